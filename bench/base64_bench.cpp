@@ -0,0 +1,189 @@
+/*
+ * base64_bench.cpp
+ *
+ * Copyright (C) 2020-2021 Max Qian
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*************************************************
+
+Copyright: 2020-2021 Max Qian. All rights reserved
+
+Author:Max Qian
+
+E-mail:astro_air@126.com
+
+Date:2021-7-12
+
+Description:Base64 codec micro-benchmark
+
+**************************************************/
+
+#include "../src/tools/ImgTools.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <functional>
+
+namespace
+{
+    /*原来的逐字符实现，作为比较的基准*/
+    std::string ScalarEncode(const unsigned char *Data,int DataByte)
+    {
+        const char EncodeTable[]="ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+        std::string strEncode;
+        unsigned char Tmp[4]={0};
+        int LineLength=0;
+        for(int i=0;i<(int)(DataByte / 3);i++)
+        {
+            Tmp[1] = *Data++;
+            Tmp[2] = *Data++;
+            Tmp[3] = *Data++;
+            strEncode+= EncodeTable[Tmp[1] >> 2];
+            strEncode+= EncodeTable[((Tmp[1] << 4) | (Tmp[2] >> 4)) & 0x3F];
+            strEncode+= EncodeTable[((Tmp[2] << 2) | (Tmp[3] >> 6)) & 0x3F];
+            strEncode+= EncodeTable[Tmp[3] & 0x3F];
+            if(LineLength+=4,LineLength==76) {strEncode+="\r\n";LineLength=0;}
+        }
+        int Mod=DataByte % 3;
+        if(Mod==1)
+        {
+            Tmp[1] = *Data++;
+            strEncode+= EncodeTable[(Tmp[1] & 0xFC) >> 2];
+            strEncode+= EncodeTable[((Tmp[1] & 0x03) << 4)];
+            strEncode+= "==";
+        }
+        else if(Mod==2)
+        {
+            Tmp[1] = *Data++;
+            Tmp[2] = *Data++;
+            strEncode+= EncodeTable[(Tmp[1] & 0xFC) >> 2];
+            strEncode+= EncodeTable[((Tmp[1] & 0x03) << 4) | ((Tmp[2] & 0xF0) >> 4)];
+            strEncode+= EncodeTable[((Tmp[2] & 0x0F) << 2)];
+            strEncode+= "=";
+        }
+        return strEncode;
+    }
+
+    std::string ScalarDecode(const char* Data,int DataByte)
+    {
+        const char DecodeTable[] =
+        {
+            0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+            0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+            62, // '+'
+            0, 0, 0,
+            63, // '/'
+            52, 53, 54, 55, 56, 57, 58, 59, 60, 61, // '0'-'9'
+            0, 0, 0, 0, 0, 0, 0,
+            0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12,
+            13, 14, 15, 16, 17, 18, 19, 20, 21, 22, 23, 24, 25, // 'A'-'Z'
+            0, 0, 0, 0, 0, 0,
+            26, 27, 28, 29, 30, 31, 32, 33, 34, 35, 36, 37, 38,
+            39, 40, 41, 42, 43, 44, 45, 46, 47, 48, 49, 50, 51, // 'a'-'z'
+        };
+        std::string strDecode;
+        int nValue;
+        int i = 0;
+        while (i < DataByte)
+        {
+            if (*Data != '\r' && *Data != '\n')
+            {
+                nValue = DecodeTable[(unsigned char)*Data++] << 18;
+                nValue += DecodeTable[(unsigned char)*Data++] << 12;
+                strDecode += (nValue & 0x00FF0000) >> 16;
+                if (*Data != '=')
+                {
+                    nValue += DecodeTable[(unsigned char)*Data++] << 6;
+                    strDecode += (nValue & 0x0000FF00) >> 8;
+                    if (*Data != '=')
+                    {
+                        nValue += DecodeTable[(unsigned char)*Data++];
+                        strDecode += nValue & 0x000000FF;
+                    }
+                }
+                i += 4;
+            }
+            else
+            {
+                Data++;
+                i++;
+            }
+        }
+        return strDecode;
+    }
+
+    /*重复运行，返回最快一次的用时(秒)*/
+    double Best(int repeat,const std::function<void()> &run)
+    {
+        double best = 1e30;
+        for(int i = 0;i < repeat;i++)
+        {
+            auto start = std::chrono::steady_clock::now();
+            run();
+            double used = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            if(used < best)
+                best = used;
+        }
+        return best;
+    }
+
+    void Report(const char *name,size_t bytes,double seconds,double baseline)
+    {
+        printf("%-28s %9.2f ms %9.1f MB/s %7.1fx\n",name,seconds * 1e3,bytes / seconds / 1e6,baseline / seconds);
+    }
+}
+
+/*
+ * 用法：base64_bench [字节数] [重复次数]
+ * 默认编码约15MB的随机数据，与一张16位全画幅图像的大小相当
+ */
+int main(int argc,char *argv[])
+{
+    using namespace AstroAir::ImageTools;
+    const size_t size = argc > 1 ? strtoull(argv[1],nullptr,10) : 4144 * 1911 * 2;
+    const int repeat = argc > 2 ? atoi(argv[2]) : 5;
+    std::vector<unsigned char> data(size);
+    std::mt19937 gen(1);
+    for(auto &it : data)
+        it = (unsigned char)gen();
+    printf("Base64 benchmark, %zu bytes, best of %d runs\n",size,repeat);
+
+    std::string old_text,new_text,new_lines;
+    double old_enc = Best(repeat,[&]{old_text = ScalarEncode(data.data(),(int)size);});
+    double new_enc = Best(repeat,[&]{new_text = base64Encode(data.data(),size);});
+    double new_enc_lines = Best(repeat,[&]{new_lines = base64Encode(data.data(),size,true);});
+    Report("encode scalar (old)",size,old_enc,old_enc);
+    Report("encode",size,new_enc,old_enc);
+    Report("encode with line breaks",size,new_enc_lines,old_enc);
+
+    std::string old_data,new_data;
+    double old_dec = Best(repeat,[&]{old_data = ScalarDecode(old_text.data(),(int)old_text.size());});
+    double new_dec = Best(repeat,[&]{new_data = base64Decode(new_text.data(),new_text.size());});
+    Report("decode scalar (old)",size,old_dec,old_dec);
+    Report("decode",size,new_dec,old_dec);
+
+    /*两种实现的结果必须一致*/
+    bool ok = new_lines == old_text
+        && std::string(data.begin(),data.end()) == new_data
+        && old_data == new_data
+        && base64Decode(new_lines.data(),new_lines.size()) == new_data;
+    printf("%s\n",ok ? "Results match" : "Results do NOT match");
+    return ok ? 0 : 1;
+}
@@ -75,7 +75,7 @@ if(HAS_OPENCV AND HAS_BASE64)
 			COMMENT "Downloaded and Building OPENCV Library"
 		)
 	endif()
-	add_library(OPENCV src/tools/ImgTools.cpp)
+	add_library(OPENCV src/tools/ImgTools.cpp src/tools/ImgPreview.cpp src/tools/ImgStretch.cpp src/tools/ImgStar.cpp src/tools/ImgStats.cpp)
 	target_link_libraries(airserver PUBLIC OPENCV)
 	target_link_libraries(airserver PUBLIC libopencv_imgcodecs.so)
 	target_link_libraries(airserver PUBLIC libopencv_core.so)
@@ -49,6 +49,24 @@ if(HAS_WEBSOCKET)
 	add_library(WEBSOCKET src/wsserver.cpp)
 	target_link_libraries(airserver PUBLIC WEBSOCKET)
 	target_link_libraries(airserver PUBLIC libpthread.so)
+	#permessage-deflate压缩，需要zlib
+	option(HAS_DEFLATE "Using permessage-deflate extension" ON)
+	if(HAS_DEFLATE)
+		find_package(ZLIB)
+		if(ZLIB_FOUND)
+			message("-- Found zlib library in ${ZLIB_LIBRARIES}")
+			target_link_libraries(airserver PUBLIC ${ZLIB_LIBRARIES})
+		else()
+			message("-- Could not found zlib library.Try to build it!")
+			add_custom_command(
+				TARGET airserver
+				PRE_BUILD
+				COMMAND sudo apt install zlib1g-dev -y
+				COMMENT "Downloaded and Building zlib Library"
+			)
+			target_link_libraries(airserver PUBLIC libz.so)
+		endif()
+	endif()
 else()
 	message("Please check setting,websocketpp is one of the main library!")
 endif()
\ No newline at end of file
@@ -0,0 +1,5 @@
+option(HAS_SIMULATOR "Using simulated camera" ON)
+if(HAS_SIMULATOR)
+	add_library(SIMULATOR src/camera/air-sim/sim_ccd.cpp)
+	target_link_libraries(airserver PUBLIC SIMULATOR)
+endif()
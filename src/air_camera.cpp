@@ -34,6 +34,10 @@ Description:Camera Offical Port
 #include "air_camera.h"
 #include "wsserver.h"
 #include "logger.h"
+#include "tools/BoundedQueue.h"
+
+#include <chrono>
+#include <algorithm>
 
 namespace AstroAir
 {
@@ -48,7 +52,8 @@ namespace AstroAir
      */
     AIRCAMERA::AIRCAMERA()
     {
-        AIRCAMINFO->InExposure = false;
+        Info = AIRCAMINFO;
+        Info->InExposure = false;
         InSequenceRun = false;
     }
 
@@ -59,12 +64,37 @@ namespace AstroAir
      */
     AIRCAMERA::~AIRCAMERA()
     {
-        if(AIRCAMINFO->InExposure|| InSequenceRun)
-            CCD->AbortExposure();
-        AIRCAMINFO->InExposure = false;
+        {
+            std::lock_guard<std::mutex> control(VideoControl);
+            VideoRun = false;
+            JoinVideo();
+        }
+        if(Info->InExposure|| InSequenceRun)
+            IDLog_Error(_("Camera %s is released during exposure\n"),Info->Instance.c_str());
+        Info->InExposure = false;
         InSequenceRun = false;
     }
 
+    /*
+     * name: SetInfo(CameraInfo *info)
+     * @param info:相机状态
+     * describe: Use a separate state block
+     * 描述：设置相机状态，主相机默认使用AIRCAMINFO
+     */
+    void AIRCAMERA::SetInfo(CameraInfo *info)
+    {
+        if(info)
+        {
+            Info = info;
+            Info->InExposure = false;
+        }
+    }
+
+    CameraInfo *AIRCAMERA::GetInfo()
+    {
+        return Info;
+    }
+
     /*
      * name: Connect()
      * describe: Connect from camera
@@ -108,7 +138,6 @@ namespace AstroAir
      * @param Offset:相机偏置
      * describe: Start exposure
      * 描述：开始曝光
-     * calls: ImagineThread()
 	 * calls: StartExposure(int exp,int bin,bool IsSave,std::string FitsName,int Gain,int Offset)
      * calls: IDLog(const char *fmt, ...)
      * calls: IDLog_DEBUG(const char *fmt, ...)
@@ -125,32 +154,39 @@ namespace AstroAir
             ShotRunningSend(0,4);
             return false;
         }
-		if(AIRCAMINFO->isCameraConnected)
+        if(Info->InVideo)
+        {
+            IDLog_Error(_("Camera %s is in video mode, stop it before exposure\n"),Info->Instance.c_str());
+            WebLog(_("Camera is in video mode, stop it before exposure"),3);
+            StartExposureError();
+            return false;
+        }
+		if(Info->isCameraConnected)
 		{
-            AIRCAMINFO->LastImageName = FitsName;
-            AIRCAMINFO->Bin = bin;
-            AIRCAMINFO->Exposure = exp;
-            AIRCAMINFO->InExposure = true;
-            std::thread CameraCountThread(&AIRCAMERA::ImagineThread,this);
-            CameraCountThread.detach();
+            Info->LastImageName = FitsName;
+            Info->Bin = bin;
+            Info->Exposure = exp;
+            /*进度信息由驱动中的WaitExposure()发送*/
+            Info->InExposure = true;
             WebLog(_("Start exposure!"),2);
-			if(!CCD->StartExposure(exp, bin, IsSave, FitsName, Gain, Offset))
+			if(!StartExposure(exp, bin, IsSave, FitsName, Gain, Offset))
 			{
 				/*返回曝光错误的原因*/
 				StartExposureError();
                 ShotRunningSend(0,4);
 				IDLog(_("Unable to start the exposure of the camera. Please check the connection of the camera. If you have any problems, please contact the developer\n"));
                 WebLog(_("Unable to start the exposure of the camera"),3);
-				AIRCAMINFO->InExposure = false;
+				Info->InExposure = false;
                 /*如果函数执行不成功返回false*/
 				return false;
 			}
-            AIRCAMINFO->InExposure = false;
+            Info->InExposure = false;
 			/*将拍摄成功的消息返回至客户端*/
 			StartExposureSuccess();
             WebLog("Successfully exposure",2);
             ShotRunningSend(100,2);
-            newJPGReadySend();
+            /*驱动在StartExposure()中已经处理了图像*/
+            newJPGReadySend(LastImage());
 		}
 		else
 		{
@@ -178,60 +214,633 @@ namespace AstroAir
         return true;
     }
 
+    /*序列拍摄中已经读出、等待保存和预览的图像*/
+    struct CaptureJob
+    {
+        FramePtr frame;
+        std::string FitsName;
+        int Index = 0;
+        double Exposure = 0;        //曝光用时(毫秒)
+        double Readout = 0;         //读出用时(毫秒)
+        std::chrono::steady_clock::time_point Queued;
+    };
+
+    /*读出后最多排队等待处理的图像数量，处理跟不上时下一次读出等待*/
+    const size_t SequenceQueueDepth = 2;
+
+    static double Milliseconds(std::chrono::steady_clock::duration d)
+    {
+        return std::chrono::duration<double,std::milli>(d).count();
+    }
+
+    /*序列中每张图像的文件名，在扩展名之前加上序号*/
+    static std::string SequenceFrameName(const std::string &name,int index,int loop)
+    {
+        if(loop <= 1 || name.empty())
+            return name;
+        char suffix[16];
+        snprintf(suffix,sizeof(suffix),"_%04d",index);
+        size_t dot = name.rfind('.'),slash = name.rfind('/');
+        if(dot != std::string::npos && (slash == std::string::npos || dot > slash))
+            return name.substr(0,dot) + suffix + name.substr(dot);
+        return name + suffix;
+    }
+
+    /*
+     * name: StartExposureSeq(int loop,int exp,int bin,bool IsSave,std::string FitsName,int Gain,int Offset)
+     * @param loop:拍摄数量
+     * @param exp:相机曝光时间
+     * @param bin:像素合并
+     * @param IsSave:是否保存图像
+     * @param FitsName:保存图像名称，多张图像时加上序号
+     * @param Gain:相机增益
+     * @param Offset:相机偏置
+     * describe: Pipelined sequence capture
+     * 描述：流水线序列拍摄，读出完成后立即开始下一次曝光，上一张图像在处理线程中保存和预览
+     * calls: StartExposure()
+     * calls: ReadoutFrame()
+     * calls: SaveFrame()
+     * calls: PreviewFrame()
+     * calls: newJPGReadySend()
+     * note: Stages are joined by a bounded queue, so a slow disk slows the capture instead of
+     *       filling memory. Every frame reports how long each stage took.
+     */
     bool AIRCAMERA::StartExposureSeq(int loop,int exp,int bin,bool IsSave,std::string FitsName,int Gain,int Offset)
     {
+        if(!Info->isCameraConnected)
+        {
+            IDLog_Error(_("Camera not connected,how do you exposure?\n"));
+            WebLog(_("Camera not connected,how do you exposure?"),3);
+            return false;
+        }
+        if(exp <= 0 || loop <= 0)
+        {
+            WebLog(_("Exposure time is less than 0, please input a reasonable data"),3);
+            return false;
+        }
+        if(Info->InVideo)
+        {
+            IDLog_Error(_("Camera %s is in video mode, stop it before exposure\n"),Info->Instance.c_str());
+            WebLog(_("Camera is in video mode, stop it before exposure"),3);
+            return false;
+        }
+        if(InSequenceRun.exchange(true))
+        {
+            IDLog_Error(_("Camera %s is already running a sequence\n"),Info->Instance.c_str());
+            WebLog(_("Camera is already running a sequence"),3);
+            return false;
+        }
+        Info->Bin = bin;
+        Info->Exposure = exp;
+        Info->Gain = Gain;
+        Info->Offset = Offset;
+        BoundedQueue<CaptureJob> queue(SequenceQueueDepth);
+        /*处理线程：保存FITS、生成预览并通知客户端*/
+        std::thread worker([this,&queue,IsSave,op = CurrentOperation()]
+        {
+            OperationScope scope(op);
+            CaptureJob job;
+            while(queue.Pop(job))
+            {
+                auto start = std::chrono::steady_clock::now();
+                if(IsSave && !SaveFrame(job.frame,job.FitsName))
+                    WebLog(_("Could not save image correctly,please check the config"),3);
+                auto saved = std::chrono::steady_clock::now();
+                ImageInfo image;
+                PreviewFrame(job.frame,&image);
+                auto end = std::chrono::steady_clock::now();
+                /*尽早归还缓冲区*/
+                job.frame.reset();
+                Info->LastImageName = job.FitsName;
+                newJPGReadySend(image);
+                if(ws.Subscribed(Topic::Progress))
+                {
+                    Json::Value Root;
+                    Root["Event"] = Json::Value("CaptureTiming");
+                    Root["Device"] = Json::Value(Info->Instance);
+                    Root["Frame"] = Json::Value(job.Index);
+                    Root["File"] = Json::Value(job.FitsName);
+                    Root["Exposure"] = Json::Value(job.Exposure);
+                    Root["Readout"] = Json::Value(job.Readout);
+                    Root["Queue"] = Json::Value(Milliseconds(start - job.Queued));
+                    Root["Save"] = Json::Value(Milliseconds(saved - start));
+                    Root["Process"] = Json::Value(Milliseconds(end - saved));
+                    ws.Publish(Topic::Progress,Root);
+                }
+            }
+        });
+        bool ok = true;
+        int frames = 0;
+        auto SeqStart = std::chrono::steady_clock::now();
+        for(int i = 1;i <= loop && InSequenceRun;i++)
+        {
+            auto start = std::chrono::steady_clock::now();
+            bool exposed = StartExposure(exp,bin,false,"",Gain,Offset);
+            auto exposed_at = std::chrono::steady_clock::now();
+            FramePtr frame = exposed ? ReadoutFrame() : nullptr;
+            auto readout_at = std::chrono::steady_clock::now();
+            if(!frame)
+            {
+                IDLog_Error(_("Sequence stopped at frame %d of %d\n"),i,loop);
+                StartExposureError();
+                ok = false;
+                break;
+            }
+            CaptureJob job;
+            job.frame = std::move(frame);
+            job.FitsName = SequenceFrameName(FitsName,i,loop);
+            job.Index = i;
+            job.Exposure = Milliseconds(exposed_at - start);
+            job.Readout = Milliseconds(readout_at - exposed_at);
+            job.Queued = readout_at;
+            if(!queue.Push(std::move(job)))
+                break;
+            frames++;
+        }
+        queue.Close();
+        worker.join();
+        InSequenceRun = false;
+        /*快门打开的时间占总时间的比例*/
+        double wall = Milliseconds(std::chrono::steady_clock::now() - SeqStart);
+        double duty = wall > 0 ? frames * exp * 1000.0 / wall * 100 : 0;
+        IDLog(_("Sequence finished, %d of %d frames, duty cycle %.1f%%\n"),frames,loop,duty);
+        WebLog(_("Sequence capture finished"),2);
+        return ok;
+    }
+
+    /*
+     * name: ReadoutFrame()
+     * describe: Read the finished exposure into a pooled buffer
+     * 描述：将曝光完成的图像读出到缓冲池中的缓冲区，由驱动实现
+     * @return 图像，失败时为空
+     * note:This function should not be executed normally
+     */
+    FramePtr AIRCAMERA::ReadoutFrame()
+    {
+        IDLog_Error(_("Camera %s does not support frame readout\n"),Info->Instance.c_str());
+        return nullptr;
+    }
+
+    /*
+     * name: SaveFrame(const FramePtr &frame,const std::string &FitsName)
+     * @param frame:读出的图像
+     * @param FitsName:保存图像名称
+     * describe: Write a frame to a FITS file
+     * 描述：将图像保存为FITS文件，相机设置由相机状态读取
+     * calls: SaveFitsImage()
+     */
+    bool AIRCAMERA::SaveFrame(const FramePtr &frame,const std::string &FitsName)
+    {
+        if(!frame)
+            return false;
+        #ifdef HAS_FITSIO
+            return FitsIO::SaveFitsImage(frame->Data(),FitsName.c_str(),frame->BitDepth > 8 ? 1 : 0,Info->isColorCamera,frame->Height,frame->Width,Info->Name[Info->ID],Info->Exposure,frame->Bin,Info->Offset,Info->Gain,Info->Temperature,frame->StartX,frame->StartY);
+        #else
+            return true;
+        #endif
+    }
+
+    /*
+     * name: PreviewFrame(const FramePtr &frame,ImageInfo *Result)
+     * @param frame:读出的图像
+     * @param Result:不为空时返回处理结果
+     * describe: Statistics, star analysis and preview of a frame
+     * 描述：计算统计信息和星点，生成预览图，处理结果和子画幅的位置保存在本相机的信息中，用于换算星点在传感器上的坐标
+     * calls: ProcessImage()
+     */
+    bool AIRCAMERA::PreviewFrame(const FramePtr &frame,ImageInfo *Result)
+    {
+        if(!frame)
+            return false;
+        #ifdef HAS_OPENCV
+            ImageInfo image;
+            if(!ImageTools::ProcessImage(frame->Data(),frame->Height,frame->Width,frame->BitDepth,frame->Channels,frame->Bayer,image))
+                return false;
+            image.StartX = frame->StartX;
+            image.StartY = frame->StartY;
+            image.Bin = frame->Bin;
+            if(Result)
+                *Result = image;
+            std::lock_guard<std::mutex> guard(Info->ImageMutex);
+            Info->LastImage = std::move(image);
+        #endif
+        return true;
+    }
+
+    ImageInfo AIRCAMERA::LastImage()
+    {
+        std::lock_guard<std::mutex> guard(Info->ImageMutex);
+        return Info->LastImage;
+    }
+
+    /*子画幅的最小边长(传感器像素)*/
+    const int MinSubframe = 16;
+    /*手动选择的位置附近多远以内的星点被认为是选中的星点(像素)*/
+    const double StarSelectRadius = 20;
+
+    /*
+     * name: SetSubframe(int X,int Y,int Width,int Height)
+     * @param X,Y:子画幅左上角(传感器像素)
+     * @param Width,Height:子画幅尺寸(传感器像素)，为0时拍摄全画幅
+     * describe: Select the region of the sensor to read out
+     * 描述：设置子画幅，超出传感器的部分向内移动，在下一次曝光时由驱动生效
+     * note: Readout, transfer, FITS writing and star analysis all scale with the
+     *       pixel count, so a 256x256 subframe is far cheaper than a full frame.
+     */
+    bool AIRCAMERA::SetSubframe(int X,int Y,int Width,int Height)
+    {
+        if(Width <= 0 || Height <= 0)
+        {
+            Info->ROI_X = Info->ROI_Y = Info->ROI_Width = Info->ROI_Height = 0;
+            return true;
+        }
+        if(Info->ImageMaxWidth <= 0 || Info->ImageMaxHeight <= 0)
+        {
+            IDLog_Error(_("Camera %s does not report its sensor size, unable to set subframe\n"),Info->Instance.c_str());
+            return false;
+        }
+        Width = std::clamp(Width,std::min(MinSubframe,Info->ImageMaxWidth),Info->ImageMaxWidth);
+        Height = std::clamp(Height,std::min(MinSubframe,Info->ImageMaxHeight),Info->ImageMaxHeight);
+        Info->ROI_X = std::clamp(X,0,Info->ImageMaxWidth - Width);
+        Info->ROI_Y = std::clamp(Y,0,Info->ImageMaxHeight - Height);
+        Info->ROI_Width = Width;
+        Info->ROI_Height = Height;
+        IDLog(_("Set subframe to %dx%d at (%d,%d)\n"),Width,Height,Info->ROI_X,Info->ROI_Y);
+        return true;
+    }
+
+    /*
+     * name: CenterSubframe(int Width,int Height,double StarX,double StarY)
+     * @param Width,Height:子画幅尺寸(传感器像素)
+     * @param StarX,StarY:选择的星点在上一张图像中的坐标，小于0时自动选择
+     * describe: Center a subframe on a star of the last image
+     * 描述：以上一张图像中的星点为中心设置子画幅，选择的位置附近有星点时使用星点的质心
+     * calls: SetSubframe()
+     * note: Repeating this before every autofocus frame keeps the star centred
+     *       while it drifts.
+     */
+    bool AIRCAMERA::CenterSubframe(int Width,int Height,double StarX,double StarY)
+    {
+        /*复制本相机上一张图像的结果，处理线程可能同时写入新的结果*/
+        const ImageInfo image = LastImage();
+        const std::vector<ImageTools::Star> &stars = image.Stars;
+        const int StartX = image.StartX,StartY = image.StartY,bin = std::max(image.Bin,1);
+        const ImageTools::Star *best = nullptr;
+        if(StarX < 0 || StarY < 0)
+        {
+            /*星点按亮度从高到低排列*/
+            for(const auto &it : stars)
+            {
+                if(!it.Saturated)
+                {
+                    best = &it;
+                    break;
+                }
+            }
+            if(!best)
+            {
+                IDLog_Error(_("No star found in the last image, unable to center subframe\n"));
+                WebLog(_("No star found in the last image, unable to center subframe"),3);
+                return false;
+            }
+        }
+        else
+        {
+            double nearest = StarSelectRadius * StarSelectRadius;
+            for(const auto &it : stars)
+            {
+                double d = (it.X - StarX) * (it.X - StarX) + (it.Y - StarY) * (it.Y - StarY);
+                if(d <= nearest)
+                {
+                    nearest = d;
+                    best = &it;
+                }
+            }
+        }
+        double x = best ? best->X : StarX,y = best ? best->Y : StarY;
+        /*换算为传感器坐标*/
+        int cx = (int)((StartX + x) * bin),cy = (int)((StartY + y) * bin);
+        return SetSubframe(cx - Width / 2,cy - Height / 2,Width,Height);
+    }
+
+    /*
+     * name: SubframeGeometry(int Bin,int WidthAlign,int &X,int &Y,int &Width,int &Height)
+     * @param Bin:像素合并
+     * @param WidthAlign:相机要求的宽度对齐
+     * @param X,Y,Width,Height:驱动使用的子画幅(合并后的像素)
+     * describe: Turn the subframe setting into binned camera coordinates
+     * 描述：将子画幅设置换算为合并后的像素，宽度按相机要求对齐，高度和起点为偶数，彩色相机的拜耳阵列不变
+     * @return true: 子画幅
+     * @return false: 全画幅
+     */
+    bool AIRCAMERA::SubframeGeometry(int Bin,int WidthAlign,int &X,int &Y,int &Width,int &Height)
+    {
+        Bin = std::max(Bin,1);
+        WidthAlign = std::max(WidthAlign,2);
+        const int MaxWidth = Info->ImageMaxWidth / Bin,MaxHeight = Info->ImageMaxHeight / Bin;
+        X = Y = 0;
+        Width = MaxWidth;
+        Height = MaxHeight;
+        if(Info->ROI_Width <= 0 || Info->ROI_Height <= 0)
+            return false;
+        int w = std::min(Info->ROI_Width / Bin,MaxWidth),h = std::min(Info->ROI_Height / Bin,MaxHeight);
+        w -= w % WidthAlign;
+        h -= h % 2;
+        if(w <= 0 || h <= 0)
+            return false;
+        Width = w;
+        Height = h;
+        X = std::clamp(Info->ROI_X / Bin,0,MaxWidth - Width) & ~1;
+        Y = std::clamp(Info->ROI_Y / Bin,0,MaxHeight - Height) & ~1;
         return true;
     }
+
+    void AIRCAMERA::StopSequence()
+    {
+        InSequenceRun = false;
+    }
     
+    /*视频读出连续失败多少次后停止*/
+    const int VideoMaxFailures = 10;
+
+    /*
+     * name: StartVideoServer(int exp,int bin,int Gain,int Offset)
+     * @param exp:单帧曝光时间(毫秒)
+     * @param bin:像素合并
+     * @param Gain:相机增益
+     * @param Offset:相机偏置
+     * describe: Start live view
+     * 描述：开始视频模式，用于对焦和构图
+     * calls: StartVideo()
+     * calls: VideoCaptureLoop()
+     * calls: VideoPreviewLoop()
+     * note: The readout thread never waits for the preview. Frames the preview
+     *       thread did not take in time are dropped and go back to the pool.
+     */
+    bool AIRCAMERA::StartVideoServer(int exp,int bin,int Gain,int Offset)
+    {
+        if(!Info->isCameraConnected)
+        {
+            IDLog_Error(_("Camera not connected,how do you start video?\n"));
+            WebLog(_("Camera not connected,how do you start video?"),3);
+            return false;
+        }
+        if(exp <= 0)
+        {
+            WebLog(_("Exposure time is less than 0, please input a reasonable data"),3);
+            return false;
+        }
+        std::lock_guard<std::mutex> control(VideoControl);
+        if(Info->InExposure || Info->InVideo || InSequenceRun)
+        {
+            IDLog_Error(_("Camera %s is busy, unable to start video\n"),Info->Instance.c_str());
+            WebLog(_("Camera is busy, unable to start video"),3);
+            return false;
+        }
+        /*上一次视频因错误停止时线程已经退出*/
+        JoinVideo();
+        if(!StartVideo(exp,bin,Gain,Offset))
+        {
+            IDLog_Error(_("Unable to start video capture of camera %s\n"),Info->Instance.c_str());
+            WebLog(_("Unable to start video capture"),3);
+            return false;
+        }
+        Info->InVideo = true;
+        Info->Bin = bin;
+        Info->Gain = Gain;
+        Info->Offset = Offset;
+        VideoRing.Clear();
+        VideoRun = true;
+        VideoCaptureThread = std::thread([this]{VideoCaptureLoop();});
+        VideoPreviewThread = std::thread([this]{VideoPreviewLoop();});
+        WebLog(_("Start video capture"),2);
+        return true;
+    }
+
+    /*
+     * name: StopVideoServer()
+     * describe: Stop live view
+     * 描述：停止视频模式，等待读出和预览线程退出后再停止相机
+     * calls: StopVideo()
+     * note: Holds VideoControl, so a stop issued while StartVideoServer() is still
+     *       running waits for it instead of being lost, and a disconnect cannot
+     *       join the video threads at the same time as a client stop.
+     */
+    bool AIRCAMERA::StopVideoServer()
+    {
+        std::lock_guard<std::mutex> control(VideoControl);
+        if(!Info->InVideo)
+            return true;
+        VideoRun = false;
+        JoinVideo();
+        bool ret = StopVideo();
+        Info->InVideo = false;
+        IDLog(_("Stop video capture, %llu frames dropped\n"),(unsigned long long)VideoRing.DroppedFrames());
+        {
+            std::lock_guard<std::mutex> guard(VideoMutex);
+            VideoFrame.reset();
+        }
+        VideoRing.Clear();
+        if(!ret)
+            WebLog(_("Unable to stop video capture"),3);
+        else
+            WebLog(_("Stop video capture"),2);
+        return ret;
+    }
+
+    void AIRCAMERA::JoinVideo()
+    {
+        if(VideoCaptureThread.joinable())
+            VideoCaptureThread.join();
+        if(VideoPreviewThread.joinable())
+            VideoPreviewThread.join();
+    }
+
+    FramePtr AIRCAMERA::LatestVideoFrame()
+    {
+        std::lock_guard<std::mutex> guard(VideoMutex);
+        return VideoFrame;
+    }
+
+    /*
+     * name: VideoCaptureLoop()
+     * describe: Read frames as fast as the camera delivers them
+     * 描述：读出线程，图像放入环形缓冲区后立即读取下一帧
+     * calls: ReadoutVideoFrame()
+     */
+    void AIRCAMERA::VideoCaptureLoop()
+    {
+        int failures = 0;
+        while(VideoRun)
+        {
+            FramePtr frame = ReadoutVideoFrame();
+            if(!frame)
+            {
+                if(VideoRun && ++failures >= VideoMaxFailures)
+                {
+                    IDLog_Error(_("Video capture of camera %s failed %d times, stopped\n"),Info->Instance.c_str(),failures);
+                    WebLog(_("Video capture failed, please stop and restart it"),3);
+                    VideoRun = false;
+                }
+                continue;
+            }
+            failures = 0;
+            VideoRing.Publish(std::move(frame));
+        }
+    }
+
+    /*
+     * name: VideoPreviewLoop()
+     * describe: Send previews of the latest frame at a capped rate
+     * 描述：预览线程，按照限制的帧率取走最新的图像，有客户端订阅图像时缩小后发送
+     * calls: ProcessVideoFrame()
+     * calls: sendImage()
+     */
+    void AIRCAMERA::VideoPreviewLoop()
+    {
+        using clock = std::chrono::steady_clock;
+        clock::time_point next = clock::now();
+        unsigned long long count = 0;
+        while(VideoRun)
+        {
+            const clock::duration period = std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(1.0 / std::max(IMGSET->VideoPreviewFps,1)));
+            std::this_thread::sleep_until(next);
+            /*处理比帧间隔慢时不追赶*/
+            next = std::max(next + period,clock::now());
+            FramePtr frame = VideoRing.Latest();
+            if(!frame)
+                continue;
+            {
+                std::lock_guard<std::mutex> guard(VideoMutex);
+                VideoFrame = frame;
+            }
+            count++;
+            if(!ws.Subscribed(Topic::Images))
+                continue;
+            #ifdef HAS_OPENCV
+                unsigned int ImageID = 0;
+                if(!ImageTools::ProcessVideoFrame(frame->Data(),frame->Height,frame->Width,frame->BitDepth,frame->Channels,frame->Bayer,ImageID))
+                    continue;
+                Json::Value Root;
+                Root["Event"] = Json::Value("NewVideoFrame");
+                Root["Device"] = Json::Value(Info->Instance);
+                Root["Frame"] = Json::Value((Json::UInt64)count);
+                Root["Dropped"] = Json::Value((Json::UInt64)VideoRing.DroppedFrames());
+                Root["PixelDimX"] = Json::Value(frame->Width);
+                Root["PixelDimY"] = Json::Value(frame->Height);
+                Root["Bin"] = Json::Value(Info->Bin);
+                Root["TimeInfo"] = Json::Value(timestampW());
+                ws.sendImage(Root,ImageID);
+            #endif
+        }
+    }
+
+    /*
+     * name: StartVideo(int exp,int bin,int Gain,int Offset)
+     * describe: Start video capture
+     * 描述：开始视频拍摄，由驱动实现
+     * note:This function should not be executed normally
+     */
+    bool AIRCAMERA::StartVideo(int exp,int bin,int Gain,int Offset)
+    {
+        IDLog_Error(_("Camera %s does not support video capture\n"),Info->Instance.c_str());
+        return false;
+    }
+
+    bool AIRCAMERA::StopVideo()
+    {
+        return true;
+    }
+
+    FramePtr AIRCAMERA::ReadoutVideoFrame()
+    {
+        return nullptr;
+    }
+
+    /*进度信息的发送间隔*/
+    const std::chrono::seconds ProgressInterval(1);
+    /*预计结束前多久开始查询相机状态*/
+    const std::chrono::milliseconds PollLead(100);
+    /*查询相机状态的间隔*/
+    const std::chrono::milliseconds PollInterval(5);
+
     /*
-     * name: ImagineThread()
-     * describe: Calculate the remaining exposure time
-     * 描述：计算曝光剩余时间
+     * name: WaitExposure(double seconds,const std::function<ExposureState()> &Status)
+     * @param seconds:曝光时间
+     * @param Status:查询相机曝光状态，为空时等到预计结束时间
+     * describe: Sleep until the exposure is nearly over, then poll the camera
+     * 描述：按单调时钟计算结束时间，在此之前休眠并每秒发送进度，临近结束时频繁查询相机状态
      * calls: ShotRunningSend()
-     * note: This thread is orphan. Please note
+     * @return true: 曝光完成
+     * @return false: 曝光被中止或相机报告错误
+     * note: A 300 s exposure now wakes about once a second rather than every 10 ms.
+     *       AbortExposure() clears InExposure and calls WakeExposure(), so aborting
+     *       does not wait for the next progress tick.
      */
-    void AIRCAMERA::ImagineThread()
+    bool AIRCAMERA::WaitExposure(double seconds,const std::function<ExposureState()> &Status)
+    {
+        using clock = std::chrono::steady_clock;
+        const clock::time_point start = clock::now();
+        const clock::time_point deadline = start + std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(seconds));
+        const clock::time_point PollStart = Status ? deadline - PollLead : deadline;
+        clock::time_point next = start + ProgressInterval;
+        Info->ExposureUsed = 0;
+        std::unique_lock<std::mutex> lock(ExposureMutex);
+        while(Info->InExposure)
+        {
+            if(clock::now() >= PollStart)
+                break;
+            ExposureCond.wait_until(lock,std::min(next,PollStart),[this]{return !Info->InExposure;});
+            const clock::time_point now = clock::now();
+            if(now >= next && Info->InExposure)
+            {
+                next += ProgressInterval;
+                /*发送时不持有锁，中止曝光不需要等待网络*/
+                lock.unlock();
+                Info->ExposureUsed = std::chrono::duration<double>(now - start).count();
+                ShotRunningSend(std::min(Info->ExposureUsed / seconds * 100,100.0),1);
+                lock.lock();
+            }
+        }
+        lock.unlock();
+        if(!Info->InExposure)
+            return false;
+        if(Status)
+        {
+            /*相机读出需要一段时间，实际结束时间可能晚于预计时间*/
+            for(;;)
+            {
+                ExposureState state = Status();
+                if(state == ExposureState::Done)
+                    break;
+                if(state == ExposureState::Failed || !Info->InExposure)
+                    return false;
+                std::this_thread::sleep_for(PollInterval);
+            }
+        }
+        Info->ExposureUsed = seconds;
+        return true;
+    }
+
+    void AIRCAMERA::WakeExposure()
     {
-        while(AIRCAMINFO->ExposureUsed < AIRCAMINFO->Exposure && AIRCAMINFO->InExposure)
         {
-            sleep(1);
-            AIRCAMINFO->ExposureUsed++;
-            ShotRunningSend((AIRCAMINFO->ExposureUsed/AIRCAMINFO->Exposure)*100,1);
+            std::lock_guard<std::mutex> guard(ExposureMutex);
         }
-        AIRCAMINFO->ExposureUsed = 0;
+        ExposureCond.notify_all();
     }
 
     /*
      * name: AbortExposure()
      * describe: Abort exposure
-     * 描述：停止曝光
-     * calls: IDLog(const char *fmt, ...)
-     * calls: IDLog_DEBUG(const char *fmt, ...)
+     * 描述：停止曝光，由驱动实现
+     * note:This function should not be executed normally
      */
     bool AIRCAMERA::AbortExposure()
     {
-		if(AIRCAMINFO->isCameraConnected)
-		{
-			if (!CCD->AbortExposure())
-			{
-				/*返回曝光错误的原因*/
-				AbortExposureError();
-                WebLog(_("Unable to stop the exposure of the camera"),3);
-				IDLog_Error(_("Unable to stop the exposure of the camera. Please check the connection of the camera. If you have any problems, please contact the developer\n"));
-				/*如果函数执行不成功返回false*/
-				return false;
-			}
-			/*将拍摄成功的消息返回至客户端*/
-			AbortExposureSuccess();
-            WebLog(_("Abort exposure successfully"),2);
-		}
-		else
-		{
-            WebLog(_("Unable to stop the exposure of the camera"),3);
-			IDLog_Error(_("Try to stop exposure,Should never get here.\n"));
-			return false;
-        }
-        return true;
+        IDLog_Error(_("Camera %s does not support aborting exposures\n"),Info->Instance.c_str());
+        WebLog(_("Unable to stop the exposure of the camera"),3);
+        return false;
     }
     
     /*
@@ -245,7 +854,7 @@ namespace AstroAir
     {
         if(CoolerOFF)
         {
-            if(!CCD->Cooling(false,false,false,false,true,CamTemp))
+            if(!Cooling(false,false,false,false,true,CamTemp))
             {
                 IDLog_Error(_("Unable to turn off the camera cooling mode, please check the condition of the device\n"));
                 WebLog(_("Unable to turn off the camera cooling mode"),3);
@@ -254,7 +863,7 @@ namespace AstroAir
         }
         if(CoolerOFF)
         {
-            if(!CCD->Cooling(true,false,false,false,false,CamTemp))
+            if(!Cooling(true,false,false,false,false,CamTemp))
             {
                 IDLog_Error(_("Unable to turn on the camera cooling mode, please check the condition of the device\n"));
                 WebLog(_("Unable to turn on the camera cooling mode"),3);
@@ -263,7 +872,7 @@ namespace AstroAir
         }
 		if(CoolDown)
 		{
-			if(CCD->Cooling(false,true,false,false,false,CamTemp) != true)
+			if(Cooling(false,true,false,false,false,CamTemp) != true)
 			{
 				IDLog_Error(_("The camera can't cool down normally, please check the condition of the equipment\n"));
 				WebLog(_("The camera can't cool down normally"),3);
@@ -272,7 +881,7 @@ namespace AstroAir
 		}
 		if(Warmup)
 		{
-			if(!CCD->Cooling(false,false,false,true,false,CamTemp))
+			if(!Cooling(false,false,false,true,false,CamTemp))
 			{
 				IDLog_Error(_("The camera can't warm up normally, please check the condition of the equipment\n"));
 				WebLog(_("The camera can't warm up normally"),3);
@@ -309,7 +918,7 @@ namespace AstroAir
         Root["Event"] = Json::Value("RemoteActionResult");
         Root["UID"] = Json::Value("RemoteCameraShot");
         Root["ActionResultInt"] = Json::Value(4);
-        ws.send(Root.toStyledString());
+        ws.send(Root);
 	}
 	
     /*
@@ -327,7 +936,7 @@ namespace AstroAir
         Root["Event"] = Json::Value("RemoteActionResult");
         Root["UID"] = Json::Value("RemoteCameraShot");
         Root["ActionResultInt"] = Json::Value(6);
-        ws.send(Root.toStyledString());
+        ws.send(Root);
 	}
 
 	/*
@@ -346,7 +955,7 @@ namespace AstroAir
         Root["Event"] = Json::Value("RemoteActionResult");
         Root["UID"] = Json::Value("RemoteCameraShot");
         Root["ActionResultInt"] = Json::Value(5);
-		ws.send(Root.toStyledString());
+		ws.send(Root);
     }
     
     /*
@@ -365,37 +974,82 @@ namespace AstroAir
         Root["Event"] = Json::Value("RemoteActionResult");
         Root["UID"] = Json::Value("RemoteCameraShot");
         Root["ActionResultInt"] = Json::Value(5);
-		ws.send(Root.toStyledString());
+		ws.send(Root);
     }
     
     /*
-	 * name: ShotRunningSend(int ElapsedPerc,int id)
+	 * name: ShotRunningSend(double ElapsedPerc,int id)
      * @param ElapsedPerc:已完成进度
      * @param id:状态
 	 * describe: Send exposure information
 	 * 描述：发送曝光信息
 	 * calls: send()
 	 */
-    void AIRCAMERA::ShotRunningSend(int ElapsedPerc,int id)
+    void AIRCAMERA::ShotRunningSend(double ElapsedPerc,int id)
     {
+        ReportProgress((int)ElapsedPerc);
+        if(!ws.Subscribed(Topic::Progress))
+            return;
         Json::Value Root;
         Root["Event"] = Json::Value("ShotRunning");
         Root["ElapsedPerc"] = Json::Value(ElapsedPerc);
         Root["Status"] = Json::Value(id);
-        Root["File"] = Json::Value(AIRCAMINFO->LastImageName);
-        Root["Expo"] = Json::Value(AIRCAMINFO->Exposure);
-        Root["Elapsed"] = Json::Value(AIRCAMINFO->ExposureUsed);
-		ws.send(Root.toStyledString());
+        Root["File"] = Json::Value(Info->LastImageName);
+        Root["Expo"] = Json::Value(Info->Exposure);
+        Root["Elapsed"] = Json::Value(Info->ExposureUsed);
+        Root["Device"] = Json::Value(Info->Instance);
+		ws.Publish(Topic::Progress,Root);
+    }
+
+    /*
+     * name: HistogramJson(const ImageTools::ImageStats &stats,int bins)
+     * @param stats:图像统计信息
+     * @param bins:区间数，全分辨率的直方图按此合并
+     * describe: Statistics and a reduced histogram for client histogram widgets
+     * 描述：生成发送给客户端的统计信息和合并后的直方图，彩色图像按R、G、B排列
+     */
+    static Json::Value HistogramJson(const ImageTools::ImageStats &stats,int bins)
+    {
+        Json::Value Histogram;
+        Histogram["BitDepth"] = Json::Value(stats.BitDepth);
+        Histogram["Bins"] = Json::Value(bins);
+        const char *Names[3] = {"B","G","R"};
+        for(int c = (int)stats.Channels.size() - 1;c >= 0;c--)
+        {
+            const ImageTools::ChannelStats &channel = stats.Channels[c];
+            Json::Value Channel;
+            Channel["Channel"] = Json::Value(stats.Channels.size() == 3 ? Names[c] : "L");
+            Channel["Min"] = Json::Value(channel.Min);
+            Channel["Max"] = Json::Value(channel.Max);
+            Channel["Mean"] = Json::Value(channel.Mean);
+            Channel["Median"] = Json::Value(channel.Median);
+            Channel["MAD"] = Json::Value(channel.MAD);
+            Channel["Saturated"] = Json::Value((Json::UInt64)channel.Saturated);
+            /*每个区间包含相同数量的像素值*/
+            const size_t Levels = channel.Histogram.size();
+            Json::Value Data(Json::arrayValue);
+            for(int i = 0;i < bins;i++)
+            {
+                uint64_t sum = 0;
+                for(size_t j = Levels * i / bins;j < Levels * (i + 1) / bins;j++)
+                    sum += channel.Histogram[j];
+                Data.append(Json::Value((Json::UInt64)sum));
+            }
+            Channel["Data"] = Data;
+            Histogram["Channels"].append(Channel);
+        }
+        return Histogram;
     }
 
     /*
-	 * name: newJPGReadySend()
+	 * name: newJPGReadySend(const ImageInfo &Image)
+	 * @param Image:该图像的处理结果
 	 * describe: Send the message that the picture is ready to the client
 	 * 描述：将图片准备就绪的消息传给客户端
 	 * calls: send()
      * calls: imread()
 	 */
-    void AIRCAMERA::newJPGReadySend()
+    void AIRCAMERA::newJPGReadySend(const ImageInfo &Image)
     {
         auto start = std::chrono::high_resolution_clock::now();
         /*组合即将发送的json信息*/
@@ -403,19 +1057,24 @@ namespace AstroAir
         Root["Event"] = Json::Value("NewJPGReady");
         Root["UID"] = Json::Value("RemoteCameraShot");
         Root["ActionResultInt"] = Json::Value(5);
-        Root["Base64Data"] = Json::Value(IMGINFO->img_data);
-        Root["PixelDimX"] = Json::Value(AIRCAMINFO->Image_Width);
-        Root["PixelDimY"] = Json::Value(AIRCAMINFO->Image_Height);
+        Root["PixelDimX"] = Json::Value(Info->Image_Width);
+        Root["PixelDimY"] = Json::Value(Info->Image_Height);
+        Root["StartX"] = Json::Value(Image.StartX);
+        Root["StartY"] = Json::Value(Image.StartY);
         Root["SequenceTarget"] = Json::Value(SequenceTarget);
-        Root["Bin"] = Json::Value(AIRCAMINFO->Bin);
-        Root["StarIndex"] = Json::Value(IMGINFO->StarIndex);
-        Root["HFD"] = Json::Value(IMGINFO->HFD);
-        Root["Expo"] = Json::Value(AIRCAMINFO->Exposure);
+        Root["Bin"] = Json::Value(Info->Bin);
+        Root["StarIndex"] = Json::Value(Image.StarIndex);
+        Root["HFD"] = Json::Value(Image.HFD);
+        Root["FWHM"] = Json::Value(Image.FWHM);
+        if(IMGSET->HistogramBins > 0 && !Image.Stats.Channels.empty())
+            Root["Histogram"] = HistogramJson(Image.Stats,IMGSET->HistogramBins);
+        Root["Expo"] = Json::Value(Info->Exposure);
         Root["TimeInfo"] = Json::Value(timestampW());
-        Root["File"] = Json::Value(AIRCAMINFO->LastImageName);
+        Root["File"] = Json::Value(Info->LastImageName);
         Root["Filter"] = Json::Value("** BayerMatrix **");
-        /*发送信息*/
-		ws.send(Root.toStyledString());
+        Root["Device"] = Json::Value(Info->Instance);
+        /*发送信息，图像数据根据客户端协议和订阅的预览等级以Base64或二进制帧发送*/
+		ws.sendImage(Root,Image.ImageID);
         auto end = std::chrono::high_resolution_clock::now();
         std::chrono::duration<double> diff = end - start;
         IDLog(_("Progress image took %g seconds\n"), diff.count());
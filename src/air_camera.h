@@ -36,26 +36,36 @@ Description:Camera Offical Port
 
 #include <string>
 #include <atomic>
+#include <functional>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
 
 #include "tools/ImgTools.h"
+#include "tools/FramePool.h"
+#include "tools/FrameRing.h"
 #include "tools/ImgFitsIO.h"
 
 #define MAXDEVICE 5
 
 namespace AstroAir
 {
+    struct CameraInfo;
+
+    /*相机报告的曝光状态*/
+    enum class ExposureState {Working,Done,Failed};
+
     class AIRCAMERA
     {
         public:
             explicit AIRCAMERA();
-            ~AIRCAMERA();
+            virtual ~AIRCAMERA();
             virtual bool Connect(std::string Device_name);      //连接相机
 			virtual bool Disconnect();                          //断开连接
 			virtual std::string ReturnDeviceName();             //返回设备名称
             virtual bool StartExposure(int exp,int bin,bool IsSave,std::string FitsName,int Gain,int Offset);
             virtual bool StartExposureServer(int exp,int bin,bool IsSave,std::string FitsName,int Gain,int Offset);
             virtual bool StartExposureSeq(int loop,int exp,int bin,bool IsSave,std::string FitsName,int Gain,int Offset);
-            virtual void ImagineThread();
             virtual bool AbortExposure();
             virtual bool Cooling(bool SetPoint,bool CoolDown,bool ASync,bool Warmup,bool CoolerOFF,int CamTemp);
             virtual bool CoolingServer(bool SetPoint,bool CoolDown,bool ASync,bool Warmup,bool CoolerOFF,int CamTemp);
@@ -63,12 +73,58 @@ namespace AstroAir
             virtual void AbortExposureSuccess();
             virtual void StartExposureError();
             virtual void AbortExposureError();
-            virtual void ShotRunningSend(int ElapsedPerc,int id);
-            virtual void newJPGReadySend();
+            virtual void ShotRunningSend(double ElapsedPerc,int id);
+            virtual void newJPGReadySend(const ImageInfo &Image);
+            /*曝光结束后读出图像，保存和预览在其他线程中进行，读出后即可开始下一次曝光*/
+            virtual FramePtr ReadoutFrame();
+            virtual bool SaveFrame(const FramePtr &frame,const std::string &FitsName);
+            virtual bool PreviewFrame(const FramePtr &frame,ImageInfo *Result = nullptr);
+            /*本相机上一张预览图像的处理结果*/
+            ImageInfo LastImage();
+            /*停止正在进行的序列拍摄，当前曝光结束后不再开始新的曝光*/
+            void StopSequence();
+            /*视频模式，读出线程只保留最新的图像，预览线程按照限制的帧率发送预览*/
+            virtual bool StartVideoServer(int exp,int bin,int Gain,int Offset);
+            virtual bool StopVideoServer();
+            /*预览线程最近取走的视频图像，用于对焦等需要原始数据的功能*/
+            FramePtr LatestVideoFrame();
+            /*视频模式的驱动接口，曝光时间单位为毫秒*/
+            virtual bool StartVideo(int exp,int bin,int Gain,int Offset);
+            virtual bool StopVideo();
+            virtual FramePtr ReadoutVideoFrame();
+            /*子画幅，坐标和尺寸为传感器像素，宽或高为0时拍摄全画幅，下一次曝光生效*/
+            virtual bool SetSubframe(int X,int Y,int Width,int Height);
+            /*以上一张图像中的星点为中心设置子画幅，坐标小于0时选择最亮的未饱和星点*/
+            bool CenterSubframe(int Width,int Height,double StarX = -1,double StarY = -1);
 
             virtual void CameraGUI(bool* p_open);
+            /*设置相机状态，同一服务器中的多个相机各自拥有独立的状态*/
+            void SetInfo(CameraInfo *info);
+            CameraInfo *GetInfo();
+        protected:
+            CameraInfo *Info;
+            /*等待曝光结束并发送进度，临近结束前休眠，之后再查询相机状态*/
+            bool WaitExposure(double seconds,const std::function<ExposureState()> &Status = nullptr);
+            /*中止曝光后唤醒WaitExposure*/
+            void WakeExposure();
+            /*按照合并模式计算驱动使用的子画幅(合并后的像素)，宽度按WidthAlign对齐，返回是否为子画幅*/
+            bool SubframeGeometry(int Bin,int WidthAlign,int &X,int &Y,int &Width,int &Height);
         private:
 			std::atomic_bool InSequenceRun;
+            std::mutex ExposureMutex;
+            std::condition_variable ExposureCond;
+            /*视频模式*/
+            void VideoCaptureLoop();
+            void VideoPreviewLoop();
+            void JoinVideo();
+            std::atomic_bool VideoRun{false};
+            FrameRing VideoRing;
+            std::thread VideoCaptureThread;
+            std::thread VideoPreviewThread;
+            std::mutex VideoMutex;
+            FramePtr VideoFrame;
+            /*开始、停止视频和回收视频线程互斥，断开连接时停止视频可能与客户端命令同时发生*/
+            std::mutex VideoControl;
     };
     extern AIRCAMERA *CCD;
 
@@ -82,7 +138,7 @@ namespace AstroAir
         /*相机设置*/
         int Bin;
         int Exposure;
-        int ExposureUsed;
+        double ExposureUsed = 0;       //已曝光的时间(秒)
         double Temperature = 0;
         int Offset;
         int Gain;
@@ -92,6 +148,17 @@ namespace AstroAir
         int Image_Width;
         int ImageMaxHeight;
         int ImageMaxWidth;
+        /*子画幅设置(传感器像素)，宽或高为0时拍摄全画幅*/
+        int ROI_X = 0;
+        int ROI_Y = 0;
+        int ROI_Width = 0;
+        int ROI_Height = 0;
+        /*当前图像在传感器上的起点(合并后的像素)*/
+        int StartX = 0;
+        int StartY = 0;
+        /*上一张预览图像的处理结果，星点用于以星点为中心设置子画幅，由ImageMutex保护*/
+        ImageInfo LastImage;
+        std::mutex ImageMutex;
         std::string LastImageName;
         /*连接相机*/
         int Count;
@@ -101,6 +168,9 @@ namespace AstroAir
         bool isCoolCamera;
         bool isColorCamera;
         bool isGuidingCamera;
+        std::string BayerPattern;       //原始图像的拜耳阵列(RGGB、BGGR、GRBG或GBRG)，黑白相机为空
+        /*设备实例名称*/
+        std::string Instance;
     };extern CameraInfo *AIRCAMINFO;
 
     
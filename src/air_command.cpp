@@ -0,0 +1,117 @@
+/*
+ * air_command.cpp
+ *
+ * Copyright (C) 2020-2021 Max Qian
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*************************************************
+
+Copyright: 2020-2021 Max Qian. All rights reserved
+
+Author:Max Qian
+
+E-mail:astro_air@126.com
+
+Date:2021-7-12
+
+Description:Command dispatch table
+
+**************************************************/
+
+#include "air_command.h"
+
+namespace AstroAir
+{
+    /*
+     * name: CheckParams(const CommandEntry &cmd,const CommandParams &params,std::string &bad)
+     * @param cmd:命令
+     * @param params:客户端发送的参数
+     * @param bad:不符合要求的参数名称
+     * describe: Check parameters against the schema of the command
+     * 描述：检查参数是否符合命令的要求，可选参数存在时也必须是正确的类型
+     */
+    bool CheckParams(const CommandEntry &cmd,const CommandParams &params,std::string &bad)
+    {
+        for(size_t i = 0;i < cmd.param_num;i++)
+        {
+            const ParamSpec &spec = cmd.params[i];
+            if(!params.Has(spec.name))
+            {
+                if(spec.required)
+                {
+                    bad = spec.name;
+                    return false;
+                }
+                continue;
+            }
+            const Json::Value &value = params.Raw()[spec.name];
+            bool ok = false;
+            switch(spec.type)
+            {
+                case ParamType::Int:
+                    ok = value.isConvertibleTo(Json::intValue);
+                    break;
+                case ParamType::Bool:
+                    ok = value.isConvertibleTo(Json::booleanValue);
+                    break;
+                case ParamType::Double:
+                    ok = value.isConvertibleTo(Json::realValue);
+                    break;
+                case ParamType::String:
+                    ok = value.isConvertibleTo(Json::stringValue);
+                    break;
+            }
+            if(!ok)
+            {
+                bad = spec.name;
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /*
+     * name: Record(std::chrono::steady_clock::duration used)
+     * @param used:命令执行时间
+     * describe: Count one call of the command
+     * 描述：记录一次命令执行
+     */
+    void CommandMetrics::Record(std::chrono::steady_clock::duration used)
+    {
+        uint64_t us = std::chrono::duration_cast<std::chrono::microseconds>(used).count();
+        int bucket = 0;
+        while(bucket < Buckets - 1 && (1ull << bucket) <= us)
+            bucket++;
+        Calls++;
+        TotalUs += us;
+        Histogram[bucket]++;
+        uint64_t max = MaxUs;
+        while(us > max && !MaxUs.compare_exchange_weak(max,us));
+    }
+
+    Json::Value CommandMetrics::ToJson() const
+    {
+        Json::Value Root;
+        Root["Calls"] = Json::Value((Json::UInt64)Calls);
+        Root["Rejected"] = Json::Value((Json::UInt64)Rejected);
+        Root["TotalUs"] = Json::Value((Json::UInt64)TotalUs);
+        Root["MaxUs"] = Json::Value((Json::UInt64)MaxUs);
+        Root["Histogram"] = Json::Value(Json::arrayValue);
+        for(int i = 0;i < Buckets;i++)
+            Root["Histogram"].append((Json::UInt64)Histogram[i]);
+        return Root;
+    }
+}
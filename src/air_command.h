@@ -0,0 +1,233 @@
+/*
+ * air_command.h
+ *
+ * Copyright (C) 2020-2021 Max Qian
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*************************************************
+
+Copyright: 2020-2021 Max Qian. All rights reserved
+
+Author:Max Qian
+
+E-mail:astro_air@126.com
+
+Date:2021-7-12
+
+Description:Command dispatch table
+
+**************************************************/
+
+#ifndef _AIR_COMMAND_H_
+#define _AIR_COMMAND_H_
+
+#include "air_message.h"
+#include "air_operation.h"
+
+#include <json/json.h>
+
+#include <cstdint>
+#include <cstddef>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <string_view>
+
+namespace AstroAir
+{
+    /*命令执行方式*/
+    enum class CommandExec
+    {
+        Inline,     //在网络线程中直接执行，只能用于不会阻塞的命令
+        Pooled,     //在任务池中与其他命令并行执行
+        Queue       //在设备串行队列中执行
+    };
+
+    /*参数类型*/
+    enum class ParamType
+    {
+        Int,
+        Bool,
+        Double,
+        String
+    };
+
+    /*参数说明，缺少必需参数或类型不正确的命令不会被执行*/
+    struct ParamSpec
+    {
+        const char *name;
+        ParamType type;
+        bool required;
+    };
+
+    typedef void (*CommandHandler)(const Message &message);
+
+    /*命令表中的一项*/
+    struct CommandEntry
+    {
+        const char *method = "";
+        CommandExec exec = CommandExec::Inline;
+        const char *queue = "";
+        CommandHandler handler = nullptr;
+        const ParamSpec *params = nullptr;
+        size_t param_num = 0;
+        CancelHandler cancel = nullptr;     //客户端取消请求时执行
+
+        constexpr CommandEntry() = default;
+        constexpr CommandEntry(const char *m,CommandExec e,const char *q,CommandHandler h)
+            : method(m),exec(e),queue(q),handler(h) {}
+        template<size_t N>
+        constexpr CommandEntry(const char *m,CommandExec e,const char *q,CommandHandler h,const ParamSpec (&p)[N])
+            : method(m),exec(e),queue(q),handler(h),params(p),param_num(N) {}
+        /*设置取消操作时执行的函数*/
+        constexpr CommandEntry WithCancel(CancelHandler c) const
+        {
+            CommandEntry e = *this;
+            e.cancel = c;
+            return e;
+        }
+    };
+
+    /*检查参数是否符合命令的要求，不符合时返回参数名称*/
+    bool CheckParams(const CommandEntry &cmd,const CommandParams &params,std::string &bad);
+
+    /*
+        带种子的FNV-1a，用于生成完美哈希
+        FNV的低位只由种子和字符的低位决定，查表只使用低位，所以最后需要把高位混合进来，
+        否则只有很少的种子是真正不同的
+    */
+    constexpr uint32_t CommandHash(std::string_view s,uint32_t seed)
+    {
+        uint32_t h = 2166136261u ^ seed;
+        for(char c : s)
+        {
+            h ^= (unsigned char)c;
+            h *= 16777619u;
+        }
+        h ^= h >> 16;
+        h *= 0x7feb352du;
+        h ^= h >> 15;
+        return h;
+    }
+
+    /*
+        命令分发表
+        编译时寻找一个种子，使所有命令的哈希值互不冲突
+        查找时仍然比较命令名称，未知命令不会被误认为其他命令
+    */
+    template<size_t N>
+    class CommandTable
+    {
+        public:
+            static constexpr size_t Slots = [](){size_t n = 1;while(n < N * 4) n <<= 1;return n;}();
+
+            constexpr explicit CommandTable(const std::array<CommandEntry,N> &list) : entries(list)
+            {
+                for(uint32_t s = 1;s < 1000000;s++)
+                {
+                    if(TrySeed(s))
+                    {
+                        seed = s;
+                        return;
+                    }
+                }
+            }
+
+            /*是否找到了完美哈希*/
+            constexpr bool Valid() const
+            {
+                return seed != 0;
+            }
+
+            /*命令名称是否重复*/
+            constexpr bool Unique() const
+            {
+                for(size_t i = 0;i < N;i++)
+                    for(size_t j = i + 1;j < N;j++)
+                        if(std::string_view(entries[i].method) == std::string_view(entries[j].method))
+                            return false;
+                return true;
+            }
+
+            const CommandEntry *Find(std::string_view method) const
+            {
+                int i = slot[CommandHash(method,seed) & (Slots - 1)];
+                if(i < 0 || method != entries[i].method)
+                    return nullptr;
+                return &entries[i];
+            }
+
+            constexpr size_t Index(const CommandEntry *cmd) const
+            {
+                return cmd - entries.data();
+            }
+
+            constexpr size_t Size() const
+            {
+                return N;
+            }
+
+            constexpr const CommandEntry &operator[](size_t i) const
+            {
+                return entries[i];
+            }
+        private:
+            constexpr bool TrySeed(uint32_t s)
+            {
+                for(auto &i : slot)
+                    i = -1;
+                for(size_t i = 0;i < N;i++)
+                {
+                    int16_t &pos = slot[CommandHash(entries[i].method,s) & (Slots - 1)];
+                    if(pos >= 0)
+                        return false;
+                    pos = (int16_t)i;
+                }
+                return true;
+            }
+
+            std::array<CommandEntry,N> entries;
+            std::array<int16_t,Slots> slot {};
+            uint32_t seed = 0;
+    };
+
+    template<size_t N>
+    constexpr CommandTable<N> MakeCommandTable(const std::array<CommandEntry,N> &list)
+    {
+        return CommandTable<N>(list);
+    }
+
+    /*
+        命令统计
+        记录调用次数、被拒绝的次数和执行时间分布
+        第i个区间表示执行时间小于2^i微秒
+    */
+    struct CommandMetrics
+    {
+        static constexpr int Buckets = 24;
+        std::atomic_uint64_t Calls {0};
+        std::atomic_uint64_t Rejected {0};
+        std::atomic_uint64_t TotalUs {0};
+        std::atomic_uint64_t MaxUs {0};
+        std::atomic_uint64_t Histogram[Buckets] = {};
+
+        void Record(std::chrono::steady_clock::duration used);
+        Json::Value ToJson() const;
+    };
+}
+
+#endif
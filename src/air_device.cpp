@@ -0,0 +1,525 @@
+/*
+ * air_device.cpp
+ *
+ * Copyright (C) 2020-2021 Max Qian
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*************************************************
+
+Copyright: 2020-2021 Max Qian. All rights reserved
+
+Author:Max Qian
+
+E-mail:astro_air@126.com
+
+Date:2021-7-12
+
+Description:Device registry and driver factory
+
+**************************************************/
+
+#include "air_device.h"
+#include "logger.h"
+
+#include <dlfcn.h>
+#include <dirent.h>
+#include <algorithm>
+
+namespace AstroAir
+{
+    DeviceRegistry DEVICES;
+
+    static const char *TypeNames[] = {"camera","mount","focus","filter","guide"};
+
+    const char *DeviceTypeName(DeviceType type)
+    {
+        if(type >= DeviceType::TypeNum)
+            return "unknown";
+        return TypeNames[(int)type];
+    }
+
+    bool ParseDeviceType(const std::string &name,DeviceType &type)
+    {
+        for(int i = 0;i < (int)DeviceType::TypeNum;i++)
+        {
+            if(name == TypeNames[i])
+            {
+                type = (DeviceType)i;
+                return true;
+            }
+        }
+        /*兼容配置文件中的"Guide"*/
+        if(name == "Guide" || name == "guider")
+        {
+            type = DeviceType::Guider;
+            return true;
+        }
+        return false;
+    }
+
+//----------------------------------------设备实例----------------------------------------
+
+    DeviceInstance::DeviceInstance(const std::string &id,DeviceType type,const std::string &brand,const std::string &name)
+        : ID(id),Type(type),Brand(brand),Name(name)
+    {
+        Connected = false;
+        if(Type == DeviceType::Camera)
+        {
+            /*主相机继续使用AIRCAMINFO，其他相机拥有独立的状态*/
+            if(IsPrimary())
+                Info = AIRCAMINFO;
+            else
+            {
+                Info = new CameraInfo();
+                OwnInfo = true;
+            }
+            Info->Instance = ID;
+        }
+    }
+
+    /*
+     * name: ~DeviceInstance()
+     * describe: Destructor
+     * 描述：析构函数，释放驱动
+     * note: The device must be removed from the registry first
+     */
+    DeviceInstance::~DeviceInstance()
+    {
+        delete Camera;
+        delete Mount;
+        delete Focus;
+        delete Filter;
+        delete Guider;
+        if(OwnInfo)
+            delete Info;
+    }
+
+    bool DeviceInstance::IsPrimary() const
+    {
+        return ID == DeviceTypeName(Type);
+    }
+
+    /*
+     * name: Connect()
+     * describe: Connect the driver and update the connection state
+     * 描述：连接设备，主设备同时更新原有的全局连接状态
+     */
+    bool DeviceInstance::Connect()
+    {
+        bool ok = false;
+        switch(Type)
+        {
+            case DeviceType::Camera:
+                if((ok = Camera && Camera->Connect(Name)))
+                    Info->isCameraConnected = true;
+                break;
+            case DeviceType::Mount:
+                if((ok = Mount && Mount->Connect(Name)) && IsPrimary())
+                    isMountConnected = true;
+                break;
+            case DeviceType::Focus:
+                if((ok = Focus && Focus->Connect(Name)) && IsPrimary())
+                    isFocusConnected = true;
+                break;
+            case DeviceType::Filter:
+                if((ok = Filter && Filter->Connect(Name)) && IsPrimary())
+                    isFilterConnected = true;
+                break;
+            case DeviceType::Guider:
+                if((ok = Guider && Guider->Connect(Name)) && IsPrimary())
+                    isGuideConnected = true;
+                break;
+            default:
+                break;
+        }
+        Connected = ok;
+        return ok;
+    }
+
+    /*
+     * name: Disconnect()
+     * describe: Disconnect the driver
+     * 描述：断开设备，无论是否成功都视为已断开
+     */
+    bool DeviceInstance::Disconnect()
+    {
+        bool ok = false;
+        switch(Type)
+        {
+            case DeviceType::Camera:
+                ok = Camera && Camera->Disconnect();
+                Info->isCameraConnected = false;
+                break;
+            case DeviceType::Mount:
+                ok = Mount && Mount->Disconnect();
+                if(IsPrimary())
+                    isMountConnected = false;
+                break;
+            case DeviceType::Focus:
+                ok = Focus && Focus->Disconnect();
+                if(IsPrimary())
+                    isFocusConnected = false;
+                break;
+            case DeviceType::Filter:
+                ok = Filter && Filter->Disconnect();
+                if(IsPrimary())
+                    isFilterConnected = false;
+                break;
+            case DeviceType::Guider:
+                ok = Guider && Guider->Disconnect();
+                if(IsPrimary())
+                    isGuideConnected = false;
+                break;
+            default:
+                break;
+        }
+        Connected = false;
+        return ok;
+    }
+
+    std::string DeviceInstance::DeviceName()
+    {
+        switch(Type)
+        {
+            case DeviceType::Camera:
+                return Camera ? Camera->ReturnDeviceName() : Name;
+            case DeviceType::Mount:
+                return Mount ? Mount->ReturnDeviceName() : Name;
+            case DeviceType::Focus:
+                return Focus ? Focus->ReturnDeviceName() : Name;
+            case DeviceType::Filter:
+                return Filter ? Filter->ReturnDeviceName() : Name;
+            case DeviceType::Guider:
+                return Guider ? Guider->ReturnDeviceName() : Name;
+            default:
+                return Name;
+        }
+    }
+
+    Json::Value DeviceInstance::ToJson() const
+    {
+        Json::Value Root;
+        Root["Device"] = Json::Value(ID);
+        Root["Type"] = Json::Value(DeviceTypeName(Type));
+        Root["Brand"] = Json::Value(Brand);
+        Root["Name"] = Json::Value(Name);
+        Root["Driver"] = Json::Value(Source);
+        Root["Connected"] = Json::Value((bool)Connected);
+        return Root;
+    }
+
+//----------------------------------------设备注册表----------------------------------------
+
+    DeviceRegistry::DeviceRegistry()
+    {
+
+    }
+
+    /*
+     * name: ~DeviceRegistry()
+     * describe: Destructor
+     * 描述：析构函数，驱动必须在插件卸载之前释放
+     */
+    DeviceRegistry::~DeviceRegistry()
+    {
+        Clear();
+        for(auto handle : plugins)
+            dlclose(handle);
+    }
+
+    /*
+     * name: RegisterDriver(DeviceType type,const std::string &brand,DeviceFactory factory)
+     * @param type:设备类型
+     * @param brand:品牌，与配置文件中的brand一致
+     * @param factory:创建驱动的函数
+     * describe: Register a driver for a brand
+     * 描述：注册驱动，插件加载时注册的驱动记录插件路径
+     */
+    bool DeviceRegistry::RegisterDriver(DeviceType type,const std::string &brand,DeviceFactory factory)
+    {
+        if(type >= DeviceType::TypeNum || brand.empty() || !factory)
+            return false;
+        std::lock_guard<std::mutex> guard(mtx);
+        auto &list = drivers[(int)type];
+        if(list.count(brand))
+        {
+            IDLog_Error(_("Driver %s of %s has already been registered\n"),brand.c_str(),DeviceTypeName(type));
+            return false;
+        }
+        list[brand] = Driver{factory,loading.empty() ? "builtin" : loading};
+        return true;
+    }
+
+    std::vector<std::string> DeviceRegistry::Brands(DeviceType type)
+    {
+        std::vector<std::string> brands;
+        if(type >= DeviceType::TypeNum)
+            return brands;
+        std::lock_guard<std::mutex> guard(mtx);
+        for(auto &it : drivers[(int)type])
+            brands.push_back(it.first);
+        return brands;
+    }
+
+    /*
+     * name: LoadPlugins(const std::string &dir)
+     * @param dir:插件目录
+     * describe: Load all shared object plugins in a directory
+     * 描述：加载目录下所有.so插件
+     */
+    int DeviceRegistry::LoadPlugins(const std::string &dir)
+    {
+        DIR *d = opendir(dir.c_str());
+        if(!d)
+            return 0;
+        std::vector<std::string> files;
+        while(struct dirent *entry = readdir(d))
+        {
+            std::string file = entry->d_name;
+            if(file.size() > 3 && file.compare(file.size() - 3,3,".so") == 0)
+                files.push_back(dir + "/" + file);
+        }
+        closedir(d);
+        /*按名称顺序加载，品牌重复时结果是确定的*/
+        std::sort(files.begin(),files.end());
+        int loaded = 0;
+        for(auto &file : files)
+            if(LoadPlugin(file))
+                loaded++;
+        IDLog(_("Loaded %d driver plugins from %s\n"),loaded,dir.c_str());
+        return loaded;
+    }
+
+    /*
+     * name: LoadPlugin(const std::string &path)
+     * @param path:插件路径
+     * describe: Load a plugin and call its entry
+     * 描述：加载插件并调用AstroAirRegisterPlugin注册驱动
+     * note: The plugin is kept loaded until the registry is destroyed
+     */
+    bool DeviceRegistry::LoadPlugin(const std::string &path)
+    {
+        void *handle = dlopen(path.c_str(),RTLD_NOW | RTLD_LOCAL);
+        if(!handle)
+        {
+            IDLog_Error(_("Could not load plugin %s: %s\n"),path.c_str(),dlerror());
+            return false;
+        }
+        PluginEntry entry = (PluginEntry)dlsym(handle,AIR_PLUGIN_ENTRY);
+        if(!entry)
+        {
+            IDLog_Error(_("Plugin %s has no entry %s\n"),path.c_str(),AIR_PLUGIN_ENTRY);
+            dlclose(handle);
+            return false;
+        }
+        {
+            std::lock_guard<std::mutex> guard(mtx);
+            loading = path;
+        }
+        bool ok = entry(this,AIR_PLUGIN_VERSION);
+        std::lock_guard<std::mutex> guard(mtx);
+        loading.clear();
+        if(!ok)
+        {
+            /*插件可能已经注册了部分驱动，这些驱动仍然需要插件中的代码*/
+            IDLog_Error(_("Plugin %s refused to register\n"),path.c_str());
+        }
+        plugins.push_back(handle);
+        return ok;
+    }
+
+    /*
+     * name: Create(const std::string &id,DeviceType type,const std::string &brand,const std::string &name)
+     * @param id:实例名称，与设备类型同名时为主设备
+     * @param type:设备类型
+     * @param brand:品牌
+     * @param name:设备型号
+     * describe: Create a device instance with the registered driver
+     * 描述：使用已注册的驱动创建设备实例，替换同名的未连接实例，被替换的实例在不再被使用时释放
+     * @return nullptr:品牌未注册、驱动创建失败或同名实例已连接
+     */
+    DevicePtr DeviceRegistry::Create(const std::string &id,DeviceType type,const std::string &brand,const std::string &name)
+    {
+        if(type >= DeviceType::TypeNum || id.empty())
+            return nullptr;
+        std::lock_guard<std::mutex> guard(mtx);
+        auto driver = drivers[(int)type].find(brand);
+        if(driver == drivers[(int)type].end())
+        {
+            IDLog_Error(_("No driver for %s %s\n"),DeviceTypeName(type),brand.c_str());
+            return nullptr;
+        }
+        auto old = devices.find(id);
+        if(old != devices.end())
+        {
+            if(old->second->Connected)
+                return nullptr;
+            Bind(*old->second,false);
+            devices.erase(old);
+        }
+        DevicePtr dev = std::make_shared<DeviceInstance>(id,type,brand,name);
+        dev->Source = driver->second.source;
+        if(!driver->second.factory(*dev))
+        {
+            IDLog_Error(_("Could not create driver %s for %s\n"),brand.c_str(),id.c_str());
+            return nullptr;
+        }
+        if(type == DeviceType::Camera)
+        {
+            if(!dev->Camera)
+                return nullptr;
+            dev->Camera->SetInfo(dev->Info);
+        }
+        Bind(*dev,true);
+        devices[id] = dev;
+        return dev;
+    }
+
+    /*
+     * name: Bind(DeviceInstance &dev,bool attach)
+     * describe: Keep the global pointers pointing at the primary devices
+     * 描述：主设备同时赋值CCD、MOUNT等全局指针
+     */
+    void DeviceRegistry::Bind(DeviceInstance &dev,bool attach)
+    {
+        if(!dev.IsPrimary())
+            return;
+        switch(dev.Type)
+        {
+            case DeviceType::Camera:
+                CCD = attach ? dev.Camera : nullptr;
+                break;
+            case DeviceType::Mount:
+                MOUNT = attach ? dev.Mount : nullptr;
+                break;
+            case DeviceType::Focus:
+                FOCUS = attach ? dev.Focus : nullptr;
+                break;
+            case DeviceType::Filter:
+                FILTER = attach ? dev.Filter : nullptr;
+                break;
+            case DeviceType::Guider:
+                GUIDE = attach ? dev.Guider : nullptr;
+                break;
+            default:
+                break;
+        }
+    }
+
+    DevicePtr DeviceRegistry::Find(const std::string &id)
+    {
+        std::lock_guard<std::mutex> guard(mtx);
+        auto it = devices.find(id);
+        return it == devices.end() ? nullptr : it->second;
+    }
+
+    std::vector<DevicePtr> DeviceRegistry::List()
+    {
+        std::vector<DevicePtr> list;
+        std::lock_guard<std::mutex> guard(mtx);
+        for(auto &it : devices)
+            list.push_back(it.second);
+        return list;
+    }
+
+    /*
+     * name: Remove(const std::string &id)
+     * @param id:实例名称
+     * describe: Remove an instance from the registry
+     * 描述：移除设备实例，主设备的全局指针置空
+     * note: Running commands and sequence tasks hold a DevicePtr, so the driver
+     *       is released when the last of them finishes rather than here.
+     */
+    void DeviceRegistry::Remove(const std::string &id)
+    {
+        std::lock_guard<std::mutex> guard(mtx);
+        auto it = devices.find(id);
+        if(it == devices.end())
+            return;
+        Bind(*it->second,false);
+        devices.erase(it);
+    }
+
+    void DeviceRegistry::Clear()
+    {
+        std::map<std::string,DevicePtr> removed;
+        {
+            std::lock_guard<std::mutex> guard(mtx);
+            for(auto &it : devices)
+                Bind(*it.second,false);
+            removed.swap(devices);
+        }
+    }
+
+    DevicePtr DeviceRegistry::Get(const std::string &id,DeviceType type)
+    {
+        DevicePtr dev = Find(id.empty() ? DeviceTypeName(type) : id);
+        if(!dev || dev->Type != type)
+            return nullptr;
+        return dev;
+    }
+
+    AIRCAMERA *DeviceRegistry::Camera(const std::string &id)
+    {
+        DevicePtr dev = Get(id,DeviceType::Camera);
+        return dev ? dev->Camera : nullptr;
+    }
+
+    AIRMOUNT *DeviceRegistry::Mount(const std::string &id)
+    {
+        DevicePtr dev = Get(id,DeviceType::Mount);
+        return dev ? dev->Mount : nullptr;
+    }
+
+    AIRFOCUS *DeviceRegistry::Focus(const std::string &id)
+    {
+        DevicePtr dev = Get(id,DeviceType::Focus);
+        return dev ? dev->Focus : nullptr;
+    }
+
+    AIRFILTER *DeviceRegistry::Filter(const std::string &id)
+    {
+        DevicePtr dev = Get(id,DeviceType::Filter);
+        return dev ? dev->Filter : nullptr;
+    }
+
+    AIRGUIDER *DeviceRegistry::Guider(const std::string &id)
+    {
+        DevicePtr dev = Get(id,DeviceType::Guider);
+        return dev ? dev->Guider : nullptr;
+    }
+
+    /*
+     * name: ToJson()
+     * describe: List device instances and registered drivers
+     * 描述：返回所有设备实例和已注册的驱动
+     */
+    Json::Value DeviceRegistry::ToJson()
+    {
+        Json::Value Root;
+        Root["Devices"] = Json::Value(Json::arrayValue);
+        for(auto &dev : List())
+            Root["Devices"].append(dev->ToJson());
+        for(int i = 0;i < (int)DeviceType::TypeNum;i++)
+        {
+            Json::Value &list = Root["Drivers"][TypeNames[i]];
+            list = Json::Value(Json::arrayValue);
+            for(auto &brand : Brands((DeviceType)i))
+                list.append(brand);
+        }
+        return Root;
+    }
+}
@@ -0,0 +1,159 @@
+/*
+ * air_device.h
+ *
+ * Copyright (C) 2020-2021 Max Qian
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*************************************************
+
+Copyright: 2020-2021 Max Qian. All rights reserved
+
+Author:Max Qian
+
+E-mail:astro_air@126.com
+
+Date:2021-7-12
+
+Description:Device registry and driver factory
+
+**************************************************/
+
+#ifndef _AIR_DEVICE_H_
+#define _AIR_DEVICE_H_
+
+#include "air_camera.h"
+#include "air_mount.h"
+#include "air_focus.h"
+#include "air_filter.h"
+#include "air_guider.h"
+
+#include <json/json.h>
+
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <atomic>
+
+/*插件接口版本，驱动头文件不兼容时需要增加*/
+#define AIR_PLUGIN_VERSION 1
+/*插件入口函数名称*/
+#define AIR_PLUGIN_ENTRY "AstroAirRegisterPlugin"
+
+namespace AstroAir
+{
+    enum class DeviceType
+    {
+        Camera = 0,
+        Mount,
+        Focus,
+        Filter,
+        Guider,
+        TypeNum
+    };
+    /*设备类型名称，同时也是主设备的实例名称和命令队列名称*/
+    const char *DeviceTypeName(DeviceType type);
+    bool ParseDeviceType(const std::string &name,DeviceType &type);
+
+    /*
+        设备实例
+        同一类型可以有多个实例，例如主相机和导星相机，每个实例拥有自己的驱动、状态和命令队列
+        实例名称与设备类型同名的为主设备，同时赋值CCD、MOUNT等全局指针，兼容原有命令
+    */
+    class DeviceInstance
+    {
+        public:
+            DeviceInstance(const std::string &id,DeviceType type,const std::string &brand,const std::string &name);
+            ~DeviceInstance();
+            bool Connect();
+            bool Disconnect();
+            std::string DeviceName();
+            bool IsPrimary() const;
+            Json::Value ToJson() const;
+
+            const std::string ID;           //实例名称，也是该设备的命令队列名称
+            const DeviceType Type;
+            const std::string Brand;
+            const std::string Name;         //设备型号
+            std::string Source;             //驱动来源，内置驱动为builtin，否则为插件路径
+            /*驱动，只有与Type对应的一个不为空*/
+            AIRCAMERA *Camera = nullptr;
+            AIRMOUNT *Mount = nullptr;
+            AIRFOCUS *Focus = nullptr;
+            AIRFILTER *Filter = nullptr;
+            AIRGUIDER *Guider = nullptr;
+            CameraInfo *Info = nullptr;     //相机状态，主相机使用AIRCAMINFO，其他相机各自独立
+            std::atomic_bool Connected;
+        private:
+            bool OwnInfo = false;
+    };
+    typedef std::shared_ptr<DeviceInstance> DevicePtr;
+
+    /*驱动工厂，根据dev.Type创建对应的驱动并赋值，失败时返回false*/
+    typedef bool (*DeviceFactory)(DeviceInstance &dev);
+    /*插件入口，插件在其中调用RegisterDriver注册自己的驱动*/
+    typedef bool (*PluginEntry)(class DeviceRegistry *registry,int version);
+
+    /*
+        设备注册表
+        驱动按设备类型和品牌注册，内置驱动在服务器启动时注册，其他驱动可以由插件提供
+    */
+    class DeviceRegistry
+    {
+        public:
+            DeviceRegistry();
+            ~DeviceRegistry();
+            /*注册驱动，品牌已经存在时返回false*/
+            bool RegisterDriver(DeviceType type,const std::string &brand,DeviceFactory factory);
+            std::vector<std::string> Brands(DeviceType type);
+            /*加载目录下的所有插件，返回成功加载的数量*/
+            int LoadPlugins(const std::string &dir);
+            bool LoadPlugin(const std::string &path);
+            /*创建设备实例，品牌未知或实例已连接时返回nullptr*/
+            DevicePtr Create(const std::string &id,DeviceType type,const std::string &brand,const std::string &name);
+            DevicePtr Find(const std::string &id);
+            std::vector<DevicePtr> List();
+            /*移除实例，驱动在最后一个持有DevicePtr的任务结束后释放*/
+            void Remove(const std::string &id);
+            /*释放所有实例，调用前必须停止所有可能使用驱动的线程*/
+            void Clear();
+            /*按实例名称查找驱动，名称为空时返回主设备*/
+            AIRCAMERA *Camera(const std::string &id);
+            AIRMOUNT *Mount(const std::string &id);
+            AIRFOCUS *Focus(const std::string &id);
+            AIRFILTER *Filter(const std::string &id);
+            AIRGUIDER *Guider(const std::string &id);
+            Json::Value ToJson();
+        private:
+            struct Driver
+            {
+                DeviceFactory factory;
+                std::string source;
+            };
+            DevicePtr Get(const std::string &id,DeviceType type);
+            void Bind(DeviceInstance &dev,bool attach);
+
+            std::map<std::string,Driver> drivers[(int)DeviceType::TypeNum];
+            std::map<std::string,DevicePtr> devices;
+            std::vector<void *> plugins;        //已加载插件的句柄
+            std::string loading;                //正在加载的插件路径
+            std::mutex mtx;
+    };
+    extern DeviceRegistry DEVICES;
+}
+
+#endif
@@ -42,7 +42,8 @@ namespace AstroAir
     class AIRFILTER
     {
         public:
-            
+            virtual ~AIRFILTER() = default;
+
             virtual bool Connect(std::string Device_name);      //连接相机
 			virtual bool Disconnect();                          //断开连接
 			virtual std::string ReturnDeviceName();             //返回设备名称
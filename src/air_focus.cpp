@@ -131,9 +131,12 @@ namespace AstroAir
 				IDLog(_("The focus failed to move to %d\n"),TargetPosition);
                 WebLog(_("The focus failed to move to."),3);
 				InMoving = false;
+                /*停下的位置由驱动报告*/
+                TelemetryChanged();
 				return false;
             }
             InMoving = false;
+            PositionChanged(TargetPosition);
             MoveToSuccess();
             WebLog(_("Focus move to  ok"),2);
         }
@@ -194,9 +197,11 @@ namespace AstroAir
 				IDLog(_("The focus failed to move %d\n"),Steps);
                 WebLog(_("The focus failed to move."),3);
 				InMoving = false;
+                TelemetryChanged();
 				return false;
             }
             InMoving = false;
+            TelemetryChanged();
             MoveSuccess();
             WebLog(_("Focus move ok"),2);
         }
@@ -228,4 +233,17 @@ namespace AstroAir
     {
 
     }
+
+    /*
+     * name: PositionChanged(int Position)
+     * @param Position:电动调焦座当前的位置
+     * describe: Publish a new focuser position
+     * 描述：更新电动调焦座位置，位置变化时通知遥测线程立即推送，自动对焦时不必等待下一个采样周期
+     * calls: TelemetryChanged()
+     */
+    void AIRFOCUS::PositionChanged(int Position)
+    {
+        if(FocusPosition.exchange(Position) != Position)
+            TelemetryChanged();
+    }
 }
\ No newline at end of file
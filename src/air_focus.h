@@ -43,7 +43,7 @@ namespace AstroAir
     {
         public:
             explicit AIRFOCUS();
-            ~AIRFOCUS();
+            virtual ~AIRFOCUS();
             virtual bool Connect(std::string Device_name);      //连接电动调焦座
 			virtual bool Disconnect();                          //断开连接
 			virtual std::string ReturnDeviceName();             //返回设备名称
@@ -52,6 +52,9 @@ namespace AstroAir
             virtual bool MoveServer(int Steps);
             virtual bool Move(int Steps);
 
+        protected:
+            /*驱动读取到新的位置时调用，位置变化时立即推送遥测信息*/
+            void PositionChanged(int Position);
         private:
             virtual void MoveToError();
             virtual void MoveToSuccess();
@@ -43,7 +43,7 @@ namespace AstroAir
     {
         public:
             explicit AIRGUIDER();
-            ~AIRGUIDER();
+            virtual ~AIRGUIDER();
 
             virtual bool Connect(std::string Device_name);      //连接导星软件
             virtual bool Disconnect();                          //断开连接
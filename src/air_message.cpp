@@ -0,0 +1,219 @@
+/*
+ * air_message.cpp
+ *
+ * Copyright (C) 2020-2021 Max Qian
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*************************************************
+
+Copyright: 2020-2021 Max Qian. All rights reserved
+
+Author:Max Qian
+
+E-mail:astro_air@126.com
+
+Date:2021-7-12
+
+Description:Client message port
+
+Using:JsonCpp<https://github.com/open-source-parsers/jsoncpp>
+
+**************************************************/
+
+#include "air_message.h"
+
+#include <streambuf>
+#include <ostream>
+
+namespace AstroAir
+{
+//----------------------------------------命令参数----------------------------------------
+
+    CommandParams::CommandParams(const Json::Value &params) : params(params)
+    {
+
+    }
+
+    bool CommandParams::Has(const char *key) const
+    {
+        return params.isObject() && params.isMember(key);
+    }
+
+    int CommandParams::Int(const char *key,int def) const
+    {
+        if(!Has(key) || !params[key].isConvertibleTo(Json::intValue))
+            return def;
+        return params[key].asInt();
+    }
+
+    bool CommandParams::Bool(const char *key,bool def) const
+    {
+        if(!Has(key) || !params[key].isConvertibleTo(Json::booleanValue))
+            return def;
+        return params[key].asBool();
+    }
+
+    double CommandParams::Double(const char *key,double def) const
+    {
+        if(!Has(key) || !params[key].isConvertibleTo(Json::realValue))
+            return def;
+        return params[key].asDouble();
+    }
+
+    std::string CommandParams::String(const char *key,const std::string &def) const
+    {
+        if(!Has(key) || !params[key].isConvertibleTo(Json::stringValue))
+            return def;
+        return params[key].asString();
+    }
+
+    const Json::Value &CommandParams::Raw() const
+    {
+        return params;
+    }
+
+    CommandParams Message::Params() const
+    {
+        return CommandParams(root["params"]);
+    }
+
+//----------------------------------------信息池----------------------------------------
+
+    MessagePool::MessagePool(size_t max_cached) : MaxCached(max_cached)
+    {
+
+    }
+
+    MessagePool::~MessagePool()
+    {
+        for(auto msg : cached)
+            delete msg;
+        cached.clear();
+    }
+
+    /*
+     * name: Parse(const std::string &payload,std::string *errs)
+     * @param payload:客户端信息
+     * @param errs:解析错误信息
+     * describe: Parse a frame into its own document
+     * 描述：将客户端信息解析到独立的文档中，使用完后自动回收
+     * @return nullptr:信息不是合法的JSON
+     * note: Each thread keeps its own CharReader, the builder is only used once
+     */
+    MessagePtr MessagePool::Parse(const std::string &payload,std::string *errs)
+    {
+        thread_local std::unique_ptr<Json::CharReader> json_read(Json::CharReaderBuilder().newCharReader());
+        Message *msg = Acquire();
+        msg->payload = payload;
+        Json::String err;
+        if(!json_read->parse(payload.c_str(),payload.c_str() + payload.length(),&msg->root,&err) || !msg->root.isObject())
+        {
+            if(errs)
+                *errs = err;
+            Release(msg);
+            return nullptr;
+        }
+        msg->method = msg->root["method"].isString() ? msg->root["method"].asString() : "";
+        if(msg->root.isMember("RequestID") && (msg->root["RequestID"].isString() || msg->root["RequestID"].isIntegral()))
+            msg->RequestID = msg->root["RequestID"];
+        if(msg->root["Deadline"].isConvertibleTo(Json::intValue))
+            msg->Deadline = msg->root["Deadline"].asInt();
+        return MessagePtr(msg,[this](Message *m){Release(m);});
+    }
+
+    Message *MessagePool::Acquire()
+    {
+        std::lock_guard<std::mutex> guard(mtx);
+        if(cached.empty())
+            return new Message();
+        Message *msg = cached.back();
+        cached.pop_back();
+        return msg;
+    }
+
+    void MessagePool::Release(Message *msg)
+    {
+        if(msg->root.isObject() || msg->root.isArray())
+            msg->root.clear();
+        else
+            msg->root = Json::Value();
+        msg->method.clear();
+        msg->payload.clear();
+        msg->client.reset();
+        msg->RequestID = Json::Value();
+        msg->Deadline = 0;
+        std::lock_guard<std::mutex> guard(mtx);
+        if(cached.size() >= MaxCached)
+        {
+            delete msg;
+            return;
+        }
+        cached.push_back(msg);
+    }
+
+//----------------------------------------信息输出----------------------------------------
+
+    /*直接写入std::string的输出缓冲区，清空后保留已分配的内存*/
+    class StringOutBuf : public std::streambuf
+    {
+        public:
+            std::string data;
+        protected:
+            int_type overflow(int_type c) override
+            {
+                if(c != traits_type::eof())
+                    data.push_back((char)c);
+                return c;
+            }
+            std::streamsize xsputn(const char *s,std::streamsize n) override
+            {
+                data.append(s,n);
+                return n;
+            }
+    };
+
+    /*
+     * name: WriteJson(const Json::Value &root,bool styled)
+     * @param root:需要发送的信息
+     * @param styled:是否输出带缩进的格式
+     * describe: Serialize an outgoing message with a cached writer
+     * 描述：使用线程本地的写入器序列化信息，避免每次发送都重新创建写入器和缓冲区
+     */
+    const std::string &WriteJson(const Json::Value &root,bool styled)
+    {
+        struct Writer
+        {
+            StringOutBuf buf;
+            std::ostream out;
+            std::unique_ptr<Json::StreamWriter> compact,pretty;
+            Writer() : out(&buf)
+            {
+                Json::StreamWriterBuilder builder;
+                builder["indentation"] = "";
+                builder["emitUTF8"] = true;
+                compact.reset(builder.newStreamWriter());
+                builder["indentation"] = "\t";
+                pretty.reset(builder.newStreamWriter());
+            }
+        };
+        thread_local Writer writer;
+        writer.buf.data.clear();
+        (styled ? writer.pretty : writer.compact)->write(root,&writer.out);
+        if(styled)
+            writer.buf.data.push_back('\n');
+        return writer.buf.data;
+    }
+}
@@ -0,0 +1,105 @@
+/*
+ * air_message.h
+ *
+ * Copyright (C) 2020-2021 Max Qian
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*************************************************
+
+Copyright: 2020-2021 Max Qian. All rights reserved
+
+Author:Max Qian
+
+E-mail:astro_air@126.com
+
+Date:2021-7-12
+
+Description:Client message port
+
+**************************************************/
+
+#ifndef _AIR_MESSAGE_H_
+#define _AIR_MESSAGE_H_
+
+#include <json/json.h>
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+
+namespace AstroAir
+{
+    /*
+        客户端命令参数的只读视图
+        处理函数只能通过它读取"params"中的参数，不再访问共享的Json::Value
+    */
+    class CommandParams
+    {
+        public:
+            explicit CommandParams(const Json::Value &params);
+            bool Has(const char *key) const;
+            int Int(const char *key,int def = 0) const;
+            bool Bool(const char *key,bool def = false) const;
+            double Double(const char *key,double def = 0) const;
+            std::string String(const char *key,const std::string &def = "") const;
+            const Json::Value &Raw() const;
+        private:
+            const Json::Value &params;
+    };
+
+    /*每一条客户端信息都拥有自己的解析结果*/
+    struct Message
+    {
+        Json::Value root;
+        std::string method;
+        std::string payload;
+        std::weak_ptr<void> client;     //发送这条信息的客户端句柄
+        Json::Value RequestID;          //客户端提供的请求编号，结果信息中原样返回
+        int Deadline = 0;               //请求的截止时间(秒)，0表示没有截止时间
+        CommandParams Params() const;
+    };
+    typedef std::shared_ptr<Message> MessagePtr;
+
+    /*
+        客户端信息池
+        解析结果在最后一个使用者释放后回到池中，避免每条信息都重新分配内存
+    */
+    class MessagePool
+    {
+        public:
+            explicit MessagePool(size_t max_cached = 32);
+            ~MessagePool();
+            /*解析客户端信息，格式错误时返回nullptr*/
+            MessagePtr Parse(const std::string &payload,std::string *errs = nullptr);
+        private:
+            Message *Acquire();
+            void Release(Message *msg);
+
+            std::vector<Message *> cached;
+            std::mutex mtx;
+            size_t MaxCached;
+    };
+
+    /*
+        发送信息的序列化
+        默认输出紧凑格式，调试客户端可以选择带缩进的格式
+        结果写入线程本地缓冲区，返回值在本线程下一次调用前有效
+    */
+    const std::string &WriteJson(const Json::Value &root,bool styled = false);
+}
+
+#endif
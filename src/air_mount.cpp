@@ -91,14 +91,17 @@ namespace AstroAir
     bool AIRMOUNT::GotoServer(std::string Target_RA,std::string Target_DEC)
     {
         isMountSlewing = true;
+        TelemetryChanged();
         if(MOUNT->Goto(Target_RA,Target_DEC) != true)
         {
             isMountSlewing = false;
+            TelemetryChanged();
             IDLog_Error(_("The equator doesn't work properly\n"));
             WebLog(_("The equator doesn't work properly"),3);
             return false;
         }
         isMountSlewing = false;
+        TelemetryChanged();
         IDLog("The equator moves to the designated position\n");
         WebLog("赤道仪转动到指定位置",3);
         return true;
@@ -135,6 +138,7 @@ namespace AstroAir
                 return false;
             }
             isMountParked = true;
+            TelemetryChanged();
             IDLog(_("The equator moves to the designated position\n"));
             WebLog(_("赤道仪归位"),3);
             return true;
@@ -148,6 +152,7 @@ namespace AstroAir
                 return false;
             }
             isMountParked = false;
+            TelemetryChanged();
             IDLog(_("The equator moves to the designated position\n"));
             WebLog(_("赤道仪解除归位状态"),3);
             return true;
@@ -196,12 +201,14 @@ namespace AstroAir
             IDLog(_("The equator started tracking\n"));
             WebLog(_("赤道仪开始跟踪"),3);
             isMountTracking = true;
+            TelemetryChanged();
         }
         else
         {
             IDLog(_("The equator stopped tracking\n"));
             WebLog(_("赤道仪停止跟踪"),3);
             isMountTracking = false;
+            TelemetryChanged();
         }
         return true;
     }
@@ -47,6 +47,7 @@ namespace AstroAir
     class AIRMOUNT
     {
         public:
+            virtual ~AIRMOUNT() = default;
             virtual bool Connect(std::string Device_name);
 			virtual bool Disconnect();
 			virtual std::string ReturnDeviceName();
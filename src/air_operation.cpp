@@ -0,0 +1,256 @@
+/*
+ * air_operation.cpp
+ *
+ * Copyright (C) 2020-2021 Max Qian
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*************************************************
+
+Copyright: 2020-2021 Max Qian. All rights reserved
+
+Author:Max Qian
+
+E-mail:astro_air@126.com
+
+Date:2021-7-12
+
+Description:In-flight operations of client requests
+
+Using:JsonCpp<https://github.com/open-source-parsers/jsoncpp>
+
+**************************************************/
+
+#include "air_operation.h"
+#include "logger.h"
+
+namespace AstroAir
+{
+    OperationTable OPS;
+
+    thread_local OperationPtr Current;
+
+    Operation::Operation(const OperationOwner &client,const Json::Value &id,const std::string &method,const Json::Value &params,CancelHandler cancel,int timeout)
+        : Client(client),RequestID(id),Key(OperationTable::IDKey(id)),Method(method),Params(params),Cancel(cancel),
+          Start(std::chrono::steady_clock::now()),
+          Deadline(timeout > 0 ? Start + std::chrono::seconds(timeout) : std::chrono::steady_clock::time_point::max())
+    {
+        State = Queued;
+        Progress = 0;
+        Cancelled = false;
+        TimedOut = false;
+    }
+
+    Json::Value Operation::ToJson() const
+    {
+        auto now = std::chrono::steady_clock::now();
+        Json::Value Root;
+        Root["RequestID"] = RequestID;
+        Root["method"] = Json::Value(Method);
+        static const char *StateNames[] = {"Queued","Running","Cancelled"};
+        Root["State"] = Json::Value(StateNames[State]);
+        Root["Progress"] = Json::Value((int)Progress);
+        Root["Elapsed"] = Json::Value((Json::Int64)std::chrono::duration_cast<std::chrono::milliseconds>(now - Start).count());
+        if(Deadline != std::chrono::steady_clock::time_point::max())
+            Root["Remaining"] = Json::Value((Json::Int64)std::chrono::duration_cast<std::chrono::milliseconds>(Deadline - now).count());
+        Root["Cancelled"] = Json::Value((bool)Cancelled);
+        Root["Cancellable"] = Json::Value(Cancel != nullptr);
+        return Root;
+    }
+
+    OperationTable::OperationTable()
+    {
+
+    }
+
+    OperationTable::~OperationTable()
+    {
+        {
+            std::lock_guard<std::mutex> guard(mtx);
+            running = false;
+            cond.notify_all();
+        }
+        if(watchdog.joinable())
+            watchdog.join();
+    }
+
+    std::string OperationTable::IDKey(const Json::Value &id)
+    {
+        if(id.isString())
+            return id.asString();
+        if(id.isIntegral())
+            return std::to_string(id.asLargestInt());
+        return id.toStyledString();
+    }
+
+    /*
+     * name: Begin(const OperationOwner &client,const Json::Value &id,const std::string &method,const Json::Value &params,CancelHandler cancel,int timeout)
+     * @param client:发出请求的客户端
+     * @param id:客户端提供的RequestID
+     * @param method:命令名称
+     * @param params:命令参数
+     * @param cancel:取消操作时执行的函数，可以为空
+     * @param timeout:截止时间(秒)，0表示没有截止时间
+     * describe: Register an in-flight operation
+     * 描述：记录正在进行的操作
+     */
+    OperationPtr OperationTable::Begin(const OperationOwner &client,const Json::Value &id,const std::string &method,const Json::Value &params,CancelHandler cancel,int timeout)
+    {
+        OperationPtr op = std::make_shared<Operation>(client,id,method,params,cancel,timeout);
+        OperationKey key{client,op->Key};
+        std::lock_guard<std::mutex> guard(mtx);
+        if(ops.count(key))
+            return nullptr;
+        ops[key] = op;
+        if(timeout > 0)
+        {
+            /*第一次有截止时间的操作时启动监视线程*/
+            if(!watchdog.joinable())
+                watchdog = std::thread(&OperationTable::Watchdog,this);
+            cond.notify_all();
+        }
+        return op;
+    }
+
+    void OperationTable::End(const OperationPtr &op)
+    {
+        std::lock_guard<std::mutex> guard(mtx);
+        auto it = ops.find(OperationKey{op->Client,op->Key});
+        if(it != ops.end() && it->second == op)
+            ops.erase(it);
+    }
+
+    /*
+     * name: Cancel(const OperationOwner &client,const Json::Value &id)
+     * @param client:发出取消命令的客户端
+     * @param id:客户端提供的RequestID
+     * describe: Cancel an operation
+     * 描述：取消操作，还在排队的操作不会再执行，正在执行的操作调用取消函数
+     * note: A client can only cancel its own requests
+     */
+    bool OperationTable::Cancel(const OperationOwner &client,const Json::Value &id)
+    {
+        OperationPtr op;
+        {
+            std::lock_guard<std::mutex> guard(mtx);
+            auto it = ops.find(OperationKey{client,IDKey(id)});
+            if(it == ops.end())
+                return false;
+            op = it->second;
+        }
+        Abort(op);
+        return true;
+    }
+
+    /*
+     * name: Abort(const OperationPtr &op)
+     * @param op:需要取消的操作
+     * describe: Cancel a queued or running operation
+     * 描述：取消操作，与开始执行的线程竞争同一个状态，还在排队时由这里标记为已取消，否则调用取消函数
+     * note: The handler only runs if its thread moved the state from Queued to Running first
+     */
+    void OperationTable::Abort(const OperationPtr &op)
+    {
+        if(op->Cancelled.exchange(true))
+            return;
+        IDLog(_("Cancel request %s (%s)\n"),op->Key.c_str(),op->Method.c_str());
+        int queued = Operation::Queued;
+        if(!op->State.compare_exchange_strong(queued,Operation::Aborted) && op->Cancel)
+            op->Cancel(op->Params);
+    }
+
+    std::vector<OperationPtr> OperationTable::List(const OperationOwner &client)
+    {
+        std::lock_guard<std::mutex> guard(mtx);
+        std::vector<OperationPtr> list;
+        for(auto &it : ops)
+        {
+            if(!it.first.Client.owner_before(client) && !client.owner_before(it.first.Client))
+                list.push_back(it.second);
+        }
+        return list;
+    }
+
+    void OperationTable::SetTimeoutHandler(TimeoutHandler handler)
+    {
+        std::lock_guard<std::mutex> guard(mtx);
+        OnTimeout = handler;
+    }
+
+    /*
+     * name: Watchdog()
+     * describe: Cancel operations which passed their deadline
+     * 描述：监视线程，取消超过截止时间的操作
+     */
+    void OperationTable::Watchdog()
+    {
+        std::unique_lock<std::mutex> lock(mtx);
+        while(running)
+        {
+            auto now = std::chrono::steady_clock::now();
+            auto next = std::chrono::steady_clock::time_point::max();
+            std::vector<OperationPtr> expired;
+            for(auto &it : ops)
+            {
+                if(it.second->Deadline <= now)
+                {
+                    if(!it.second->TimedOut.exchange(true))
+                        expired.push_back(it.second);
+                }
+                else if(it.second->Deadline < next)
+                    next = it.second->Deadline;
+            }
+            if(!expired.empty())
+            {
+                TimeoutHandler handler = OnTimeout;
+                lock.unlock();
+                for(auto &op : expired)
+                {
+                    IDLog_Error(_("Request %s (%s) timed out\n"),op->Key.c_str(),op->Method.c_str());
+                    Abort(op);
+                    if(handler)
+                        handler(op);
+                }
+                lock.lock();
+                continue;
+            }
+            if(next == std::chrono::steady_clock::time_point::max())
+                cond.wait(lock);
+            else
+                cond.wait_until(lock,next);
+        }
+    }
+
+    OperationPtr CurrentOperation()
+    {
+        return Current;
+    }
+
+    void ReportProgress(int perc)
+    {
+        if(Current)
+            Current->Progress = perc < 0 ? 0 : (perc > 100 ? 100 : perc);
+    }
+
+    OperationScope::OperationScope(OperationPtr op) : prev(Current)
+    {
+        Current = std::move(op);
+    }
+
+    OperationScope::~OperationScope()
+    {
+        Current = std::move(prev);
+    }
+}
@@ -0,0 +1,148 @@
+/*
+ * air_operation.h
+ *
+ * Copyright (C) 2020-2021 Max Qian
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*************************************************
+
+Copyright: 2020-2021 Max Qian. All rights reserved
+
+Author:Max Qian
+
+E-mail:astro_air@126.com
+
+Date:2021-7-12
+
+Description:In-flight operations of client requests
+
+**************************************************/
+
+#ifndef _AIR_OPERATION_H_
+#define _AIR_OPERATION_H_
+
+#include <json/json.h>
+
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <functional>
+#include <atomic>
+#include <chrono>
+
+namespace AstroAir
+{
+    /*取消函数，参数为命令的params，用于找到命令指定的设备*/
+    typedef void (*CancelHandler)(const Json::Value &params);
+    /*发出请求的客户端，与websocketpp::connection_hdl相同*/
+    typedef std::weak_ptr<void> OperationOwner;
+
+    /*
+        客户端请求对应的操作
+        客户端在命令中带上RequestID后，服务器记录操作的进度、截止时间，并允许取消
+    */
+    class Operation
+    {
+        public:
+            enum Status {Queued = 0,Running,Aborted};      //Aborted:排队时被取消，不会再执行
+
+            Operation(const OperationOwner &client,const Json::Value &id,const std::string &method,const Json::Value &params,CancelHandler cancel,int timeout);
+            Json::Value ToJson() const;
+
+            const OperationOwner Client;    //只有该客户端可以取消，结果也只发送给它
+            const Json::Value RequestID;
+            const std::string Key;
+            const std::string Method;
+            const Json::Value Params;       //命令参数，取消时传给取消函数
+            const CancelHandler Cancel;
+            const std::chrono::steady_clock::time_point Start;
+            const std::chrono::steady_clock::time_point Deadline;     //没有截止时间时为time_point::max()
+            std::atomic_int State;
+            std::atomic_int Progress;       //0-100
+            std::atomic_bool Cancelled;
+            std::atomic_bool TimedOut;
+    };
+    typedef std::shared_ptr<Operation> OperationPtr;
+
+    /*
+        正在进行的操作
+        超过截止时间的操作由监视线程取消
+    */
+    class OperationTable
+    {
+        public:
+            typedef std::function<void(const OperationPtr &)> TimeoutHandler;
+
+            OperationTable();
+            ~OperationTable();
+            /*开始一个操作，同一客户端的RequestID重复时返回nullptr，不同客户端可以使用相同的RequestID*/
+            OperationPtr Begin(const OperationOwner &client,const Json::Value &id,const std::string &method,const Json::Value &params,CancelHandler cancel,int timeout);
+            void End(const OperationPtr &op);
+            /*取消该客户端的操作，没有找到时返回false*/
+            bool Cancel(const OperationOwner &client,const Json::Value &id);
+            /*该客户端正在进行的操作*/
+            std::vector<OperationPtr> List(const OperationOwner &client);
+            void SetTimeoutHandler(TimeoutHandler handler);
+            /*将RequestID转化为查找用的字符串*/
+            static std::string IDKey(const Json::Value &id);
+        private:
+            /*按客户端和RequestID查找，客户端断开后仍然可以比较*/
+            struct OperationKey
+            {
+                OperationOwner Client;
+                std::string ID;
+                bool operator<(const OperationKey &other) const
+                {
+                    if(Client.owner_before(other.Client))
+                        return true;
+                    if(other.Client.owner_before(Client))
+                        return false;
+                    return ID < other.ID;
+                }
+            };
+            void Abort(const OperationPtr &op);
+            void Watchdog();
+
+            std::map<OperationKey,OperationPtr> ops;
+            std::mutex mtx;
+            std::condition_variable cond;
+            std::thread watchdog;
+            bool running = true;
+            TimeoutHandler OnTimeout;
+    };
+    extern OperationTable OPS;
+
+    /*当前线程正在执行的操作，没有时返回nullptr*/
+    OperationPtr CurrentOperation();
+    /*更新当前操作的进度*/
+    void ReportProgress(int perc);
+
+    /*在作用域内将操作设为当前线程的操作，用于任务池线程和设备的计时线程*/
+    class OperationScope
+    {
+        public:
+            explicit OperationScope(OperationPtr op);
+            ~OperationScope();
+        private:
+            OperationPtr prev;
+    };
+}
+
+#endif
@@ -0,0 +1,115 @@
+/*
+ * air_outbound.cpp
+ *
+ * Copyright (C) 2020-2021 Max Qian
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*************************************************
+
+Copyright: 2020-2021 Max Qian. All rights reserved
+
+Author:Max Qian
+
+E-mail:astro_air@126.com
+
+Date:2021-7-12
+
+Description:Outbound message queue of each client
+
+**************************************************/
+
+#include "air_outbound.h"
+
+namespace AstroAir
+{
+    OutboundQueue::OutboundQueue(size_t max_log) : MaxLog(max_log)
+    {
+        dropped = 0;
+    }
+
+    /*
+     * name: Push(Class type,std::vector<Frame> frames)
+     * @param type:信息类型
+     * @param frames:需要发送的帧
+     * describe: Queue a message according to the policy of its class
+     * 描述：按照信息类型的策略加入队列
+     * note: Superseded messages are removed, the new one goes to the end to keep the order
+     */
+    void OutboundQueue::Push(Class type,std::vector<Frame> frames)
+    {
+        std::lock_guard<std::mutex> guard(mtx);
+        switch(type)
+        {
+            case Telemetry:
+            case Progress:
+            case Image:
+                /*只保留最新的一条*/
+                for(auto it = entries.begin();it != entries.end();++it)
+                {
+                    if(it->type == type)
+                    {
+                        entries.erase(it);
+                        dropped |= 1u << type;
+                        break;
+                    }
+                }
+                break;
+            case Log:
+                /*丢弃最早的日志*/
+                if(LogNum >= MaxLog)
+                {
+                    for(auto it = entries.begin();it != entries.end();++it)
+                    {
+                        if(it->type == Log)
+                        {
+                            entries.erase(it);
+                            LogNum--;
+                            dropped |= 1u << Log;
+                            break;
+                        }
+                    }
+                }
+                LogNum++;
+                break;
+            default:
+                break;
+        }
+        entries.push_back(Entry{type,std::move(frames)});
+    }
+
+    bool OutboundQueue::Pop(std::vector<Frame> &frames)
+    {
+        std::lock_guard<std::mutex> guard(mtx);
+        if(entries.empty())
+            return false;
+        if(entries.front().type == Log)
+            LogNum--;
+        frames = std::move(entries.front().frames);
+        entries.pop_front();
+        return true;
+    }
+
+    size_t OutboundQueue::Size()
+    {
+        std::lock_guard<std::mutex> guard(mtx);
+        return entries.size();
+    }
+
+    bool OutboundQueue::TakeDropped(Class type)
+    {
+        return dropped.fetch_and(~(1u << type)) & (1u << type);
+    }
+}
@@ -0,0 +1,101 @@
+/*
+ * air_outbound.h
+ *
+ * Copyright (C) 2020-2021 Max Qian
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*************************************************
+
+Copyright: 2020-2021 Max Qian. All rights reserved
+
+Author:Max Qian
+
+E-mail:astro_air@126.com
+
+Date:2021-7-12
+
+Description:Outbound message queue of each client
+
+**************************************************/
+
+#ifndef _AIR_OUTBOUND_H_
+#define _AIR_OUTBOUND_H_
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <atomic>
+
+namespace AstroAir
+{
+    /*
+        客户端可以订阅的主题
+        命令结果总是发送，其他主题没有客户端订阅时不会生成和序列化
+    */
+    enum class Topic {Results = 0,Logs,Progress,Images,Telemetry,GuideSteps,TopicNum};
+    /*图像订阅，减去ImageThumbnail即为预览等级*/
+    enum ImageSubscription {ImageNone = 0,ImageThumbnail,ImageScreen,ImageFull};
+
+    /*
+        客户端发送队列
+        每个客户端拥有自己的队列，发送缓慢的客户端只会丢弃已经过时的信息，不会阻塞相机和赤道仪线程
+        不同类型的信息使用不同的策略：
+            Result      命令结果，从不丢弃
+            Log         日志，超过上限时丢弃最早的日志
+            Telemetry   遥测信息，只保留最新的一条
+            Progress    拍摄进度，只保留最新的一条
+            Image       图像，只保留最新的一张
+    */
+    class OutboundQueue
+    {
+        public:
+            enum Class {Result = 0,Log,Telemetry,Progress,Image,ClassNum};
+            typedef std::shared_ptr<const std::string> Payload;
+            /*同一条信息发送给多个客户端时共用数据*/
+            struct Frame
+            {
+                Payload payload;
+                bool binary = false;
+                bool compress = true;       //客户端协商了压缩时是否压缩，JPG图像已经压缩过
+            };
+
+            explicit OutboundQueue(size_t max_log = 256);
+            /*按照信息类型的策略加入队列*/
+            void Push(Class type,std::vector<Frame> frames);
+            /*取出下一条信息，图像的信息和二进制帧作为一条取出*/
+            bool Pop(std::vector<Frame> &frames);
+            size_t Size();
+            /*上次调用之后是否丢弃过该类型的信息*/
+            bool TakeDropped(Class type);
+            /*同一时间只能有一个线程向该客户端发送*/
+            std::mutex send_mtx;
+        private:
+            struct Entry
+            {
+                Class type;
+                std::vector<Frame> frames;
+            };
+            std::deque<Entry> entries;
+            std::mutex mtx;
+            size_t MaxLog;
+            size_t LogNum = 0;
+            std::atomic_uint dropped;
+    };
+}
+
+#endif
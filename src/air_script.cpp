@@ -40,6 +40,7 @@ Description:Script port
 #include "air_solver.h"
 #include "air_mount.h"
 #include "air_filter.h"
+#include "air_device.h"
 
 #include <thread>
 #include <stdlib.h>
@@ -111,7 +112,7 @@ namespace AstroAir
             }
         }
         /*整合信息并发送至客户端*/
-        ws.send(Root.toStyledString());
+        ws.send(Root);
     }
 
     /*
@@ -230,10 +231,19 @@ namespace AstroAir
             {
                 InSequenceRun = true;
                 SequenceImageName = "Image_"+SequenceTarget+"_"+timestamp();
-                std::thread RunSequenceCamera(&AIRCAMERA::StartExposureSeq,CCD,Root["Camera"]["Loop"].asInt(),Root["Camera"]["Expo"].asInt(),Root["Camera"]["Bin"].asInt(),Root["Camera"]["SaveImage"].asBool(),SequenceImageName,Root["Camera"]["Gain"].asInt(),Root["Camera"]["Offset"].asInt());
-                RunSequenceCamera.detach();
+                const Json::Value &cam = Root["Camera"];
+                int loop = cam["Loop"].asInt(),exp = cam["Expo"].asInt(),bin = cam["Bin"].asInt(),gain = cam["Gain"].asInt(),offset = cam["Offset"].asInt();
+                bool save = cam["SaveImage"].asBool();
+                std::string name = SequenceImageName;
                 WebLog("Start sequence capture",2);
-                SS->thread_num--;
+                /*序列在相机队列中拍摄，不会与客户端发送的其他相机命令同时执行，拍摄完成后请求才结束*/
+                bool ok = CameraTask([=](AIRCAMERA *camera){camera->StartExposureSeq(loop,exp,bin,save,name,gain,offset);});
+                InSequenceRun = false;
+                if(!ok)
+                {
+                    RunSequenceError(_("Camera is not available"));
+                    return;
+                }
             }
             else
             {
@@ -246,17 +256,54 @@ namespace AstroAir
         {
             RunSequenceError(_("There is no camera been selected"));
             WebLog(_("未指定相机，无法进行计划拍摄"),3);
-            SS->thread_num--;
             return;
         }
     }
 
+    /*
+     * name: CameraTask(std::function<void(AIRCAMERA *camera)> task)
+     * @param task:需要使用相机的任务
+     * describe: Run a task with the primary camera
+     * 描述：使用主相机执行任务，序列和脚本命令本身在相机队列中执行，不会与客户端的相机命令同时执行
+     * @return false:相机未连接
+     * note: The task runs in the calling thread. Waiting here for another task
+     *       of the same bounded pool could deadlock once every worker is busy.
+     *       The device instance is held until the task returns, so the driver
+     *       is not released while it is still in use.
+     */
+    bool AIRSCRIPT::CameraTask(std::function<void(AIRCAMERA *camera)> task)
+    {
+        DevicePtr dev = DEVICES.Find(DeviceTypeName(DeviceType::Camera));
+        if(!dev || !dev->Camera)
+            return false;
+        /*请求已经被取消*/
+        OperationPtr op = CurrentOperation();
+        if(!op || !op->Cancelled)
+            task(dev->Camera);
+        return true;
+    }
+
+    /*
+     * name: AbortSequence()
+     * describe: Stop a running sequence or drag script
+     * 描述：取消序列或脚本，停止主相机正在进行的序列拍摄，脚本不再执行后续步骤
+     */
+    void AIRSCRIPT::AbortSequence()
+    {
+        Scripts.Enable = false;
+        if(AIRCAMERA *camera = DEVICES.Camera(""))
+        {
+            camera->StopSequence();
+            camera->AbortExposure();
+        }
+    }
+
     void AIRSCRIPT::RunSequenceError(std::string error)
     {
         Json::Value Root;
         Root["error"]["message"] = Json::Value(error);
         Root["id"] = Json::Value(100);
-        ws.send(Root.toStyledString());
+        ws.send(Root);
     }
 
 //----------------------------------------脚本----------------------------------------
@@ -307,7 +354,7 @@ namespace AstroAir
             }
         }
         /*整合信息并发送至客户端*/
-        ws.send(Root.toStyledString());
+        ws.send(Root);
     }
 
     constexpr std::uint32_t hash_str_to_uint32(const char* data)
@@ -363,6 +410,13 @@ namespace AstroAir
             }
             for(YAML::const_iterator it= script["jobs"]["steps"].begin(); it != script["jobs"]["steps"].end();++it)
             {
+                /*请求被取消后不再执行后续步骤*/
+                OperationPtr op = CurrentOperation();
+                if(op && op->Cancelled)
+                {
+                    WebLog(_("Drag script cancelled"),2);
+                    break;
+                }
                 /*执行脚本*/
                 switch (hash_str_to_uint32(it->first.as<std::string>().c_str()))
                 {
@@ -461,10 +515,12 @@ namespace AstroAir
 
     void AIRSCRIPT::DS_Shot(std::string type,int loop,int exp,int bin,int Gain,int Offset)
     {
-        for(int i = 0 ;i<loop;i++)
+        /*连续拍摄，读出后立即开始下一次曝光*/
+        if(Scripts.Enable)
         {
-            if(Scripts.Enable)
-                CCD->StartExposure(exp,bin,true,Scripts.SequenceImageName,Gain,Offset);
+            std::string name = Scripts.SequenceImageName;
+            if(!CameraTask([=](AIRCAMERA *camera){camera->StartExposureSeq(loop,exp,bin,true,name,Gain,Offset);}))
+                WebLog(_("Camera is not available, skip shot"),3);
         }
     }
 
@@ -36,9 +36,12 @@ Description:Script port
 
 #include <string>
 #include <atomic>
+#include <functional>
 
 namespace AstroAir
 {
+    class AIRCAMERA;
+
     class AIRSCRIPT
     {
         public:
@@ -49,6 +52,8 @@ namespace AstroAir
             void RunSequenceError(std::string error);
             void GetListAvalaibleDragScript();
             void RemoteDragScript(std::string DragScript);
+            /*取消序列或脚本*/
+            void AbortSequence();
         protected:
             void DS_Shot(std::string type,int loop,int exp,int bin,int Gain,int Offset);
             void DS_Goto(std::string RA,std::string DEC);
@@ -56,6 +61,8 @@ namespace AstroAir
             void DS_FilterMoveTo(int TargetPosition);
             void DS_Solve(int downsample);
             void DS_Guide();
+            /*使用主相机执行任务，调用者已经在相机队列中*/
+            bool CameraTask(std::function<void(AIRCAMERA *camera)> task);
         private:
             std::string SequenceImageName;
             std::atomic_bool InSequenceRun;
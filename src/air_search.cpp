@@ -163,7 +163,7 @@ namespace AstroAir
         info["Key"] = Json::Value(_("星座"));     //天体所在星座
         info["Value"] = Json::Value(CONZH);
         Root["ParamRet"]["Info"].append(info);
-		ws.send(Root.toStyledString());
+		ws.send(Root);
     }
 
     /*
@@ -188,7 +188,7 @@ namespace AstroAir
             Root["ActionResultInt"] = Json::Value(5);
             Root["Motivo"] = Json::Value(_("Could not open star base!"));
         }
-		ws.send(Root.toStyledString());
+		ws.send(Root);
     }
 
     /*
@@ -290,7 +290,7 @@ namespace AstroAir
             Root["ParamRet"]["list"].append(info);
             i++;
         }
-        ws.send(Root.toStyledString());
+        ws.send(Root);
     }
 
     void Search::RoboClipGetTargetListError(int errCode)
@@ -303,7 +303,7 @@ namespace AstroAir
             Root["Motivo"] = Json::Value("Not Found File!");
         else
             Root["Motivo"] = Json::Value("Empty File!");
-        ws.send(Root.toStyledString());
+        ws.send(Root);
     }
 
     void Search::RemoteRoboClipAddTarget(std::string DECJ2000,std::string RAJ2000,int FCOL,int FROW,std::string Group,std::string GuidTarget,bool IsMosaic,std::string Note,std::string PA,std::string TILES,std::string TargetName,bool angleAdj,int overlap)
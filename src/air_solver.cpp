@@ -144,7 +144,7 @@ namespace AstroAir
         Root["ParamRet"]["DEC"] = Json::Value(TargetDEC);
         Root["ParamRet"]["PA"] = Json::Value(MountAngle);
         Root["ParamRet"]["IsSolved"] = Json::Value("Completed");
-        ws.send(Root.toStyledString());
+        ws.send(Root);
     }
 
     /*
@@ -160,7 +160,7 @@ namespace AstroAir
         Root["UID"] = Json::Value("sendRemoteSolveNoSync");
         Root["ActionResultInt"] = Json::Value(5);
         Root["Motivo"] = Json::Value("Could not solve image!");
-        ws.send(Root.toStyledString());
+        ws.send(Root);
     }
 
     /*
@@ -174,15 +174,8 @@ namespace AstroAir
     bool ASICCD::Disconnect()
     {
 		/*在关闭相机之前停止所有任务*/
-		if(ASICAMERA->InVideo == true)
-		{
-			if((errCode = ASIStopVideoCapture(ASICAMERA->ID)) != ASI_SUCCESS)		//停止视频拍摄
-			{
-				IDLog("Unable to stop video capture,error code is %d,please try again.\n",errCode);
-				return false;
-			}
-			IDLog("Stop video capture.\n");
-		}
+		if(!StopVideoServer())		//停止视频拍摄
+			return false;
 		if(ASICAMERA->InExposure == true)
 		{
 			if((errCode = ASIStopExposure(ASICAMERA->ID)) != ASI_SUCCESS)		//停止曝光
@@ -200,6 +193,8 @@ namespace AstroAir
 			IDLog("Unable to turn off the camera,error code is %d,please try again\n",errCode);
 			return false;
 		}
+		/*归还空闲的图像缓冲区*/
+		FRAMES->Trim();
 		IDLog("Disconnect from camera\n");
 		return true;
     }
@@ -220,6 +215,12 @@ namespace AstroAir
     {
 		/*判断是否为彩色相机*/
 		ASICAMERA->isColorCamera = ASICameraInfo.IsColorCam;
+		/*获取拜耳阵列，用于预览图去马赛克*/
+		if(ASICAMERA->isColorCamera)
+		{
+			const char *Pattern[] = {"RGGB","BGGR","GRBG","GBRG"};
+			ASICAMERA->BayerPattern = (ASICameraInfo.BayerPattern >= ASI_BAYER_RG && ASICameraInfo.BayerPattern <= ASI_BAYER_GB) ? Pattern[ASICameraInfo.BayerPattern] : "";
+		}
 		/*判断是否为制冷相机*/
 		ASICAMERA->isCoolCamera = ASICameraInfo.IsCoolerCam;
 		/*判断是否为导星相机*/
@@ -229,6 +230,8 @@ namespace AstroAir
 		/*获取相机最大画幅*/
 		ASICAMERA->Image_Width = ASICAMERA->ImageMaxWidth = ASICameraInfo.MaxWidth;
 		ASICAMERA->Image_Height = ASICAMERA->ImageMaxHeight = ASICameraInfo.MaxHeight;
+		/*按照RAW16的最大画幅预先分配图像缓冲区*/
+		FRAMES->Reserve((size_t)ASICAMERA->ImageMaxWidth * ASICAMERA->ImageMaxHeight * 2);
 		IDLog(_("Camera information obtained successfully.\n"));
 		return true;
     }
@@ -373,16 +376,21 @@ namespace AstroAir
 				else
 				{
 					ASICAMERA->InExposure = true;
-					do
+					/*临近结束前休眠，之后再查询曝光状态*/
+					bool done = WaitExposure(exp,[this]
 					{
-						usleep(10000);
-						errCode = ASIGetExpStatus(ASICAMERA->ID, &expStatus);
-					}
-					while (errCode == ASI_SUCCESS && expStatus == ASI_EXP_WORKING);
-					if (errCode != ASI_SUCCESS)
+						if((errCode = ASIGetExpStatus(ASICAMERA->ID, &expStatus)) != ASI_SUCCESS || expStatus == ASI_EXP_FAILED)
+							return ExposureState::Failed;
+						return expStatus == ASI_EXP_WORKING ? ExposureState::Working : ExposureState::Done;
+					});
+					if (!done)
 					{
-						IDLog("Blink exposure failed, error %d, status %d\n", errCode, expStatus);
-						AbortExposure();
+						/*已经中止的曝光不需要再次停止*/
+						if(ASICAMERA->InExposure)
+						{
+							IDLog("Blink exposure failed, error %d, status %d\n", errCode, expStatus);
+							AbortExposure();
+						}
 						return false;
 					}
 					ASICAMERA->InExposure = false;
@@ -426,6 +434,7 @@ namespace AstroAir
 			return false;
 		}
 		ASICAMERA->InExposure = false;
+		WakeExposure();
 		return true;
     }
     
@@ -436,6 +445,7 @@ namespace AstroAir
      * calls: IDLog()
      * calls: ASISetControlValue()
      * calls: ASISetROIFormat()
+     * calls: ASISetStartPos()
      */
     bool ASICCD::SetCameraConfig(long Bin,long Gain,long Offset)
     {
@@ -450,13 +460,21 @@ namespace AstroAir
 			return false;
 		}
 		ASICAMERA->Bin = Bin;
-		ASICAMERA->Image_Height = ASICAMERA->ImageMaxHeight/Bin;
-		ASICAMERA->Image_Width = ASICAMERA->ImageMaxWidth/Bin;
+		/*ASI相机要求宽度为8的倍数*/
+		int StartX,StartY;
+		SubframeGeometry(Bin,8,StartX,StartY,ASICAMERA->Image_Width,ASICAMERA->Image_Height);
 		if((errCode = ASISetROIFormat(ASICAMERA->ID, ASICAMERA->Image_Width , ASICAMERA->Image_Height , Bin, (ASI_IMG_TYPE)ASICAMERA->ImageType)) != ASI_SUCCESS)
 		{
-			IDLog_Error(_("Unable to set camera offset,error code is %d\n"),errCode);
+			IDLog_Error(_("Unable to set camera ROI format,error code is %d\n"),errCode);
+			return false;
+		}
+		if((errCode = ASISetStartPos(ASICAMERA->ID, StartX, StartY)) != ASI_SUCCESS)
+		{
+			IDLog_Error(_("Unable to set camera start position,error code is %d\n"),errCode);
 			return false;
 		}
+		ASICAMERA->StartX = StartX;
+		ASICAMERA->StartY = StartY;
 		return true;
     }
 
@@ -464,44 +482,129 @@ namespace AstroAir
      * name: SaveImage(std::string FitsName)
      * describe: Save images
      * 描述：存储图像
-     * calls: ASIGetDataAfterExp()
-     * calls: fits_create_file()
-     * calls: fits_create_img()
-     * calls: fits_update_key()
-     * calls: fits_write_img()
-     * calls: fits_close_file()
-     * calls: fits_report_error()
-	 * calls: SaveImage()
-	 * calls: SaveFitsImage()
-	 * calls: clacHistogram()
+     * calls: ReadoutFrame()
+     * calls: SaveFrame()
+     * calls: PreviewFrame()
      */
     bool ASICCD::SaveImage(std::string FitsName)
     {
 		if(ASICAMERA->InExposure == false && ASICAMERA->InVideo == false)
 		{
-			long imgSize = ASICAMERA->Image_Width*ASICAMERA->Image_Height*(1 + (ASICAMERA->ImageType==ASI_IMG_RAW16));		//设置图像大小
-			unsigned char * imgBuf = new unsigned char[imgSize];		//图像缓冲区大小
-			/*曝光后获取图像信息*/
-			if ((errCode = ASIGetDataAfterExp(ASICAMERA->ID, imgBuf, imgSize)) != ASI_SUCCESS)
-			{
-				/*获取图像失败*/
-				IDLog_Error(_("ASIGetDataAfterExp error (%d)\n"),errCode);
+			FramePtr frame = ReadoutFrame();
+			if(!frame)
 				return false;
-			}
-			IDLog(_("Download from camera completely.\n"));
 			/*将图像写入本地文件*/
-			#ifdef HAS_FITSIO
-				FitsIO::SaveFitsImage(imgBuf,FitsName.c_str(),ASICAMERA->ImageType,ASICAMERA->isColorCamera,ASICAMERA->Image_Height,ASICAMERA->Image_Width,ASICAMERA->Name[ASICAMERA->ID],ASICAMERA->Exposure,ASICAMERA->Bin,ASICAMERA->Offset,ASICAMERA->Gain,ASICAMERA->Temperature);
-			#endif
-			#ifdef HAS_OPENCV
-				IMGINFO->img_data = "data:image/jpg;base64," + ImageTools::ConvertUCto64(imgBuf,ASICAMERA->isColorCamera,ASICAMERA->Image_Height,ASICAMERA->Image_Width);
-			#endif
-			if(imgBuf)
-				delete[] imgBuf;		//删除图像缓存
+			if(!SaveFrame(frame,FitsName))
+				return false;
+			PreviewFrame(frame);
+		}
+		return true;
+	}
+
+	/*
+     * name: ReadoutFrame()
+     * describe: Download the finished exposure into a pooled buffer
+     * 描述：将曝光完成的图像读出到缓冲池中的缓冲区
+     * calls: ASIGetDataAfterExp()
+     * @return 图像，失败时为空
+     */
+	FramePtr ASICCD::ReadoutFrame()
+	{
+		/*从缓冲池获取图像缓冲区，失败返回时自动归还*/
+		FramePtr frame = AcquireFrame();
+		if(!frame)
+			return nullptr;
+		/*曝光后获取图像信息*/
+		if ((errCode = ASIGetDataAfterExp(ASICAMERA->ID, frame->Data(), frame->Size())) != ASI_SUCCESS)
+		{
+			/*获取图像失败*/
+			IDLog_Error(_("ASIGetDataAfterExp error (%d)\n"),errCode);
+			return nullptr;
+		}
+		IDLog(_("Download from camera completely.\n"));
+		return frame;
+	}
+
+	FramePtr ASICCD::AcquireFrame()
+	{
+		/*RAW16每个像素两个字节，RGB24为三个通道*/
+		int BitDepth = ASICAMERA->ImageType == ASI_IMG_RAW16 ? 16 : 8;
+		int Channels = ASICAMERA->ImageType == ASI_IMG_RGB24 ? 3 : 1;
+		FramePtr frame = FRAMES->Acquire(ASICAMERA->Image_Width,ASICAMERA->Image_Height,BitDepth,Channels);
+		if(!frame)
+			return nullptr;
+		frame->StartX = ASICAMERA->StartX;
+		frame->StartY = ASICAMERA->StartY;
+		frame->Bin = ASICAMERA->Bin;
+		/*Y8是相机输出的黑白图像，不需要去马赛克*/
+		if(ASICAMERA->ImageType != ASI_IMG_Y8 && Channels == 1)
+			frame->Bayer = ASICAMERA->BayerPattern;
+		return frame;
+	}
+
+	/*
+     * name: StartVideo(int exp,int bin,int Gain,int Offset)
+     * @param exp:单帧曝光时间(毫秒)
+     * @param bin:像素合并
+     * @param Gain:相机增益
+     * @param Offset:相机偏置
+     * describe: Start video capture
+     * 描述：开始视频拍摄
+     * calls: SetCameraConfig()
+     * calls: ASISetControlValue()
+     * calls: ASIStartVideoCapture()
+     */
+	bool ASICCD::StartVideo(int exp,int bin,int Gain,int Offset)
+	{
+		if(!SetCameraConfig(bin,Gain,Offset))
+		{
+			IDLog_Error(_("Failed to set camera configure\n"));
+			return false;
+		}
+		if((errCode = ASISetControlValue(ASICAMERA->ID, ASI_EXPOSURE, (long)exp * 1000, ASI_FALSE)) != ASI_SUCCESS)
+		{
+			IDLog_Error(_("Failed to set video exposure to %dms, error %d\n"), exp, errCode);
+			return false;
 		}
+		if((errCode = ASIStartVideoCapture(ASICAMERA->ID)) != ASI_SUCCESS)
+		{
+			IDLog_Error(_("Unable to start video capture, error %d\n"), errCode);
+			return false;
+		}
+		VideoExposure = exp;
+		IDLog(_("Start video capture.\n"));
 		return true;
 	}
 
+	bool ASICCD::StopVideo()
+	{
+		if((errCode = ASIStopVideoCapture(ASICAMERA->ID)) != ASI_SUCCESS)		//停止视频拍摄
+		{
+			IDLog_Error(_("Unable to stop video capture,error code is %d,please try again.\n"),errCode);
+			return false;
+		}
+		IDLog(_("Stop video capture.\n"));
+		return true;
+	}
+
+	/*
+     * name: ReadoutVideoFrame()
+     * describe: Wait for the next video frame
+     * 描述：等待并读出下一帧视频图像
+     * calls: ASIGetVideoData()
+     * @return 图像，超时或失败时为空
+     */
+	FramePtr ASICCD::ReadoutVideoFrame()
+	{
+		FramePtr frame = AcquireFrame();
+		if(!frame)
+			return nullptr;
+		/*SDK建议的等待时间为曝光时间的两倍加500毫秒*/
+		if((errCode = ASIGetVideoData(ASICAMERA->ID, frame->Data(), frame->Size(), VideoExposure * 2 + 500)) != ASI_SUCCESS)
+			return nullptr;
+		return frame;
+	}
+
 	/*
      * name: SaveCameraConfig()
      * describe: Save camera configuration
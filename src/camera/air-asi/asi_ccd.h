@@ -64,6 +64,12 @@ namespace AstroAir
 			virtual bool SetCameraConfig(long Bin,long Gain,long Offset);
 			/*存储图像*/
 			virtual bool SaveImage(std::string FitsName);
+			/*读出图像*/
+			virtual FramePtr ReadoutFrame() override;
+			/*视频模式*/
+			virtual bool StartVideo(int exp,int bin,int Gain,int Offset) override;
+			virtual bool StopVideo() override;
+			virtual FramePtr ReadoutVideoFrame() override;
 			/*制冷*/
 			virtual bool Cooling(bool SetPoint,bool CoolDown,bool ASync,bool Warmup,bool CoolerOFF,int CamTemp) override;
 			/**/
@@ -80,6 +86,9 @@ namespace AstroAir
 			ASI_CAMERA_INFO ASICameraInfo;
 			ASI_ERROR_CODE errCode;
 			ASI_EXPOSURE_STATUS expStatus;
+			/*按照当前图像格式获取缓冲区*/
+			FramePtr AcquireFrame();
+			int VideoExposure = 0;		//视频单帧曝光时间(毫秒)
 	};
 }
 
@@ -41,6 +41,7 @@ Description:QHY camera driver
 #include <unistd.h>
 #include <json/json.h>
 #include <fstream>
+#include <chrono>
 
 namespace AstroAir
 {
@@ -187,15 +188,8 @@ namespace AstroAir
 	bool QHYCCD::Disconnect()
 	{
 		/*在关闭相机之前停止所有任务*/
-		if(QHYCAMERA->InVideo)
-		{
-			if(StopQHYCCDLive(pCamHandle) != QHYCCD_SUCCESS)		//停止视频拍摄
-			{
-				IDLog_Error(_("Unable to stop video capture, please try again.\n"));
-				return false;
-			}
-			IDLog(_("Stop video capture.\n"));
-		}
+		if(!StopVideoServer())		//停止视频拍摄
+			return false;
 		if(QHYCAMERA->InExposure)
 		{
 			if(CancelQHYCCDExposingAndReadout(pCamHandle) != QHYCCD_SUCCESS)		//停止曝光
@@ -221,6 +215,8 @@ namespace AstroAir
 		{
 			IDLog(_("SDK resources released.\n")); 
 		}
+		/*归还空闲的图像缓冲区*/
+		FRAMES->Trim();
 		IDLog(_("Disconnect from camera\n"));
 		return true;
     }
@@ -247,6 +243,8 @@ namespace AstroAir
 		{
 			QHYCAMERA->isColorCamera = true;
 			channels = 3;
+			/*获取拜耳阵列，用于预览图去马赛克*/
+			QHYCAMERA->BayerPattern = retVal == BAYER_GB ? "GBRG" : retVal == BAYER_GR ? "GRBG" : retVal == BAYER_BG ? "BGGR" : "RGGB";
 		}
 		if((retVal = IsQHYCCDControlAvailable(pCamHandle, CONTROL_COOLER)) == QHYCCD_SUCCESS)
 			QHYCAMERA->isCoolCamera = true;
@@ -259,6 +257,8 @@ namespace AstroAir
 		}
 		QHYCAMERA->Image_Width = QHYCAMERA->ImageMaxWidth;
 		QHYCAMERA->Image_Height = QHYCAMERA->ImageMaxHeight;
+		/*按照SDK需要的最大内存预先分配图像缓冲区*/
+		FRAMES->Reserve(GetQHYCCDMemLength(pCamHandle));
 		IDLog(_("Camera information obtained successfully.\n"));
 		return true;
 	}
@@ -301,16 +301,15 @@ namespace AstroAir
 			else
 			{
 				QHYCAMERA->InExposure = true;
-				if((retVal = ExpQHYCCDSingleFrame(pCamHandle)) != QHYCCD_ERROR)
-				{
-					usleep(10);
-				}
-				else
+				if((retVal = ExpQHYCCDSingleFrame(pCamHandle)) == QHYCCD_ERROR)
 				{
 					IDLog_Error(_("Blink exposure failed, error code is %d\n"), retVal);
 					AbortExposure();
 					return false;
                 }
+				/*读出时GetQHYCCDSingleFrame会等待曝光结束，这里只需要等到预计结束时间*/
+				if(!WaitExposure(exp))
+					return false;
 				QHYCAMERA->InExposure = false;
             }
         }
@@ -348,6 +347,7 @@ namespace AstroAir
 			return false;
 		}
 		QHYCAMERA->InExposure = false;
+		WakeExposure();
 		return true;
 	}
 	
@@ -383,9 +383,9 @@ namespace AstroAir
 			IDLog_Error(_("Unable to set camera OFFSET failure, error code is  %d\n"), retVal);
 			return false;
 		}
-		/*设置像素合并模式*/
-		QHYCAMERA->Image_Height =  QHYCAMERA->Image_Height / Bin;
-		QHYCAMERA->Image_Width = QHYCAMERA->Image_Width /Bin;
+		/*设置像素合并模式，画幅按照最大画幅计算，多次设置不会越来越小*/
+		int StartX,StartY;
+		SubframeGeometry((int)Bin,4,StartX,StartY,QHYCAMERA->Image_Width,QHYCAMERA->Image_Height);
 		if((retVal = SetQHYCCDBinMode(pCamHandle,Bin,Bin)) != QHYCCD_SUCCESS)
 		{
 			IDLog_Error(_("Unable to set camera BIN MODE failure, error code is  %d\n"), retVal);
@@ -393,12 +393,14 @@ namespace AstroAir
 		}
 		else
 		{
-			if((retVal = SetQHYCCDResolution(pCamHandle, 0, 0, QHYCAMERA->Image_Width, QHYCAMERA->Image_Height)) != QHYCCD_SUCCESS)
+			if((retVal = SetQHYCCDResolution(pCamHandle, StartX, StartY, QHYCAMERA->Image_Width, QHYCAMERA->Image_Height)) != QHYCCD_SUCCESS)
 			{
 				IDLog_Error(_("Unable to set camera frame size failure, error code is  %d\n"), retVal);
 				return false;
 			}
 			QHYCAMERA->Bin = Bin;
+			QHYCAMERA->StartX = StartX;
+			QHYCAMERA->StartY = StartY;
 		}
 		/*设置相机USB速度
 		retVal = IsQHYCCDControlAvailable(pCamHandle, CONTROL_SPEED);
@@ -439,45 +441,148 @@ namespace AstroAir
      * name: SaveImage(std::string FitsName)
      * describe: Save images
      * 描述：存储图像
-     * calls: GetQHYCCDMemLength()
-	 * calls: GetQHYCCDSingleFrame()
-     * calls: fits_create_file()
-     * calls: fits_create_img()
-     * calls: fits_update_key()
-     * calls: fits_write_img()
-     * calls: fits_close_file()
-     * calls: fits_report_error()
-	 * calls: SaveImage()
-	 * calls: SaveFitsImage()
-	 * calls: clacHistogram()
+     * calls: ReadoutFrame()
+     * calls: SaveFrame()
+     * calls: PreviewFrame()
      */
     bool QHYCCD::SaveImage(std::string FitsName)
     {
 		if(QHYCAMERA->InExposure == false && QHYCAMERA->InVideo == false)
 		{
-			uint32_t imgSize = GetQHYCCDMemLength(pCamHandle);		//设置图像大小
-			unsigned char * imgBuf = new unsigned char [imgSize];		//图像缓冲区大小
-			/*曝光后获取图像信息*/
-			if ((retVal = GetQHYCCDSingleFrame(pCamHandle, (uint32_t*)&QHYCAMERA->Image_Width, (uint32_t*)&QHYCAMERA->Image_Height, (uint32_t*)&QHYCAMERA->ImageType, &channels, imgBuf)) != QHYCCD_SUCCESS)
-			{
-				/*获取图像失败*/
-				IDLog_Error(_("GetQHYCCDSingleFrame error (%d)\n"),retVal);
+			FramePtr frame = ReadoutFrame();
+			if(!frame)
 				return false;
-			}
-			IDLog(_("Download complete.\n"));
 			/*将图像写入本地文件*/
-			#ifdef HAS_FITSIO
-				FitsIO::SaveFitsImage(imgBuf,FitsName.c_str(),QHYCAMERA->ImageType,QHYCAMERA->isColorCamera,QHYCAMERA->Image_Height,QHYCAMERA->Image_Width,QHYCAMERA->Name[QHYCAMERA->ID],QHYCAMERA->Exposure,QHYCAMERA->Bin,QHYCAMERA->Offset,QHYCAMERA->Gain,QHYCAMERA->Temperature);
-			#endif
-			#ifdef HAS_OPENCV
-				IMGINFO->img_data = "data:image/jpg;base64," + ImageTools::ConvertUCto64(imgBuf,QHYCAMERA->isColorCamera,QHYCAMERA->Image_Height,QHYCAMERA->Image_Width);
-			#endif
-			if(imgBuf)
-				delete[] imgBuf;		//删除图像缓存
+			if(!SaveFrame(frame,FitsName))
+				return false;
+			PreviewFrame(frame);
 		}
 		return true;
 	}
 
+	/*
+     * name: ReadoutFrame()
+     * describe: Download the finished exposure into a pooled buffer
+     * 描述：将曝光完成的图像读出到缓冲池中的缓冲区
+     * calls: GetQHYCCDMemLength()
+	 * calls: GetQHYCCDSingleFrame()
+     * @return 图像，失败时为空
+     */
+	FramePtr QHYCCD::ReadoutFrame()
+	{
+		/*从缓冲池获取图像缓冲区，失败返回时自动归还*/
+		FramePtr frame = FRAMES->Acquire(GetQHYCCDMemLength(pCamHandle));
+		if(!frame)
+			return nullptr;
+		/*曝光后获取图像信息*/
+		if ((retVal = GetQHYCCDSingleFrame(pCamHandle, (uint32_t*)&QHYCAMERA->Image_Width, (uint32_t*)&QHYCAMERA->Image_Height, (uint32_t*)&QHYCAMERA->ImageType, &channels, frame->Data())) != QHYCCD_SUCCESS)
+		{
+			/*获取图像失败*/
+			IDLog_Error(_("GetQHYCCDSingleFrame error (%d)\n"),retVal);
+			return nullptr;
+		}
+		IDLog(_("Download complete.\n"));
+		/*GetQHYCCDSingleFrame返回实际的位数和通道数，单通道的彩色相机图像为原始图像*/
+		frame->Width = QHYCAMERA->Image_Width;
+		frame->Height = QHYCAMERA->Image_Height;
+		frame->BitDepth = QHYCAMERA->ImageType;
+		frame->Channels = channels;
+		frame->StartX = QHYCAMERA->StartX;
+		frame->StartY = QHYCAMERA->StartY;
+		frame->Bin = QHYCAMERA->Bin;
+		if(channels == 1)
+			frame->Bayer = QHYCAMERA->BayerPattern;
+		return frame;
+	}
+
+	/*
+     * name: StartVideo(int exp,int bin,int Gain,int Offset)
+     * @param exp:单帧曝光时间(毫秒)
+     * @param bin:像素合并
+     * @param Gain:相机增益
+     * @param Offset:相机偏置
+     * describe: Start live mode
+     * 描述：切换到连续模式并开始视频拍摄
+     * calls: SetQHYCCDStreamMode()
+     * calls: InitQHYCCD()
+     * calls: BeginQHYCCDLive()
+     */
+	bool QHYCCD::StartVideo(int exp,int bin,int Gain,int Offset)
+	{
+		/*切换拍摄模式后需要重新初始化相机*/
+		if((retVal = SetQHYCCDStreamMode(pCamHandle, 1)) != QHYCCD_SUCCESS || (retVal = InitQHYCCD(pCamHandle)) != QHYCCD_SUCCESS)
+		{
+			IDLog_Error(_("This camera doesn't support live mode, error code is %d\n"), retVal);
+			return false;
+		}
+		if(!SetCameraConfig(bin,Gain,Offset))
+		{
+			IDLog_Error(_("Failed to set camera configure\n"));
+			StopVideo();
+			return false;
+		}
+		if((retVal = SetQHYCCDParam(pCamHandle, CONTROL_EXPOSURE, exp * 1000.0)) != QHYCCD_SUCCESS || (retVal = BeginQHYCCDLive(pCamHandle)) != QHYCCD_SUCCESS)
+		{
+			IDLog_Error(_("Unable to start video capture, error code is %d\n"), retVal);
+			StopVideo();
+			return false;
+		}
+		VideoExposure = exp;
+		IDLog(_("Start video capture.\n"));
+		return true;
+	}
+
+	bool QHYCCD::StopVideo()
+	{
+		if(StopQHYCCDLive(pCamHandle) != QHYCCD_SUCCESS)		//停止视频拍摄
+		{
+			IDLog_Error(_("Unable to stop video capture, please try again.\n"));
+			return false;
+		}
+		/*恢复单帧模式*/
+		if((retVal = SetQHYCCDStreamMode(pCamHandle, 0)) != QHYCCD_SUCCESS || (retVal = InitQHYCCD(pCamHandle)) != QHYCCD_SUCCESS)
+		{
+			IDLog_Error(_("Unable to return to single frame mode, error code is %d\n"), retVal);
+			return false;
+		}
+		IDLog(_("Stop video capture.\n"));
+		return true;
+	}
+
+	/*
+     * name: ReadoutVideoFrame()
+     * describe: Wait for the next live frame
+     * 描述：等待并读出下一帧视频图像
+     * calls: GetQHYCCDLiveFrame()
+     * @return 图像，超时或失败时为空
+     * note: GetQHYCCDLiveFrame returns an error until a frame is ready,
+     *       so it is polled until the same timeout the ASI SDK uses.
+     */
+	FramePtr QHYCCD::ReadoutVideoFrame()
+	{
+		FramePtr frame = FRAMES->Acquire(GetQHYCCDMemLength(pCamHandle));
+		if(!frame)
+			return nullptr;
+		uint32_t width,height,bpp,ch;
+		const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(VideoExposure * 2 + 500);
+		while((retVal = GetQHYCCDLiveFrame(pCamHandle, &width, &height, &bpp, &ch, frame->Data())) != QHYCCD_SUCCESS)
+		{
+			if(std::chrono::steady_clock::now() > deadline)
+				return nullptr;
+			usleep(2000);
+		}
+		frame->Width = width;
+		frame->Height = height;
+		frame->BitDepth = bpp;
+		frame->Channels = ch;
+		frame->StartX = QHYCAMERA->StartX;
+		frame->StartY = QHYCAMERA->StartY;
+		frame->Bin = QHYCAMERA->Bin;
+		if(ch == 1)
+			frame->Bayer = QHYCAMERA->BayerPattern;
+		return frame;
+	}
+
 	bool QHYCCD::Cooling(bool SetPoint,bool CoolDown,bool ASync,bool Warmup,bool CoolerOFF,int CamTemp)
 	{
 		if(QHYCAMERA->isCoolCamera == true)
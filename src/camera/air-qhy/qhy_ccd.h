@@ -66,6 +66,12 @@ namespace AstroAir
 			virtual bool SetCameraConfig(double Bin,double Gain,double Offset);
 			/*存储图像*/
 			virtual bool SaveImage(std::string FitsName);
+			/*读出图像*/
+			virtual FramePtr ReadoutFrame() override;
+			/*视频模式*/
+			virtual bool StartVideo(int exp,int bin,int Gain,int Offset) override;
+			virtual bool StopVideo() override;
+			virtual FramePtr ReadoutVideoFrame() override;
 			/*相机制冷*/
 			virtual bool Cooling(bool SetPoint,bool CoolDown,bool ASync,bool Warmup,bool CoolerOFF,int CamTemp) override;
 		protected:
@@ -85,6 +91,7 @@ namespace AstroAir
 			double pixelHeight;
 
 			unsigned int channels = 1; 		//通道，默认为黑白相机
+			int VideoExposure = 0;			//视频单帧曝光时间(毫秒)
 
 			qhyccd_handle *pCamHandle;
 	};
@@ -0,0 +1,468 @@
+/*
+ * sim_ccd.cpp
+ *
+ * Copyright (C) 2020-2021 Max Qian
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*************************************************
+
+Copyright: 2020-2021 Max Qian. All rights reserved
+
+Author:Max Qian
+
+E-mail:astro_air@126.com
+
+Date:2021-7-12
+
+Description:Simulated camera driver
+
+**************************************************/
+
+#include "sim_ccd.h"
+
+#include "../../logger.h"
+#include "../../config.h"
+
+#include <json/json.h>
+#include <fstream>
+#include <sstream>
+#include <random>
+#include <chrono>
+#include <thread>
+#include <algorithm>
+#include <math.h>
+
+namespace AstroAir
+{
+    /*噪声表的大小，必须为2的幂*/
+    const size_t NoiseTableSize = 1 << 16;
+    /*天空背景在B、G、R通道的相对亮度*/
+    const double SkyColor[3] = {0.8,1.0,0.9};
+
+    /*
+     * name: SIMCCD()
+     * describe: Initialization, for camera constructor
+     * 描述：构造函数，用于初始化相机参数
+     */
+    SIMCCD::SIMCCD(CameraInfo *NEW)
+    {
+        SIMCAMERA = NEW;
+        SIMCAMERA->Exposure = 0;
+        SIMCAMERA->ExposureUsed = 0;
+        SIMCAMERA->Gain = 0;
+        SIMCAMERA->Offset = 0;
+        SIMCAMERA->Temperature = 20;
+        SIMCAMERA->ID = 0;
+        SIMCAMERA->Bin = 1;
+        SIMCAMERA->Image_Height = 0;
+        SIMCAMERA->Image_Width = 0;
+        SIMCAMERA->ImageMaxHeight = 0;
+        SIMCAMERA->ImageMaxWidth = 0;
+        SIMCAMERA->InExposure = false;
+        SIMCAMERA->InVideo = false;
+        SIMCAMERA->isCameraConnected = false;
+        SIMCAMERA->isCameraCoolingOn = false;
+        SIMCAMERA->isColorCamera = false;
+        SIMCAMERA->isCoolCamera = true;
+        SIMCAMERA->isGuidingCamera = false;
+    }
+
+    /*
+     * name: ~SIMCCD()
+     * describe: Destructor
+     * 描述：析构函数
+     */
+    SIMCCD::~SIMCCD()
+    {
+        if(SIMCAMERA->isCameraConnected)
+            Disconnect();
+    }
+
+    /*
+     * name: Connect(std::string Device_name)
+     * @param Device_name:设备名称，同时是设置文件的名称
+     * describe: Load the simulator settings and build the star field
+     * 描述：读取config/camera/<设备名称>.json中的Simulator设置并生成星场，没有设置文件时使用默认值
+     * calls: BuildField()
+     */
+    bool SIMCCD::Connect(std::string Device_name)
+    {
+        DeviceName = Device_name.empty() ? "Simulator" : Device_name;
+        std::ifstream in("config/camera/" + DeviceName + ".json");
+        if(in.is_open())
+        {
+            std::stringstream buffer;
+            buffer << in.rdbuf();
+            std::string jsonStr = buffer.str();
+            Json::Value root;
+            Json::String errs;
+            Json::CharReaderBuilder reader;
+            std::unique_ptr<Json::CharReader>const json_read(reader.newCharReader());
+            if(json_read->parse(jsonStr.c_str(), jsonStr.c_str() + jsonStr.length(), &root,&errs))
+            {
+                const Json::Value &sim = root["Simulator"];
+                Setting.Width = std::max(sim.get("Width",Setting.Width).asInt(),16);
+                Setting.Height = std::max(sim.get("Height",Setting.Height).asInt(),16);
+                Setting.BitDepth = sim.get("BitDepth",Setting.BitDepth).asInt() > 8 ? 16 : 8;
+                Setting.Bayer = sim.get("Bayer",Setting.Bayer).asString();
+                Setting.Stars = std::max(sim.get("Stars",Setting.Stars).asInt(),0);
+                Setting.FWHM = std::max(sim.get("FWHM",Setting.FWHM).asDouble(),0.5);
+                Setting.MoffatBeta = sim.get("MoffatBeta",Setting.MoffatBeta).asDouble();
+                Setting.MaxFlux = sim.get("MaxFlux",Setting.MaxFlux).asDouble();
+                Setting.Sky = sim.get("Sky",Setting.Sky).asDouble();
+                Setting.ReadNoise = sim.get("ReadNoise",Setting.ReadNoise).asDouble();
+                Setting.Bias = sim.get("Bias",Setting.Bias).asDouble();
+                Setting.HotPixels = std::max(sim.get("HotPixels",Setting.HotPixels).asInt(),0);
+                Setting.Jitter = sim.get("Jitter",Setting.Jitter).asDouble();
+                Setting.ReadoutRate = sim.get("ReadoutRate",Setting.ReadoutRate).asDouble();
+                Setting.Seed = sim.get("Seed",Setting.Seed).asUInt();
+            }
+            else
+                IDLog_Error(_("Unable to parse simulator settings, using defaults: %s\n"),errs.c_str());
+        }
+        /*只支持标准的拜耳阵列*/
+        if(Setting.Bayer != "RGGB" && Setting.Bayer != "BGGR" && Setting.Bayer != "GRBG" && Setting.Bayer != "GBRG")
+            Setting.Bayer.clear();
+        SIMCAMERA->Name[SIMCAMERA->ID] = DeviceName.data();
+        SIMCAMERA->isColorCamera = !Setting.Bayer.empty();
+        SIMCAMERA->BayerPattern = Setting.Bayer;
+        SIMCAMERA->ImageType = Setting.BitDepth;
+        SIMCAMERA->Image_Width = SIMCAMERA->ImageMaxWidth = Setting.Width;
+        SIMCAMERA->Image_Height = SIMCAMERA->ImageMaxHeight = Setting.Height;
+        BuildField();
+        /*按照最大画幅预先分配图像缓冲区*/
+        FRAMES->Reserve((size_t)Setting.Width * Setting.Height * (Setting.BitDepth > 8 ? 2 : 1));
+        SIMCAMERA->isCameraConnected = true;
+        IDLog(_("Simulator %s connected, %dx%d %d bit %s, %d stars\n"),DeviceName.c_str(),Setting.Width,Setting.Height,Setting.BitDepth,Setting.Bayer.empty() ? "mono" : Setting.Bayer.c_str(),Setting.Stars);
+        return true;
+    }
+
+    /*
+     * name: Disconnect()
+     * describe: Disconnect from camera
+     * 描述：断开连接
+     */
+    bool SIMCCD::Disconnect()
+    {
+        if(!StopVideoServer())
+            return false;
+        if(SIMCAMERA->InExposure)
+            AbortExposure();
+        SIMCAMERA->isCameraConnected = false;
+        Field.clear();
+        Hot.clear();
+        /*归还空闲的图像缓冲区*/
+        FRAMES->Trim();
+        IDLog(_("Disconnect from simulator\n"));
+        return true;
+    }
+
+    std::string SIMCCD::ReturnDeviceName()
+    {
+        return DeviceName;
+    }
+
+    /*
+     * name: BuildField()
+     * describe: Generate a fixed star field
+     * 描述：按照随机数种子生成星点、热噪点和噪声表，同一设置每次生成的星场相同
+     * note: Star brightness follows a steep power law, so most stars are faint
+     *       and a few are bright enough to saturate, as on a real sky.
+     */
+    void SIMCCD::BuildField()
+    {
+        std::mt19937 gen(Setting.Seed);
+        std::uniform_real_distribution<double> uniform(0.0,1.0);
+        Field.resize(Setting.Stars);
+        for(auto &it : Field)
+        {
+            it.X = uniform(gen) * Setting.Width;
+            it.Y = uniform(gen) * Setting.Height;
+            it.Flux = Setting.MaxFlux * pow(uniform(gen),3.0);
+            /*从偏蓝到偏红的星点颜色*/
+            double t = uniform(gen);
+            it.Color[0] = 1.3 - 0.6 * t;
+            it.Color[1] = 1.0;
+            it.Color[2] = 0.7 + 0.6 * t;
+        }
+        Hot.resize(Setting.HotPixels);
+        for(auto &it : Hot)
+        {
+            it.first = (int)(uniform(gen) * Setting.Width);
+            it.second = (int)(uniform(gen) * Setting.Height);
+        }
+        /*逐像素生成正态分布的随机数太慢，预先生成后按随机下标读取*/
+        std::normal_distribution<float> normal(0.0f,1.0f);
+        NoiseTable.resize(NoiseTableSize);
+        for(auto &it : NoiseTable)
+            it = normal(gen);
+        RandomState = ((uint64_t)Setting.Seed << 1) | 1;
+    }
+
+    /*
+     * name: SetCameraConfig(int Bin,int Gain,int Offset)
+     * @param Bin:像素合并
+     * @param Gain:增益，按百分比放大信号
+     * @param Offset:偏置，直接加在16位图像的像素上
+     * describe: Apply binning and subframe
+     * 描述：设置像素合并和子画幅
+     * calls: SubframeGeometry()
+     */
+    bool SIMCCD::SetCameraConfig(int Bin,int Gain,int Offset)
+    {
+        SIMCAMERA->Bin = std::clamp(Bin,1,4);
+        SIMCAMERA->Gain = Gain;
+        SIMCAMERA->Offset = Offset;
+        int StartX,StartY;
+        SubframeGeometry(SIMCAMERA->Bin,2,StartX,StartY,SIMCAMERA->Image_Width,SIMCAMERA->Image_Height);
+        SIMCAMERA->StartX = StartX;
+        SIMCAMERA->StartY = StartY;
+        return SIMCAMERA->Image_Width > 0 && SIMCAMERA->Image_Height > 0;
+    }
+
+    /*
+     * name: StartExposure(int exp,int bin,bool IsSave,std::string FitsName,int Gain,int Offset)
+     * @param exp:曝光时间(秒)
+     * @param bin:像素合并
+     * @param IsSave:是否保存图像
+     * @param FitsName:保存图像名称
+     * @param Gain:增益
+     * @param Offset:偏置
+     * describe: Simulated exposure
+     * 描述：模拟曝光，与真实相机一样等待曝光时间并发送进度
+     * calls: WaitExposure()
+     * calls: SaveImage()
+     */
+    bool SIMCCD::StartExposure(int exp,int bin,bool IsSave,std::string FitsName,int Gain,int Offset)
+    {
+        if(!SIMCAMERA->isCameraConnected)
+            return false;
+        SIMCAMERA->Exposure = exp;
+        if(!SetCameraConfig(bin,Gain,Offset))
+        {
+            IDLog_Error(_("Failed to set camera configure\n"));
+            return false;
+        }
+        SIMCAMERA->InExposure = true;
+        if(!WaitExposure(exp))
+        {
+            IDLog(_("Simulated exposure aborted\n"));
+            return false;
+        }
+        SIMCAMERA->InExposure = false;
+        if(IsSave == true)
+        {
+            SIMCAMERA->LastImageName = FitsName;
+            if(!SaveImage(FitsName))
+            {
+                IDLog_Error(_("Could not save image correctly,please check the config\n"));
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool SIMCCD::AbortExposure()
+    {
+        IDLog(_("Aborting camera exposure...\n"));
+        SIMCAMERA->InExposure = false;
+        WakeExposure();
+        return true;
+    }
+
+    /*
+     * name: SaveImage(std::string FitsName)
+     * describe: Save images
+     * 描述：存储图像
+     * calls: ReadoutFrame()
+     * calls: SaveFrame()
+     * calls: PreviewFrame()
+     */
+    bool SIMCCD::SaveImage(std::string FitsName)
+    {
+        if(SIMCAMERA->InExposure == false && SIMCAMERA->InVideo == false)
+        {
+            FramePtr frame = ReadoutFrame();
+            if(!frame)
+                return false;
+            if(!SaveFrame(frame,FitsName))
+                return false;
+            PreviewFrame(frame);
+        }
+        return true;
+    }
+
+    FramePtr SIMCCD::ReadoutFrame()
+    {
+        return Render(SIMCAMERA->Exposure);
+    }
+
+    /*
+     * name: Render(double seconds)
+     * @param seconds:曝光时间
+     * describe: Render one frame of the star field into a pooled buffer
+     * 描述：生成一帧图像：天空背景、星点、散粒噪声和读出噪声、热噪点，彩色相机按拜耳阵列生成原始图像
+     * @return 图像，内存不足时为空
+     * note: Only the current subframe is rendered. Readout takes pixels / ReadoutRate
+     *       like a real camera; the rendering time counts towards it.
+     */
+    FramePtr SIMCCD::Render(double seconds)
+    {
+        const auto start = std::chrono::steady_clock::now();
+        const int bin = std::max(SIMCAMERA->Bin,1);
+        const int W = SIMCAMERA->Image_Width,H = SIMCAMERA->Image_Height;
+        const int X0 = SIMCAMERA->StartX,Y0 = SIMCAMERA->StartY;
+        const int depth = Setting.BitDepth > 8 ? 16 : 8;
+        FramePtr frame = FRAMES->Acquire(W,H,depth,1);
+        if(!frame)
+            return nullptr;
+        frame->StartX = X0;
+        frame->StartY = Y0;
+        frame->Bin = bin;
+        frame->Bayer = Setting.Bayer;
+        /*拜耳阵列中每个位置对应的通道(B、G、R)*/
+        int cfa[4] = {1,1,1,1};
+        const bool color = !Setting.Bayer.empty();
+        if(color)
+        {
+            for(int i = 0;i < 4;i++)
+                cfa[i] = Setting.Bayer[i] == 'B' ? 0 : (Setting.Bayer[i] == 'G' ? 1 : 2);
+        }
+        auto Channel = [&](int x,int y){return cfa[((Y0 + y) & 1) * 2 + ((X0 + x) & 1)];};
+        /*增益按百分比放大信号*/
+        const double scale = 1 + SIMCAMERA->Gain / 100.0;
+        std::vector<float> img((size_t)W * H);
+        /*天空背景，合并后的像素收集bin*bin个像素的光*/
+        const double sky = Setting.Sky * seconds * bin * bin * scale;
+        for(int y = 0;y < H;y++)
+            for(int x = 0;x < W;x++)
+                img[(size_t)y * W + x] = color ? sky * SkyColor[Channel(x,y)] : sky;
+        /*随机数，xorshift64*从噪声表中取样*/
+        auto Gauss = [this]
+        {
+            RandomState ^= RandomState >> 12;
+            RandomState ^= RandomState << 25;
+            RandomState ^= RandomState >> 27;
+            return NoiseTable[((RandomState * 2685821657736338717ULL) >> 48) & (NoiseTableSize - 1)];
+        };
+        /*星点，整幅星场随跟踪误差一起移动*/
+        const double dx = Setting.Jitter * Gauss(),dy = Setting.Jitter * Gauss();
+        const double fwhm = Setting.FWHM / bin;
+        const double sigma = fwhm / 2.3548;
+        const bool moffat = Setting.MoffatBeta > 1;
+        const double beta = Setting.MoffatBeta;
+        const double alpha = moffat ? fwhm / (2 * sqrt(pow(2.0,1.0 / beta) - 1)) : 0;
+        const int radius = (int)ceil(moffat ? 4 * fwhm : 4 * sigma) + 1;
+        for(const auto &s : Field)
+        {
+            const double cx = (s.X + dx) / bin - X0,cy = (s.Y + dy) / bin - Y0;
+            if(cx < -radius || cy < -radius || cx >= W + radius || cy >= H + radius)
+                continue;
+            const double flux = s.Flux * seconds * scale;
+            const double norm = moffat ? flux * (beta - 1) / (M_PI * alpha * alpha) : flux / (2 * M_PI * sigma * sigma);
+            const int xs = std::max((int)cx - radius,0),xe = std::min((int)cx + radius,W - 1);
+            const int ys = std::max((int)cy - radius,0),ye = std::min((int)cy + radius,H - 1);
+            for(int y = ys;y <= ye;y++)
+            {
+                for(int x = xs;x <= xe;x++)
+                {
+                    const double r2 = (x - cx) * (x - cx) + (y - cy) * (y - cy);
+                    double v = moffat ? norm * pow(1 + r2 / (alpha * alpha),-beta) : norm * exp(-r2 / (2 * sigma * sigma));
+                    if(color)
+                        v *= s.Color[Channel(x,y)];
+                    img[(size_t)y * W + x] += v;
+                }
+            }
+        }
+        /*散粒噪声和读出噪声，加上偏置后量化*/
+        const double bias = Setting.Bias + SIMCAMERA->Offset;
+        const double rn2 = Setting.ReadNoise * Setting.ReadNoise;
+        const float MaxValue = 65535;
+        for(auto &v : img)
+        {
+            const double signal = std::max(v,0.0f);
+            v = std::clamp((float)(signal + bias + sqrt(signal + rn2) * Gauss()),0.0f,MaxValue);
+        }
+        /*热噪点接近饱和*/
+        for(const auto &it : Hot)
+        {
+            const int x = it.first / bin - X0,y = it.second / bin - Y0;
+            if(x >= 0 && y >= 0 && x < W && y < H)
+                img[(size_t)y * W + x] = MaxValue * 0.95f;
+        }
+        if(depth == 16)
+        {
+            uint16_t *dst = (uint16_t *)frame->Data();
+            for(size_t i = 0;i < img.size();i++)
+                dst[i] = (uint16_t)img[i];
+        }
+        else
+        {
+            unsigned char *dst = frame->Data();
+            for(size_t i = 0;i < img.size();i++)
+                dst[i] = (unsigned char)(img[i] / 257);
+        }
+        /*模拟读出时间*/
+        if(Setting.ReadoutRate > 0)
+            std::this_thread::sleep_until(start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>((double)W * H / (Setting.ReadoutRate * 1e6))));
+        return frame;
+    }
+
+    /*
+     * name: StartVideo(int exp,int bin,int Gain,int Offset)
+     * @param exp:单帧曝光时间(毫秒)
+     * describe: Start simulated video
+     * 描述：开始模拟视频拍摄
+     */
+    bool SIMCCD::StartVideo(int exp,int bin,int Gain,int Offset)
+    {
+        if(!SIMCAMERA->isCameraConnected || !SetCameraConfig(bin,Gain,Offset))
+            return false;
+        VideoExposure = exp;
+        return true;
+    }
+
+    bool SIMCCD::StopVideo()
+    {
+        return true;
+    }
+
+    FramePtr SIMCCD::ReadoutVideoFrame()
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(VideoExposure));
+        return Render(VideoExposure / 1000.0);
+    }
+
+    /*
+     * name: Cooling(bool SetPoint,bool CoolDown,bool ASync,bool Warmup,bool CoolerOFF,int CamTemp)
+     * describe: Simulated cooler, reaches the set point at once
+     * 描述：模拟制冷，立即达到设定温度
+     */
+    bool SIMCCD::Cooling(bool SetPoint,bool CoolDown,bool ASync,bool Warmup,bool CoolerOFF,int CamTemp)
+    {
+        if(CoolerOFF || Warmup)
+        {
+            SIMCAMERA->isCameraCoolingOn = false;
+            SIMCAMERA->Temperature = 20;
+        }
+        else if(SetPoint || CoolDown)
+        {
+            SIMCAMERA->isCameraCoolingOn = true;
+            SIMCAMERA->Temperature = CamTemp;
+        }
+        return true;
+    }
+}
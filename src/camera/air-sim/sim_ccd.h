@@ -0,0 +1,117 @@
+/*
+ * sim_ccd.h
+ *
+ * Copyright (C) 2020-2021 Max Qian
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*************************************************
+
+Copyright: 2020-2021 Max Qian. All rights reserved
+
+Author:Max Qian
+
+E-mail:astro_air@126.com
+
+Date:2021-7-12
+
+Description:Simulated camera driver
+
+**************************************************/
+
+#ifndef _SIMCCD_H_
+#define _SIMCCD_H_
+
+#include "../../air_camera.h"
+
+#include <vector>
+#include <stdint.h>
+
+namespace AstroAir
+{
+    /*模拟相机设置，从config/camera/<设备名称>.json的Simulator项读取*/
+    struct SimulatorSetting
+    {
+        int Width = 4144;               //传感器尺寸
+        int Height = 2822;
+        int BitDepth = 16;              //8或16
+        std::string Bayer;              //拜耳阵列，为空时为黑白相机
+        int Stars = 300;                //星点数量
+        double FWHM = 3.0;              //星点半高全宽(像素)
+        double MoffatBeta = 0;          //Moffat分布的beta，为0时使用高斯分布
+        double MaxFlux = 200000;        //最亮星点每秒的总亮度(ADU)
+        double Sky = 20;                //天空背景每秒每像素的亮度(ADU)
+        double ReadNoise = 8;           //读出噪声(ADU)
+        double Bias = 500;              //16位图像的偏置(ADU)
+        int HotPixels = 200;            //热噪点数量
+        double Jitter = 0.5;            //每帧星点位置的随机偏移(像素)，模拟跟踪误差
+        double ReadoutRate = 50;        //读出速度(百万像素每秒)
+        unsigned int Seed = 1;          //随机数种子，相同的种子生成相同的星场
+    };
+
+    class SIMCCD: public AIRCAMERA
+    {
+        public:
+            /*构造函数，重置参数*/
+            explicit SIMCCD(CameraInfo *NEW);
+            /*析构函数*/
+            virtual ~SIMCCD();
+            /*连接相机*/
+            virtual bool Connect(std::string Device_name) override;
+            /*断开连接*/
+            virtual bool Disconnect() override;
+            /*返回相机名称*/
+            virtual std::string ReturnDeviceName() override;
+            /*开始曝光*/
+            virtual bool StartExposure(int exp,int bin,bool IsSave,std::string FitsName,int Gain,int Offset) override;
+            /*停止曝光*/
+            virtual bool AbortExposure() override;
+            /*存储图像*/
+            virtual bool SaveImage(std::string FitsName);
+            /*读出图像*/
+            virtual FramePtr ReadoutFrame() override;
+            /*视频模式*/
+            virtual bool StartVideo(int exp,int bin,int Gain,int Offset) override;
+            virtual bool StopVideo() override;
+            virtual FramePtr ReadoutVideoFrame() override;
+            /*制冷*/
+            virtual bool Cooling(bool SetPoint,bool CoolDown,bool ASync,bool Warmup,bool CoolerOFF,int CamTemp) override;
+        private:
+            struct SimStar
+            {
+                double X,Y;                 //传感器像素坐标
+                double Flux;                //每秒的总亮度
+                double Color[3];            //B、G、R通道的相对亮度
+            };
+            /*设置像素合并和子画幅*/
+            bool SetCameraConfig(int Bin,int Gain,int Offset);
+            /*生成星场、热噪点和噪声表*/
+            void BuildField();
+            /*按照当前设置生成一帧图像*/
+            FramePtr Render(double seconds);
+
+            CameraInfo *SIMCAMERA;
+            SimulatorSetting Setting;
+            std::string DeviceName;
+
+            std::vector<SimStar> Field;
+            std::vector<std::pair<int,int>> Hot;        //热噪点的传感器坐标
+            std::vector<float> NoiseTable;              //标准正态分布的样本
+            uint64_t RandomState = 1;
+            int VideoExposure = 0;                      //视频单帧曝光时间(毫秒)
+    };
+}
+
+#endif
@@ -4,6 +4,7 @@
 #define DEBUG_MODE ON
 
 #define HAS_WEBSOCKET ON
+#define HAS_DEFLATE ON
 #define HAS_JSONCPP ON
 #define HAS_OPENCV ON
 #define HAS_FITSIO ON
@@ -17,6 +18,7 @@
 #define HAS_ASIEFW 
 //#define HAS_INDI 
 #define HAS_GPhoto2 ON
+#define HAS_SIMULATOR ON
 
 #define HAS_IOPTRON ON
 
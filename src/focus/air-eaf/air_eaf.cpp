@@ -180,12 +180,14 @@ namespace AstroAir
         while(1)
 		{
 			EAFGetPosition(EAFInfo.ID, &EAF_position_now);
+            PositionChanged(EAF_position_now);
 			bool pbHandControl;
 			if((errCode = EAFIsMoving(EAFInfo.ID, &InMoving, &pbHandControl)) != EAF_SUCCESS || !InMoving)
                 break;
             usleep(500);
 		} 
         EAFGetPosition(EAFInfo.ID, &EAF_position_now);
+        PositionChanged(EAF_position_now);
         if(EAF_position_now == TargetPosition)
         {
             IDLog(_("Focuser's moving finished\n"));
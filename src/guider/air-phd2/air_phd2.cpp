@@ -199,6 +199,7 @@ namespace AstroAir
                 {
                     Guide_RA = root["RADistanceRaw"].asDouble();
                     Guide_DEC = root["DECDistanceRaw"].asDouble();
+                    GuideStepSend(root);
                     break;
                 }
                 case "GuidingStopped"_hash:
@@ -236,6 +237,30 @@ namespace AstroAir
         
     }
 
+    /*
+     * name: GuideStepSend(const Json::Value &step)
+     * @param step:PHD2的GuideStep事件
+     * describe: Forward a guide step to subscribed clients
+     * 描述：将导星数据发送给订阅了导星数据的客户端，没有客户端订阅时直接返回
+     */
+    void PHD2::GuideStepSend(const Json::Value &step)
+    {
+        if(!ws.Subscribed(Topic::GuideSteps))
+            return;
+        Json::Value Root;
+        Root["Event"] = Json::Value("GuideStep");
+        Root["Frame"] = step["Frame"];
+        Root["Time"] = step["Time"];
+        Root["RADistance"] = step["RADistanceRaw"];
+        Root["DECDistance"] = step["DECDistanceRaw"];
+        Root["RADuration"] = step["RADuration"];
+        Root["DECDuration"] = step["DECDuration"];
+        Root["StarMass"] = step["StarMass"];
+        Root["SNR"] = step["SNR"];
+        Root["HFD"] = step["HFD"];
+        ws.Publish(Topic::GuideSteps,Root);
+    }
+
     void PHD2::SendToPHD2(std::string message)
     {
         PHD2TCP->SendMessage(message.c_str());
@@ -56,6 +56,8 @@ namespace AstroAir
             void UpdatePHD2Info();
             void GetInfoFromPHD2();
             void ReadJson(std::string message);
+            /*将每一步导星数据发送给订阅的客户端*/
+            void GuideStepSend(const Json::Value &step);
         private:
             void SendToPHD2(std::string message);
             void ReadFromPHD2();
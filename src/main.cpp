@@ -97,6 +97,8 @@ int main(int argc, char *argv[])
   	textdomain(PACKAGE);
 
 	int WebPortal = 5950;
+	/*全局对象都已构造，此时才能加载配置*/
+	AstroAir::ws.Init();
 
 	char *optarg;
     int optind, opterr, optopt;
@@ -230,6 +232,7 @@ int main(int argc, char *argv[])
 	{
 		AstroAir::ws.run(WebPortal);
 	}
+	AstroAir::ws.Shutdown();
     return 0;
 }
 
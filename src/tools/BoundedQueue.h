@@ -0,0 +1,102 @@
+/*
+ * BoundedQueue.h
+ *
+ * Copyright (C) 2020-2021 Max Qian
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*************************************************
+
+Copyright: 2020-2021 Max Qian. All rights reserved
+
+Author:Max Qian
+
+E-mail:astro_air@126.com
+
+Date:2021-7-12
+
+Description:Bounded blocking queue between pipeline stages
+
+**************************************************/
+
+#ifndef _BOUNDED_QUEUE_H_
+#define _BOUNDED_QUEUE_H_
+
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+
+namespace AstroAir
+{
+    /*
+        有界阻塞队列
+        队列已满时生产者等待，下游处理不过来时上游自动减速，不会无限占用内存
+        关闭后不再接受新的数据，消费者取完剩余的数据后退出
+    */
+    template<typename T>
+    class BoundedQueue
+    {
+        public:
+            explicit BoundedQueue(size_t capacity) : Capacity(capacity ? capacity : 1) {}
+
+            /*放入数据，队列已满时等待，队列已关闭时返回false*/
+            bool Push(T item)
+            {
+                std::unique_lock<std::mutex> lock(mtx);
+                not_full.wait(lock,[this]{return closed || items.size() < Capacity;});
+                if(closed)
+                    return false;
+                items.push_back(std::move(item));
+                not_empty.notify_one();
+                return true;
+            }
+
+            /*取出数据，队列为空时等待，队列已关闭且为空时返回false*/
+            bool Pop(T &item)
+            {
+                std::unique_lock<std::mutex> lock(mtx);
+                not_empty.wait(lock,[this]{return closed || !items.empty();});
+                if(items.empty())
+                    return false;
+                item = std::move(items.front());
+                items.pop_front();
+                not_full.notify_one();
+                return true;
+            }
+
+            void Close()
+            {
+                std::lock_guard<std::mutex> guard(mtx);
+                closed = true;
+                not_full.notify_all();
+                not_empty.notify_all();
+            }
+
+            size_t Size()
+            {
+                std::lock_guard<std::mutex> guard(mtx);
+                return items.size();
+            }
+        private:
+            std::deque<T> items;
+            std::mutex mtx;
+            std::condition_variable not_full;
+            std::condition_variable not_empty;
+            size_t Capacity;
+            bool closed = false;
+    };
+}
+
+#endif
@@ -0,0 +1,224 @@
+/*
+ * FramePool.cpp
+ *
+ * Copyright (C) 2020-2021 Max Qian
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*************************************************
+
+Copyright: 2020-2021 Max Qian. All rights reserved
+
+Author:Max Qian
+
+E-mail:astro_air@126.com
+
+Date:2021-7-12
+
+Description:Camera frame buffer pool
+
+**************************************************/
+
+#include "FramePool.h"
+#include "../logger.h"
+
+#include <algorithm>
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace AstroAir
+{
+    FramePool NEW_FRAMES;
+    FramePool *FRAMES = &NEW_FRAMES;
+
+    /*大页的大小*/
+    const size_t HugePageSize = 2 << 20;
+
+    FramePool::FramePool() : shared(std::make_shared<Shared>())
+    {
+    }
+
+    FramePool::Shared::~Shared()
+    {
+        for(auto &it : idle)
+            Free(it);
+    }
+
+    /*
+     * name: Allocate(size_t size,bool HugePages,Block &block)
+     * @param size:需要的字节数
+     * @param HugePages:是否使用大页
+     * @param block:分配的内存
+     * describe: Map a page aligned block
+     * 描述：使用mmap分配按页对齐的内存，大页不可用时改用透明大页
+     */
+    bool FramePool::Allocate(size_t size,bool HugePages,Block &block)
+    {
+        if(HugePages && size >= HugePageSize)
+        {
+            #ifdef MAP_HUGETLB
+                size_t capacity = (size + HugePageSize - 1) / HugePageSize * HugePageSize;
+                void *ptr = mmap(nullptr,capacity,PROT_READ | PROT_WRITE,MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB,-1,0);
+                if(ptr != MAP_FAILED)
+                {
+                    block = {(unsigned char *)ptr,capacity,true};
+                    return true;
+                }
+            #endif
+        }
+        const size_t page = sysconf(_SC_PAGESIZE);
+        size_t capacity = (std::max<size_t>(size,1) + page - 1) / page * page;
+        void *ptr = mmap(nullptr,capacity,PROT_READ | PROT_WRITE,MAP_PRIVATE | MAP_ANONYMOUS,-1,0);
+        if(ptr == MAP_FAILED)
+            return false;
+        #ifdef MADV_HUGEPAGE
+            if(HugePages)
+                madvise(ptr,capacity,MADV_HUGEPAGE);
+        #endif
+        block = {(unsigned char *)ptr,capacity,false};
+        return true;
+    }
+
+    void FramePool::Free(const Block &block)
+    {
+        munmap(block.data,block.capacity);
+    }
+
+    /*
+     * name: Release(const std::shared_ptr<Shared> &shared,const Block &block)
+     * @param shared:缓冲池的状态
+     * @param block:归还的内存
+     * describe: Keep the block for the next frame or give it back to the system
+     * 描述：空闲缓冲区未满时保留，否则直接归还系统
+     */
+    void FramePool::Release(const std::shared_ptr<Shared> &shared,const Block &block)
+    {
+        {
+            std::lock_guard<std::mutex> guard(shared->mtx);
+            if(shared->idle.size() < shared->MaxIdle)
+            {
+                shared->idle.push_back(block);
+                return;
+            }
+        }
+        Free(block);
+    }
+
+    /*
+     * name: Acquire(size_t size)
+     * @param size:需要的字节数
+     * describe: Get a buffer, reusing the smallest idle block that fits
+     * 描述：获取缓冲区，优先使用能够容纳的最小空闲缓冲区，没有时重新分配
+     * @return 缓冲区，内存不足时为空
+     */
+    FramePtr FramePool::Acquire(size_t size)
+    {
+        Block block = {nullptr,0,false};
+        bool HugePages;
+        {
+            std::lock_guard<std::mutex> guard(shared->mtx);
+            HugePages = shared->HugePages;
+            auto best = shared->idle.end();
+            for(auto it = shared->idle.begin();it != shared->idle.end();++it)
+            {
+                if(it->capacity >= size && (best == shared->idle.end() || it->capacity < best->capacity))
+                    best = it;
+            }
+            if(best != shared->idle.end())
+            {
+                block = *best;
+                shared->idle.erase(best);
+            }
+        }
+        if(!block.data && !Allocate(size,HugePages,block))
+        {
+            IDLog_Error(_("Unable to allocate %zu bytes for image buffer\n"),size);
+            return nullptr;
+        }
+        FrameBuffer *frame = new FrameBuffer();
+        frame->data = block.data;
+        frame->size = size;
+        frame->capacity = block.capacity;
+        frame->huge = block.huge;
+        std::shared_ptr<Shared> state = shared;
+        return FramePtr(frame,[state](FrameBuffer *frame)
+        {
+            Release(state,{frame->data,frame->capacity,frame->huge});
+            delete frame;
+        });
+    }
+
+    FramePtr FramePool::Acquire(int Width,int Height,int BitDepth,int Channels)
+    {
+        if(Width <= 0 || Height <= 0 || Channels <= 0)
+            return nullptr;
+        FramePtr frame = Acquire((size_t)Width * Height * Channels * (BitDepth > 8 ? 2 : 1));
+        if(frame)
+        {
+            frame->Width = Width;
+            frame->Height = Height;
+            frame->BitDepth = BitDepth;
+            frame->Channels = Channels;
+        }
+        return frame;
+    }
+
+    void FramePool::Reserve(size_t size,size_t count)
+    {
+        std::vector<FramePtr> frames;
+        for(size_t i = 0;i < count;i++)
+        {
+            FramePtr frame = Acquire(size);
+            if(!frame)
+                break;
+            frames.push_back(frame);
+        }
+        /*frames释放后全部回到空闲列表*/
+    }
+
+    void FramePool::SetMaxIdle(size_t count)
+    {
+        std::vector<Block> extra;
+        {
+            std::lock_guard<std::mutex> guard(shared->mtx);
+            shared->MaxIdle = count;
+            while(shared->idle.size() > count)
+            {
+                extra.push_back(shared->idle.back());
+                shared->idle.pop_back();
+            }
+        }
+        for(auto &it : extra)
+            Free(it);
+    }
+
+    void FramePool::SetHugePages(bool enable)
+    {
+        std::lock_guard<std::mutex> guard(shared->mtx);
+        shared->HugePages = enable;
+    }
+
+    void FramePool::Trim()
+    {
+        std::vector<Block> idle;
+        {
+            std::lock_guard<std::mutex> guard(shared->mtx);
+            idle.swap(shared->idle);
+        }
+        for(auto &it : idle)
+            Free(it);
+    }
+}
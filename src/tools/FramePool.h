@@ -0,0 +1,119 @@
+/*
+ * FramePool.h
+ *
+ * Copyright (C) 2020-2021 Max Qian
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*************************************************
+
+Copyright: 2020-2021 Max Qian. All rights reserved
+
+Author:Max Qian
+
+E-mail:astro_air@126.com
+
+Date:2021-7-12
+
+Description:Camera frame buffer pool
+
+**************************************************/
+
+#ifndef _FRAME_POOL_H_
+#define _FRAME_POOL_H_
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+
+namespace AstroAir
+{
+    /*
+        一帧图像的缓冲区
+        内存按页对齐，由FramePool分配，最后一个引用释放后回到缓冲池
+        读出、保存FITS、生成预览和星点分析共用同一块内存，不需要复制
+    */
+    class FrameBuffer
+    {
+        public:
+            unsigned char *Data() const {return data;}
+            size_t Size() const {return size;}              //图像数据的字节数
+            size_t Capacity() const {return capacity;}      //实际分配的字节数
+            /*图像格式，由驱动在读出后填写*/
+            int Width = 0;
+            int Height = 0;
+            int BitDepth = 8;
+            int Channels = 1;
+            std::string Bayer;                              //原始图像的拜耳阵列，不需要去马赛克时为空
+            int StartX = 0;                                 //子画幅在传感器上的起点(合并后的像素)
+            int StartY = 0;
+            int Bin = 1;
+        private:
+            friend class FramePool;
+            unsigned char *data = nullptr;
+            size_t size = 0;
+            size_t capacity = 0;
+            bool huge = false;
+    };
+    typedef std::shared_ptr<FrameBuffer> FramePtr;
+
+    /*
+        相机图像缓冲池
+        每次曝光都分配几十MB的内存会使内存碎片化，空闲的缓冲区保留下来给下一帧使用
+        内存直接由mmap分配，可以使用大页，归还时不经过堆
+    */
+    class FramePool
+    {
+        public:
+            FramePool();
+            /*获取至少size字节的缓冲区，失败时返回空指针*/
+            FramePtr Acquire(size_t size);
+            /*按照图像尺寸获取缓冲区并填写图像格式*/
+            FramePtr Acquire(int Width,int Height,int BitDepth,int Channels);
+            /*连接相机后按照最大画幅预先分配，第一次曝光不需要等待分配内存*/
+            void Reserve(size_t size,size_t count = 1);
+            /*最多保留的空闲缓冲区数量*/
+            void SetMaxIdle(size_t count);
+            /*使用大页，系统不支持时使用透明大页*/
+            void SetHugePages(bool enable);
+            /*释放所有空闲的缓冲区*/
+            void Trim();
+        private:
+            struct Block
+            {
+                unsigned char *data;
+                size_t capacity;
+                bool huge;
+            };
+            /*缓冲区可能在缓冲池之后释放，共享的状态由所有缓冲区持有*/
+            struct Shared
+            {
+                std::mutex mtx;
+                std::vector<Block> idle;
+                size_t MaxIdle = 2;
+                bool HugePages = false;
+                ~Shared();
+            };
+            static bool Allocate(size_t size,bool HugePages,Block &block);
+            static void Free(const Block &block);
+            static void Release(const std::shared_ptr<Shared> &shared,const Block &block);
+
+            std::shared_ptr<Shared> shared;
+    };
+    extern FramePool *FRAMES;
+}
+
+#endif
@@ -0,0 +1,98 @@
+/*
+ * FrameRing.h
+ *
+ * Copyright (C) 2020-2021 Max Qian
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*************************************************
+
+Copyright: 2020-2021 Max Qian. All rights reserved
+
+Author:Max Qian
+
+E-mail:astro_air@126.com
+
+Date:2021-7-12
+
+Description:Latest frame ring for live view
+
+**************************************************/
+
+#ifndef _FRAME_RING_H_
+#define _FRAME_RING_H_
+
+#include <atomic>
+#include <stdint.h>
+
+#include "FramePool.h"
+
+namespace AstroAir
+{
+    /*
+        视频图像环形缓冲区，一个生产者、一个消费者，不使用锁
+        三个位置轮流使用：生产者写入自己的位置后与中间位置交换，消费者取走中间位置的图像
+        消费者来不及处理时中间位置的旧图像被新图像替换，缓冲区立即回到缓冲池
+    */
+    class FrameRing
+    {
+        public:
+            /*放入最新的图像，上一张图像还没有被取走时丢弃它并返回true*/
+            bool Publish(FramePtr frame)
+            {
+                slots[back] = std::move(frame);
+                int prev = state.exchange(back | Fresh,std::memory_order_acq_rel);
+                back = prev & Index;
+                bool dropped = prev & Fresh;
+                if(dropped)
+                    Dropped.fetch_add(1,std::memory_order_relaxed);
+                slots[back].reset();
+                return dropped;
+            }
+
+            /*取走最新的图像，没有新图像时为空*/
+            FramePtr Latest()
+            {
+                if(!(state.load(std::memory_order_acquire) & Fresh))
+                    return nullptr;
+                front = state.exchange(front,std::memory_order_acq_rel) & Index;
+                return std::move(slots[front]);
+            }
+
+            /*清空缓冲区，只能在生产者和消费者都停止后调用*/
+            void Clear()
+            {
+                for(auto &it : slots)
+                    it.reset();
+                back = 0;
+                front = 1;
+                state = 2;
+                Dropped = 0;
+            }
+
+            uint64_t DroppedFrames() const {return Dropped.load(std::memory_order_relaxed);}
+        private:
+            static const int Index = 3;     //位置编号
+            static const int Fresh = 4;     //中间位置有未取走的图像
+
+            FramePtr slots[3];
+            int back = 0;                   //生产者使用
+            int front = 1;                  //消费者使用
+            std::atomic_int state{2};       //中间位置的编号和Fresh标志
+            std::atomic<uint64_t> Dropped{0};
+    };
+}
+
+#endif
@@ -0,0 +1,445 @@
+/*
+ * ImgBase64.cpp
+ *
+ * Copyright (C) 2020-2021 Max Qian
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*************************************************
+
+Copyright: 2020-2021 Max Qian. All rights reserved
+
+Author:Max Qian
+
+E-mail:astro_air@126.com
+
+Date:2021-7-12
+
+Description:Base64 codec
+
+Using:Wojciech Mula and Daniel Lemire, "Faster Base64 Encoding and Decoding using AVX2 Instructions"
+
+**************************************************/
+
+#include "ImgTools.h"
+
+#include <stdint.h>
+#include <algorithm>
+
+#if defined(__x86_64__) || defined(__i386__)
+    #define AIR_BASE64_X86
+    #include <immintrin.h>
+#elif defined(__aarch64__)
+    #define AIR_BASE64_NEON
+    #include <arm_neon.h>
+#endif
+
+namespace AstroAir::ImageTools
+{
+    const char EncodeTable[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    /*不在字母表中的字符为-1*/
+    struct DecodeTable
+    {
+        int8_t value[256];
+        constexpr DecodeTable() : value()
+        {
+            for(int i = 0;i < 256;i++)
+                value[i] = -1;
+            for(int i = 0;i < 64;i++)
+                value[(unsigned char)EncodeTable[i]] = (int8_t)i;
+        }
+    };
+    constexpr DecodeTable Decode;
+
+//----------------------------------------标量实现----------------------------------------
+
+    /*每次编码3个字节，返回写入的字符数*/
+    static size_t EncodeScalar(const unsigned char *in,size_t n,char *out)
+    {
+        char *p = out;
+        size_t i = 0;
+        for(;i + 3 <= n;i += 3)
+        {
+            uint32_t v = (uint32_t)in[i] << 16 | (uint32_t)in[i + 1] << 8 | in[i + 2];
+            p[0] = EncodeTable[v >> 18];
+            p[1] = EncodeTable[(v >> 12) & 0x3F];
+            p[2] = EncodeTable[(v >> 6) & 0x3F];
+            p[3] = EncodeTable[v & 0x3F];
+            p += 4;
+        }
+        /*对剩余数据进行编码*/
+        if(n - i == 1)
+        {
+            p[0] = EncodeTable[in[i] >> 2];
+            p[1] = EncodeTable[(in[i] & 0x03) << 4];
+            p[2] = p[3] = '=';
+            p += 4;
+        }
+        else if(n - i == 2)
+        {
+            p[0] = EncodeTable[in[i] >> 2];
+            p[1] = EncodeTable[((in[i] & 0x03) << 4) | (in[i + 1] >> 4)];
+            p[2] = EncodeTable[(in[i + 1] & 0x0F) << 2];
+            p[3] = '=';
+            p += 4;
+        }
+        return p - out;
+    }
+
+    /*跳过换行等不在字母表中的字符，遇到'='结束，返回写入的字节数*/
+    static size_t DecodeScalar(const char *in,size_t n,unsigned char *out)
+    {
+        unsigned char *p = out;
+        uint32_t v = 0;
+        int bits = 0;
+        for(size_t i = 0;i < n && in[i] != '=';i++)
+        {
+            int8_t d = Decode.value[(unsigned char)in[i]];
+            if(d < 0)
+                continue;
+            v = (v << 6) | d;
+            bits += 6;
+            if(bits >= 8)
+            {
+                bits -= 8;
+                *p++ = (unsigned char)(v >> bits);
+            }
+        }
+        return p - out;
+    }
+
+//----------------------------------------SIMD实现----------------------------------------
+/*
+    每个函数只处理完整的块，返回已处理的输入长度，剩余部分由标量实现完成
+    解码时遇到不在字母表中的字符立即停止，由标量实现处理换行和结尾的'='
+*/
+
+#ifdef AIR_BASE64_X86
+    /*12个字节拆分为16个6位的值*/
+    __attribute__((target("ssse3"))) static inline __m128i EncodeSplit(__m128i in)
+    {
+        in = _mm_shuffle_epi8(in,_mm_set_epi8(10,11,9,10,7,8,6,7,4,5,3,4,1,2,0,1));
+        const __m128i t0 = _mm_and_si128(in,_mm_set1_epi32(0x0fc0fc00));
+        const __m128i t1 = _mm_mulhi_epu16(t0,_mm_set1_epi32(0x04000040));
+        const __m128i t2 = _mm_and_si128(in,_mm_set1_epi32(0x003f03f0));
+        const __m128i t3 = _mm_mullo_epi16(t2,_mm_set1_epi32(0x01000010));
+        return _mm_or_si128(t1,t3);
+    }
+
+    /*6位的值转换为字符，每个区间加上不同的偏移量*/
+    __attribute__((target("ssse3"))) static inline __m128i EncodeLookup(__m128i in)
+    {
+        const __m128i shift = _mm_setr_epi8('a' - 26,'0' - 52,'0' - 52,'0' - 52,'0' - 52,'0' - 52,'0' - 52,'0' - 52,'0' - 52,'0' - 52,'0' - 52,'+' - 62,'/' - 63,'A',0,0);
+        __m128i index = _mm_subs_epu8(in,_mm_set1_epi8(51));
+        const __m128i less = _mm_cmpgt_epi8(_mm_set1_epi8(26),in);
+        index = _mm_or_si128(index,_mm_and_si128(less,_mm_set1_epi8(13)));
+        return _mm_add_epi8(_mm_shuffle_epi8(shift,index),in);
+    }
+
+    __attribute__((target("ssse3"))) static size_t EncodeSSSE3(const unsigned char *in,size_t n,char *out)
+    {
+        size_t i = 0;
+        for(;i + 16 <= n;i += 12,out += 16)
+        {
+            __m128i v = _mm_loadu_si128((const __m128i *)(in + i));
+            _mm_storeu_si128((__m128i *)out,EncodeLookup(EncodeSplit(v)));
+        }
+        return i;
+    }
+
+    __attribute__((target("avx2"))) static size_t EncodeAVX2(const unsigned char *in,size_t n,char *out)
+    {
+        const __m256i shuffle = _mm256_setr_epi8(1,0,2,1,4,3,5,4,7,6,8,7,10,9,11,10,1,0,2,1,4,3,5,4,7,6,8,7,10,9,11,10);
+        const __m256i shift = _mm256_setr_epi8('a' - 26,'0' - 52,'0' - 52,'0' - 52,'0' - 52,'0' - 52,'0' - 52,'0' - 52,'0' - 52,'0' - 52,'0' - 52,'+' - 62,'/' - 63,'A',0,0,
+                                               'a' - 26,'0' - 52,'0' - 52,'0' - 52,'0' - 52,'0' - 52,'0' - 52,'0' - 52,'0' - 52,'0' - 52,'0' - 52,'+' - 62,'/' - 63,'A',0,0);
+        size_t i = 0;
+        for(;i + 28 <= n;i += 24,out += 32)
+        {
+            /*两个通道各处理12个字节*/
+            __m256i v = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i *)(in + i))),_mm_loadu_si128((const __m128i *)(in + i + 12)),1);
+            v = _mm256_shuffle_epi8(v,shuffle);
+            const __m256i t0 = _mm256_and_si256(v,_mm256_set1_epi32(0x0fc0fc00));
+            const __m256i t1 = _mm256_mulhi_epu16(t0,_mm256_set1_epi32(0x04000040));
+            const __m256i t2 = _mm256_and_si256(v,_mm256_set1_epi32(0x003f03f0));
+            const __m256i t3 = _mm256_mullo_epi16(t2,_mm256_set1_epi32(0x01000010));
+            v = _mm256_or_si256(t1,t3);
+            __m256i index = _mm256_subs_epu8(v,_mm256_set1_epi8(51));
+            const __m256i less = _mm256_cmpgt_epi8(_mm256_set1_epi8(26),v);
+            index = _mm256_or_si256(index,_mm256_and_si256(less,_mm256_set1_epi8(13)));
+            _mm256_storeu_si256((__m256i *)out,_mm256_add_epi8(_mm256_shuffle_epi8(shift,index),v));
+        }
+        return i;
+    }
+
+    /*
+        字符转换为6位的值，同时检查字符是否合法
+        高4位决定偏移量，低4位和高4位共同决定字符是否在字母表中，'/'单独处理
+    */
+    __attribute__((target("ssse3"))) static inline bool DecodeLookup(__m128i in,__m128i &out)
+    {
+        const __m128i shiftLUT = _mm_setr_epi8(0,0,19,4,-65,-65,-71,-71,0,0,0,0,0,0,0,0);
+        const __m128i maskLUT = _mm_setr_epi8((char)0xa8,(char)0xf8,(char)0xf8,(char)0xf8,(char)0xf8,(char)0xf8,(char)0xf8,(char)0xf8,(char)0xf8,(char)0xf8,(char)0xf0,0x54,0x50,0x50,0x50,0x54);
+        const __m128i bitposLUT = _mm_setr_epi8(0x01,0x02,0x04,0x08,0x10,0x20,0x40,(char)0x80,0,0,0,0,0,0,0,0);
+        const __m128i hi = _mm_and_si128(_mm_srli_epi32(in,4),_mm_set1_epi8(0x0f));
+        const __m128i lo = _mm_and_si128(in,_mm_set1_epi8(0x0f));
+        const __m128i mask = _mm_shuffle_epi8(maskLUT,lo);
+        const __m128i bit = _mm_shuffle_epi8(bitposLUT,hi);
+        if(_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_and_si128(mask,bit),_mm_setzero_si128())))
+            return false;
+        /*'/'的偏移量为16，比'+'少3*/
+        __m128i shift = _mm_shuffle_epi8(shiftLUT,hi);
+        shift = _mm_add_epi8(shift,_mm_and_si128(_mm_cmpeq_epi8(in,_mm_set1_epi8('/')),_mm_set1_epi8(-3)));
+        out = _mm_add_epi8(in,shift);
+        return true;
+    }
+
+    __attribute__((target("ssse3"))) static size_t DecodeSSSE3(const char *in,size_t n,unsigned char *out)
+    {
+        size_t i = 0;
+        for(;i + 16 <= n;i += 16,out += 12)
+        {
+            __m128i v;
+            if(!DecodeLookup(_mm_loadu_si128((const __m128i *)(in + i)),v))
+                break;
+            /*4个6位的值合并为3个字节*/
+            v = _mm_maddubs_epi16(v,_mm_set1_epi32(0x01400140));
+            v = _mm_madd_epi16(v,_mm_set1_epi32(0x00011000));
+            v = _mm_shuffle_epi8(v,_mm_setr_epi8(2,1,0,6,5,4,10,9,8,14,13,12,-1,-1,-1,-1));
+            _mm_storeu_si128((__m128i *)out,v);
+        }
+        return i;
+    }
+
+    __attribute__((target("avx2"))) static size_t DecodeAVX2(const char *in,size_t n,unsigned char *out)
+    {
+        const __m256i shiftLUT = _mm256_setr_epi8(0,0,19,4,-65,-65,-71,-71,0,0,0,0,0,0,0,0,0,0,19,4,-65,-65,-71,-71,0,0,0,0,0,0,0,0);
+        const __m256i maskLUT = _mm256_setr_epi8((char)0xa8,(char)0xf8,(char)0xf8,(char)0xf8,(char)0xf8,(char)0xf8,(char)0xf8,(char)0xf8,(char)0xf8,(char)0xf8,(char)0xf0,0x54,0x50,0x50,0x50,0x54,
+                                                 (char)0xa8,(char)0xf8,(char)0xf8,(char)0xf8,(char)0xf8,(char)0xf8,(char)0xf8,(char)0xf8,(char)0xf8,(char)0xf8,(char)0xf0,0x54,0x50,0x50,0x50,0x54);
+        const __m256i bitposLUT = _mm256_setr_epi8(0x01,0x02,0x04,0x08,0x10,0x20,0x40,(char)0x80,0,0,0,0,0,0,0,0,0x01,0x02,0x04,0x08,0x10,0x20,0x40,(char)0x80,0,0,0,0,0,0,0,0);
+        size_t i = 0;
+        for(;i + 32 <= n;i += 32,out += 24)
+        {
+            __m256i v = _mm256_loadu_si256((const __m256i *)(in + i));
+            const __m256i hi = _mm256_and_si256(_mm256_srli_epi32(v,4),_mm256_set1_epi8(0x0f));
+            const __m256i lo = _mm256_and_si256(v,_mm256_set1_epi8(0x0f));
+            const __m256i mask = _mm256_shuffle_epi8(maskLUT,lo);
+            const __m256i bit = _mm256_shuffle_epi8(bitposLUT,hi);
+            if(_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_and_si256(mask,bit),_mm256_setzero_si256())))
+                break;
+            __m256i shift = _mm256_shuffle_epi8(shiftLUT,hi);
+            shift = _mm256_add_epi8(shift,_mm256_and_si256(_mm256_cmpeq_epi8(v,_mm256_set1_epi8('/')),_mm256_set1_epi8(-3)));
+            v = _mm256_add_epi8(v,shift);
+            v = _mm256_maddubs_epi16(v,_mm256_set1_epi32(0x01400140));
+            v = _mm256_madd_epi16(v,_mm256_set1_epi32(0x00011000));
+            v = _mm256_shuffle_epi8(v,_mm256_setr_epi8(2,1,0,6,5,4,10,9,8,14,13,12,-1,-1,-1,-1,2,1,0,6,5,4,10,9,8,14,13,12,-1,-1,-1,-1));
+            /*两个通道的12个字节合并到一起*/
+            v = _mm256_permutevar8x32_epi32(v,_mm256_setr_epi32(0,1,2,4,5,6,3,7));
+            _mm256_storeu_si256((__m256i *)out,v);
+        }
+        return i;
+    }
+#endif
+
+#ifdef AIR_BASE64_NEON
+    static size_t EncodeNEON(const unsigned char *in,size_t n,char *out)
+    {
+        const uint8x16x4_t table = vld1q_u8_x4((const uint8_t *)EncodeTable);
+        size_t i = 0;
+        for(;i + 48 <= n;i += 48,out += 64)
+        {
+            /*按3个字节一组拆开，再交错写回4个字符一组*/
+            uint8x16x3_t v = vld3q_u8(in + i);
+            uint8x16x4_t r;
+            r.val[0] = vshrq_n_u8(v.val[0],2);
+            r.val[1] = vandq_u8(vorrq_u8(vshlq_n_u8(v.val[0],4),vshrq_n_u8(v.val[1],4)),vdupq_n_u8(0x3F));
+            r.val[2] = vandq_u8(vorrq_u8(vshlq_n_u8(v.val[1],2),vshrq_n_u8(v.val[2],6)),vdupq_n_u8(0x3F));
+            r.val[3] = vandq_u8(v.val[2],vdupq_n_u8(0x3F));
+            for(int k = 0;k < 4;k++)
+                r.val[k] = vqtbl4q_u8(table,r.val[k]);
+            vst4q_u8((uint8_t *)out,r);
+        }
+        return i;
+    }
+
+    /*字符转换为6位的值，不在字母表中的字符为0xFF*/
+    static inline uint8x16_t DecodeLookupNEON(uint8x16_t c)
+    {
+        uint8x16_t upper = vandq_u8(vcgeq_u8(c,vdupq_n_u8('A')),vcleq_u8(c,vdupq_n_u8('Z')));
+        uint8x16_t lower = vandq_u8(vcgeq_u8(c,vdupq_n_u8('a')),vcleq_u8(c,vdupq_n_u8('z')));
+        uint8x16_t digit = vandq_u8(vcgeq_u8(c,vdupq_n_u8('0')),vcleq_u8(c,vdupq_n_u8('9')));
+        uint8x16_t r = vdupq_n_u8(0xFF);
+        r = vbslq_u8(upper,vsubq_u8(c,vdupq_n_u8('A')),r);
+        r = vbslq_u8(lower,vsubq_u8(c,vdupq_n_u8('a' - 26)),r);
+        r = vbslq_u8(digit,vaddq_u8(c,vdupq_n_u8(52 - '0')),r);
+        r = vbslq_u8(vceqq_u8(c,vdupq_n_u8('+')),vdupq_n_u8(62),r);
+        r = vbslq_u8(vceqq_u8(c,vdupq_n_u8('/')),vdupq_n_u8(63),r);
+        return r;
+    }
+
+    static size_t DecodeNEON(const char *in,size_t n,unsigned char *out)
+    {
+        size_t i = 0;
+        for(;i + 64 <= n;i += 64,out += 48)
+        {
+            uint8x16x4_t v = vld4q_u8((const uint8_t *)in + i);
+            uint8x16_t bad = vdupq_n_u8(0);
+            for(int k = 0;k < 4;k++)
+            {
+                v.val[k] = DecodeLookupNEON(v.val[k]);
+                bad = vorrq_u8(bad,v.val[k]);
+            }
+            /*合法的值都小于64*/
+            if(vmaxvq_u8(bad) & 0xC0)
+                break;
+            uint8x16x3_t r;
+            r.val[0] = vorrq_u8(vshlq_n_u8(v.val[0],2),vshrq_n_u8(v.val[1],4));
+            r.val[1] = vorrq_u8(vshlq_n_u8(v.val[1],4),vshrq_n_u8(v.val[2],2));
+            r.val[2] = vorrq_u8(vshlq_n_u8(v.val[2],6),v.val[3]);
+            vst3q_u8(out,r);
+        }
+        return i;
+    }
+#endif
+
+//----------------------------------------分发----------------------------------------
+
+    typedef size_t (*EncodeBlocks)(const unsigned char *in,size_t n,char *out);
+    typedef size_t (*DecodeBlocks)(const char *in,size_t n,unsigned char *out);
+
+    static size_t EncodeNone(const unsigned char *,size_t,char *)
+    {
+        return 0;
+    }
+
+    static size_t DecodeNone(const char *,size_t,unsigned char *)
+    {
+        return 0;
+    }
+
+    /*根据CPU支持的指令集选择实现，只在第一次调用时检查*/
+    static EncodeBlocks SelectEncoder()
+    {
+        #ifdef AIR_BASE64_X86
+            if(__builtin_cpu_supports("avx2"))
+                return EncodeAVX2;
+            if(__builtin_cpu_supports("ssse3"))
+                return EncodeSSSE3;
+        #endif
+        #ifdef AIR_BASE64_NEON
+            return EncodeNEON;
+        #endif
+        return EncodeNone;
+    }
+
+    static DecodeBlocks SelectDecoder()
+    {
+        #ifdef AIR_BASE64_X86
+            if(__builtin_cpu_supports("avx2"))
+                return DecodeAVX2;
+            if(__builtin_cpu_supports("ssse3"))
+                return DecodeSSSE3;
+        #endif
+        #ifdef AIR_BASE64_NEON
+            return DecodeNEON;
+        #endif
+        return DecodeNone;
+    }
+
+    /*
+     * name: base64EncodedSize(size_t DataByte,bool LineBreak)
+     * @param DataByte:数据长度
+     * @param LineBreak:是否每76个字符换行
+     * describe: Size of the encoded text
+     * 描述：编码后的长度，用于预先分配缓冲区
+     */
+    size_t base64EncodedSize(size_t DataByte,bool LineBreak)
+    {
+        size_t size = (DataByte + 2) / 3 * 4;
+        if(LineBreak && size)
+            size += (size - 1) / 76 * 2;
+        return size;
+    }
+
+    /*
+     * name: base64Encode(const unsigned char *Data,size_t DataByte,char *Out,bool LineBreak)
+     * @param Data:需要编码的数据
+     * @param DataByte:数据长度
+     * @param Out:输出缓冲区，长度不能小于base64EncodedSize()
+     * @param LineBreak:是否每76个字符插入"\r\n"，data URI不需要换行
+     * describe: Base64 encoding into a preallocated buffer
+     * 描述：Base64编码，结果写入预先分配的缓冲区
+     * @return 写入的字符数
+     */
+    size_t base64Encode(const unsigned char *Data,size_t DataByte,char *Out,bool LineBreak)
+    {
+        static const EncodeBlocks Blocks = SelectEncoder();
+        if(!LineBreak)
+        {
+            size_t done = Blocks(Data,DataByte,Out);
+            return done / 3 * 4 + EncodeScalar(Data + done,DataByte - done,Out + done / 3 * 4);
+        }
+        /*每行57个字节，编码后正好76个字符*/
+        char *p = Out;
+        for(size_t i = 0;i < DataByte;i += 57)
+        {
+            if(i)
+            {
+                *p++ = '\r';
+                *p++ = '\n';
+            }
+            size_t n = std::min<size_t>(57,DataByte - i);
+            size_t done = Blocks(Data + i,n,p);
+            p += done / 3 * 4;
+            p += EncodeScalar(Data + i + done,n - done,p);
+        }
+        return p - Out;
+    }
+
+    /*
+     * name: base64Encode(const unsigned char* Data,size_t DataByte,bool LineBreak)
+     * @param Data:需要编码的数据
+     * @param DataByte:数据长度
+     * @param LineBreak:是否每76个字符换行
+     * describe: Base64 encoding
+     * 描述：Base64编码，只分配一次内存
+     * @return 已编码的数据
+     */
+    std::string base64Encode(const unsigned char *Data,size_t DataByte,bool LineBreak)
+    {
+        std::string strEncode(base64EncodedSize(DataByte,LineBreak),'\0');
+        strEncode.resize(base64Encode(Data,DataByte,strEncode.data(),LineBreak));
+        return strEncode;
+    }
+
+    /*
+     * name: base64Decode(const char* Data,size_t DataByte)
+     * @param Data:已编码的数据
+     * @param DataByte:数据长度
+     * describe: Base64 decoding
+     * 描述：Base64解码，跳过换行，遇到'='结束
+     * @return strDecode:已解码的数据
+     */
+    std::string base64Decode(const char *Data,size_t DataByte)
+    {
+        static const DecodeBlocks Blocks = SelectDecoder();
+        /*SIMD每次写入的长度比实际解码的长度多，预留额外的空间*/
+        std::string strDecode(DataByte / 4 * 3 + 32,'\0');
+        unsigned char *out = (unsigned char *)strDecode.data();
+        size_t done = Blocks(Data,DataByte,out);
+        size_t size = done / 4 * 3 + DecodeScalar(Data + done,DataByte - done,out + done / 4 * 3);
+        strDecode.resize(size);
+        return strDecode;
+    }
+}
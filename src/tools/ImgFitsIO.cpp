@@ -38,11 +38,10 @@ Description:FitsIO Port
 
 namespace AstroAir::FitsIO
 {
-    int status; //cFitsio状态
-
-    bool SaveFitsImage(unsigned char *imgBuf,const char * ImageName,int Image_Type,bool isColor,int ImageHeight,int ImageWidth,const char* CameraName,int Expo,int Bin,int Offset,int Gain,double Temp)
+    bool SaveFitsImage(unsigned char *imgBuf,const char * ImageName,int Image_Type,bool isColor,int ImageHeight,int ImageWidth,const char* CameraName,int Expo,int Bin,int Offset,int Gain,double Temp,int StartX,int StartY)
     {
         fitsfile * fptr = nullptr;
+        int status = 0; //cFitsio状态，每次保存独立，多个相机可以同时保存
         long naxes[2] = {ImageWidth, ImageHeight};
         long nelements = naxes[0] * naxes[1];
         long naxis = 2;
@@ -57,7 +56,7 @@ namespace AstroAir::FitsIO
         fits_create_memfile(&fptr, &memptr, &memsize, 2880, realloc, &status);
         if(status)
         {
-            FitsImageError(fptr);
+            FitsImageError(fptr,status);
             free(memptr);
             return false;
         }
@@ -69,12 +68,18 @@ namespace AstroAir::FitsIO
             fits_create_img(fptr, BYTE_IMG, naxis, naxes, &status); //8位或12位
         if(status)
         {
-            FitsImageError(fptr);
+            FitsImageError(fptr,status);
             free(memptr);
             return false;
         }
         //写入文件信息
-        AddImageKeywords(fptr,ImageName,ImageHeight,ImageWidth,CameraName,Expo,Bin,Offset,Gain,Temp);
+        status = AddImageKeywords(fptr,ImageName,ImageHeight,ImageWidth,CameraName,Expo,Bin,Offset,Gain,Temp,StartX,StartY);
+        if(status)
+        {
+            FitsImageError(fptr,status);
+            free(memptr);
+            return false;
+        }
         //将缓存图像写入文件
         if (Image_Type == 1)
             fits_write_img(fptr, TUSHORT, 1, nelements, &imgBuf[0], &status); //16位
@@ -82,7 +87,7 @@ namespace AstroAir::FitsIO
             fits_write_img(fptr, TBYTE, 1, nelements, &imgBuf[0], &status); //8位或12位
         if(status)
         {
-            FitsImageError(fptr);
+            FitsImageError(fptr,status);
             free(memptr);
             return false;
         }
@@ -90,15 +95,16 @@ namespace AstroAir::FitsIO
         fits_close_file(fptr, &status);
         if(status)
         {
-            FitsImageError(fptr);
+            FitsImageError(fptr,status);
             free(memptr);
             return false;
         }
         return true;
     }
 
-    void AddImageKeywords(fitsfile * fptr,const char* ImageName,int ImageHeight,int ImageWidth,const char* CameraName,int Expo,int Bin,int Offset,int Gain,double Temp)
+    int AddImageKeywords(fitsfile * fptr,const char* ImageName,int ImageHeight,int ImageWidth,const char* CameraName,int Expo,int Bin,int Offset,int Gain,double Temp,int StartX,int StartY)
     {
+        int status = 0;
         fits_update_key_str(fptr, "Name:",ImageName , "Name of Image", &status);
         fits_update_key_lng(fptr, "Width:",ImageWidth, "Width of Image" , &status);
         fits_update_key_lng(fptr, "Height:",ImageHeight, "Height of Image",&status);
@@ -108,10 +114,14 @@ namespace AstroAir::FitsIO
         fits_update_key_lng(fptr, "Offset:",Offset, "Brightness", &status);
         fits_update_key_lng(fptr, "Gain:",Gain, "Gain", &status);
         fits_update_key_lng(fptr, "Temperature:",Temp, "Camera's Temperature", &status);
+        /*子画幅的起点，与其他软件使用相同的关键字*/
+        fits_update_key_lng(fptr, "XORGSUBF",StartX, "Subframe origin on X axis", &status);
+        fits_update_key_lng(fptr, "YORGSUBF",StartY, "Subframe origin on Y axis", &status);
         fits_write_comment(fptr, "Generated by AstroAir", &status);
+        return status;
     }
 
-    void FitsImageError(fitsfile * fptr)
+    void FitsImageError(fitsfile * fptr,int status)
     {
         char error_status[2048];
         fits_report_error(stderr, status);
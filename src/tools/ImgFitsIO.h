@@ -38,9 +38,9 @@ Description:FitsIO Port
 
 namespace AstroAir::FitsIO
 {
-    bool SaveFitsImage(unsigned char *imgBuf,const char * ImageName,int Image_Type,bool isColor,int ImageHeight,int ImageWidth,const char* CameraName,int Expo,int Bin,int Offset,int Gain,double Temp);
-    void AddImageKeywords(fitsfile * fptr,const char* ImageName,int ImageHeight,int ImageWidth,const char* CameraName,int Expo,int Bin,int Offset,int Gain,double Temp);
-    void FitsImageError(fitsfile * fptr);
+    bool SaveFitsImage(unsigned char *imgBuf,const char * ImageName,int Image_Type,bool isColor,int ImageHeight,int ImageWidth,const char* CameraName,int Expo,int Bin,int Offset,int Gain,double Temp,int StartX = 0,int StartY = 0);
+    int AddImageKeywords(fitsfile * fptr,const char* ImageName,int ImageHeight,int ImageWidth,const char* CameraName,int Expo,int Bin,int Offset,int Gain,double Temp,int StartX = 0,int StartY = 0);
+    void FitsImageError(fitsfile * fptr,int status);
 }
 
 #endif
\ No newline at end of file
@@ -0,0 +1,178 @@
+/*
+ * ImgPreview.cpp
+ *
+ * Copyright (C) 2020-2021 Max Qian
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*************************************************
+
+Copyright: 2020-2021 Max Qian. All rights reserved
+
+Author:Max Qian
+
+E-mail:astro_air@126.com
+
+Date:2021-7-12
+
+Description:Image preview tiers
+
+Using:OpenCV<https://github.com/opencv/opencv>
+
+**************************************************/
+
+#include "ImgPreview.h"
+
+#include <algorithm>
+
+#include <opencv2/imgcodecs.hpp>
+#include <opencv2/imgproc.hpp>
+
+namespace AstroAir
+{
+    PreviewCache NEW_PREVIEW;
+    PreviewCache *PREVIEW = &NEW_PREVIEW;
+
+    const char *PreviewTierName(int tier)
+    {
+        static const char *Names[TierNum] = {"Thumbnail","Screen","Full"};
+        return tier >= 0 && tier < TierNum ? Names[tier] : "None";
+    }
+
+    /*
+     * name: PreviewCache(size_t max_images)
+     * @param max_images:最多保留的图像数量
+     * describe: Default tiers are 256 px, 1920 px and the full frame
+     * 描述：默认缩略图256像素，屏幕尺寸1920像素，原图质量90
+     */
+    PreviewCache::PreviewCache(size_t max_images) : MaxImages(max_images)
+    {
+        settings[TierThumbnail] = {256,80};
+        settings[TierScreen] = {1920,85};
+        settings[TierFull] = {0,90};
+    }
+
+    void PreviewCache::SetTier(int tier,int max_side,int quality)
+    {
+        if(tier < 0 || tier >= TierNum)
+            return;
+        std::lock_guard<std::mutex> guard(mtx);
+        if(max_side >= 0)
+            settings[tier].MaxSide = max_side;
+        if(quality > 0 && quality <= 100)
+            settings[tier].Quality = quality;
+    }
+
+    void PreviewCache::SetMaxImages(size_t max_images)
+    {
+        std::lock_guard<std::mutex> guard(mtx);
+        MaxImages = std::max<size_t>(max_images,1);
+        while(images.size() > MaxImages)
+            images.pop_front();
+    }
+
+    /*
+     * name: Store(const unsigned char *imgBuf,bool isColor,int ImageHeight,int ImageWidth)
+     * @param imgBuf:8位图像缓冲区
+     * @param isColor:图像是否为彩色
+     * @param ImageHeight:图像高度
+     * @param ImageWidth:图像宽度
+     * describe: Keep a copy of the frame, nothing is encoded yet
+     * 描述：保存图像，此时不编码任何JPG，最早的图像超过数量后被丢弃
+     * @return 图像编号
+     */
+    unsigned int PreviewCache::Store(const unsigned char *imgBuf,bool isColor,int ImageHeight,int ImageWidth)
+    {
+        auto entry = std::make_shared<Entry>();
+        size_t size = (size_t)ImageHeight * ImageWidth * (isColor ? 3 : 1);
+        entry->pixels.assign(imgBuf,imgBuf + size);
+        entry->width = ImageWidth;
+        entry->height = ImageHeight;
+        entry->color = isColor;
+        std::lock_guard<std::mutex> guard(mtx);
+        entry->id = ++LastImage;
+        images.push_back(entry);
+        while(images.size() > MaxImages)
+            images.pop_front();
+        return entry->id;
+    }
+
+    /*
+     * name: Get(unsigned int ImageID,int tier)
+     * @param ImageID:图像编号
+     * @param tier:预览等级
+     * describe: Get a tier of an image, encode it on first use
+     * 描述：获取图像的预览图，第一次获取时编码，之后直接返回缓存
+     */
+    PreviewCache::Preview PreviewCache::Get(unsigned int ImageID,int tier)
+    {
+        if(tier < 0 || tier >= TierNum)
+            return Preview();
+        std::shared_ptr<Entry> entry;
+        {
+            std::lock_guard<std::mutex> guard(mtx);
+            for(auto &it : images)
+            {
+                if(it->id == ImageID)
+                    entry = it;
+            }
+        }
+        if(!entry)
+            return Preview();
+        /*编码期间只锁住这一张图像*/
+        std::lock_guard<std::mutex> guard(entry->mtx);
+        if(!entry->tiers[tier].jpg && !Encode(*entry,tier))
+            return Preview();
+        return entry->tiers[tier];
+    }
+
+    unsigned int PreviewCache::LastID()
+    {
+        std::lock_guard<std::mutex> guard(mtx);
+        return LastImage;
+    }
+
+    /*
+     * name: Encode(Entry &entry,int tier)
+     * @param entry:图像
+     * @param tier:预览等级
+     * describe: Scale and encode one tier
+     * 描述：缩小并编码一级预览图
+     * note: The caller must hold entry.mtx
+     */
+    bool PreviewCache::Encode(Entry &entry,int tier)
+    {
+        TierSetting setting;
+        {
+            std::lock_guard<std::mutex> guard(mtx);
+            setting = settings[tier];
+        }
+        cv::Mat img(entry.height,entry.width,entry.color ? CV_8UC3 : CV_8UC1,entry.pixels.data());
+        int side = std::max(entry.width,entry.height);
+        if(setting.MaxSide > 0 && side > setting.MaxSide)
+        {
+            double scale = (double)setting.MaxSide / side;
+            cv::resize(img,img,cv::Size(),scale,scale,cv::INTER_AREA);
+        }
+        std::vector<int> compression_params = {cv::IMWRITE_JPEG_QUALITY,setting.Quality};
+        auto jpg = std::make_shared<std::vector<unsigned char>>();
+        if(!cv::imencode(".jpg",img,*jpg,compression_params))
+            return false;
+        entry.tiers[tier].jpg = jpg;
+        entry.tiers[tier].width = img.cols;
+        entry.tiers[tier].height = img.rows;
+        return true;
+    }
+}
@@ -0,0 +1,99 @@
+/*
+ * ImgPreview.h
+ *
+ * Copyright (C) 2020-2021 Max Qian
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*************************************************
+
+Copyright: 2020-2021 Max Qian. All rights reserved
+
+Author:Max Qian
+
+E-mail:astro_air@126.com
+
+Date:2021-7-12
+
+Description:Image preview tiers
+
+**************************************************/
+
+#ifndef _IMG_PREVIEW_H_
+#define _IMG_PREVIEW_H_
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <mutex>
+
+namespace AstroAir
+{
+    /*预览等级，缩略图、屏幕尺寸和原图*/
+    enum PreviewTier {TierThumbnail = 0,TierScreen,TierFull,TierNum};
+    const char *PreviewTierName(int tier);
+    typedef std::shared_ptr<const std::vector<unsigned char>> JpgPtr;
+
+    /*
+        预览图缓存
+        曝光结束后只保存8位图像，各级JPG在第一次被需要时才编码，同一图像的同一等级只编码一次
+        只保留最近的几张图像，客户端可以在之后请求其他等级
+    */
+    class PreviewCache
+    {
+        public:
+            struct Preview
+            {
+                JpgPtr jpg;
+                int width = 0;
+                int height = 0;
+            };
+            explicit PreviewCache(size_t max_images = 2);
+            /*设置预览等级的长边像素数(0表示原始尺寸)和JPG质量*/
+            void SetTier(int tier,int max_side,int quality);
+            void SetMaxImages(size_t max_images);
+            /*保存新的图像，返回图像编号*/
+            unsigned int Store(const unsigned char *imgBuf,bool isColor,int ImageHeight,int ImageWidth);
+            /*获取预览图，需要时才编码，图像已经不在缓存中时jpg为空*/
+            Preview Get(unsigned int ImageID,int tier);
+            unsigned int LastID();
+        private:
+            struct Entry
+            {
+                unsigned int id;
+                std::vector<unsigned char> pixels;      //8位图像，彩色为BGR
+                int width,height;
+                bool color;
+                Preview tiers[TierNum];
+                std::mutex mtx;                         //同一图像的预览图不会被同时编码两次
+            };
+            struct TierSetting
+            {
+                int MaxSide;
+                int Quality;
+            };
+            bool Encode(Entry &entry,int tier);
+
+            std::deque<std::shared_ptr<Entry>> images;
+            TierSetting settings[TierNum];
+            size_t MaxImages;
+            unsigned int LastImage = 0;
+            std::mutex mtx;
+    };
+    extern PreviewCache *PREVIEW;
+}
+
+#endif
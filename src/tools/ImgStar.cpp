@@ -0,0 +1,336 @@
+/*
+ * ImgStar.cpp
+ *
+ * Copyright (C) 2020-2021 Max Qian
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*************************************************
+
+Copyright: 2020-2021 Max Qian. All rights reserved
+
+Author:Max Qian
+
+E-mail:astro_air@126.com
+
+Date:2021-7-12
+
+Description:Star detection and measurement
+
+Using:OpenCV<https://github.com/opencv/opencv>
+
+**************************************************/
+
+#include "ImgStar.h"
+#include "ImgStats.h"
+
+#include <algorithm>
+#include <math.h>
+
+#include <opencv2/core.hpp>
+#include <opencv2/imgproc.hpp>
+
+namespace AstroAir::ImageTools
+{
+    /*分块的背景和噪声*/
+    struct TileStats
+    {
+        double Background = 0;
+        double Noise = 1;
+    };
+
+    /*
+     * name: EstimateBackground(const cv::Mat &img,const cv::Rect &tile)
+     * @param img:单通道图像
+     * @param tile:分块
+     * describe: Background and noise of a tile from the median and MAD
+     * 描述：由中位数和MAD估计分块的背景和噪声，星点只占很少的像素，不影响结果
+     */
+    template<typename T>
+    static TileStats EstimateBackground(const cv::Mat &img,const cv::Rect &tile)
+    {
+        const int step = tile.area() > 16384 ? 2 : 1;
+        std::vector<float> samples;
+        samples.reserve((size_t)tile.area() / (step * step) + tile.width + tile.height);
+        for(int y = tile.y;y < tile.y + tile.height;y += step)
+        {
+            const T *row = img.ptr<T>(y);
+            for(int x = tile.x;x < tile.x + tile.width;x += step)
+                samples.push_back(row[x]);
+        }
+        TileStats stats;
+        if(samples.empty())
+            return stats;
+        auto mid = samples.begin() + samples.size() / 2;
+        std::nth_element(samples.begin(),mid,samples.end());
+        stats.Background = *mid;
+        for(auto &it : samples)
+            it = std::fabs(it - (float)stats.Background);
+        std::nth_element(samples.begin(),mid,samples.end());
+        /*整数像素值的噪声不会小于一个量化单位*/
+        stats.Noise = std::max(1.4826 * *mid,1.0);
+        return stats;
+    }
+
+    /*
+     * name: MeasureStar(const cv::Mat &img,int px,int py,const TileStats &stats,const StarDetectSetting &setting,double saturation,Star &star)
+     * @param img:单通道图像
+     * @param px,py:局部最大值的位置
+     * @param stats:所在分块的背景和噪声
+     * @param setting:检测参数
+     * @param saturation:饱和阈值
+     * @param star:测量结果
+     * describe: Centroid, HFD, FWHM and SNR of one star
+     * 描述：测量单颗星，窗口大小由星点的范围决定，先求质心再以质心为中心测量
+     * note: HFD is twice the flux weighted mean radius, FWHM comes from the area above half maximum
+     */
+    template<typename T>
+    static bool MeasureStar(const cv::Mat &img,int px,int py,const TileStats &stats,const StarDetectSetting &setting,double saturation,Star &star)
+    {
+        const double bg = stats.Background;
+        const double threshold = bg + setting.Sigma * stats.Noise;
+        const double peak = img.at<T>(py,px);
+        /*沿四个方向找到星点降到背景噪声以内的位置*/
+        const double edge = bg + stats.Noise;
+        const int dx[4] = {1,-1,0,0},dy[4] = {0,0,1,-1};
+        int extent = 1;
+        for(int d = 0;d < 4;d++)
+        {
+            int r = 1;
+            for(;r <= setting.MaxRadius;r++)
+            {
+                int x = px + dx[d] * r,y = py + dy[d] * r;
+                if(x < 0 || y < 0 || x >= img.cols || y >= img.rows || img.at<T>(y,x) < edge)
+                    break;
+            }
+            extent = std::max(extent,r);
+        }
+        const int radius = std::clamp(extent * 3 / 2 + 2,3,std::max(setting.MaxRadius,3));
+        const int r2 = radius * radius;
+        auto inside = [&](int x,int y)
+        {
+            return x >= radius && y >= radius && x + radius < img.cols && y + radius < img.rows;
+        };
+        if(!inside(px,py))
+            return false;
+        /*以峰值为中心计算质心*/
+        double sum = 0,sx = 0,sy = 0;
+        int area = 0;
+        for(int y = -radius;y <= radius;y++)
+        {
+            const T *row = img.ptr<T>(py + y);
+            for(int x = -radius;x <= radius;x++)
+            {
+                if(x * x + y * y > r2)
+                    continue;
+                double v = row[px + x] - bg;
+                if(v <= 0)
+                    continue;
+                sum += v;
+                sx += v * x;
+                sy += v * y;
+                if(row[px + x] > threshold)
+                    area++;
+            }
+        }
+        if(area < setting.MinArea || sum <= 0)
+            return false;
+        const double cx = px + sx / sum,cy = py + sy / sum;
+        const int ix = (int)lround(cx),iy = (int)lround(cy);
+        if(!inside(ix,iy))
+            return false;
+        /*以质心为中心测量*/
+        const double half = (peak - bg) / 2;
+        double flux = 0,dist = 0;
+        int npix = 0,halfArea = 0;
+        for(int y = -radius;y <= radius;y++)
+        {
+            const T *row = img.ptr<T>(iy + y);
+            for(int x = -radius;x <= radius;x++)
+            {
+                if(x * x + y * y > r2)
+                    continue;
+                npix++;
+                double v = row[ix + x] - bg;
+                if(v <= 0)
+                    continue;
+                flux += v;
+                dist += v * std::hypot(ix + x - cx,iy + y - cy);
+                if(v >= half)
+                    halfArea++;
+            }
+        }
+        if(flux <= 0)
+            return false;
+        star.X = cx;
+        star.Y = cy;
+        star.Peak = peak - bg;
+        star.Flux = flux;
+        star.HFD = 2 * dist / flux;
+        star.FWHM = 2 * sqrt(halfArea / M_PI);
+        star.SNR = flux / sqrt(flux + npix * stats.Noise * stats.Noise);
+        star.Saturated = peak >= saturation;
+        return true;
+    }
+
+    /*
+     * name: DetectTile(const cv::Mat &img,const cv::Rect &tile,const StarDetectSetting &setting,double saturation,std::vector<Star> &stars,TileStats &stats)
+     * @param img:单通道图像
+     * @param tile:分块
+     * @param setting:检测参数
+     * @param saturation:饱和阈值
+     * @param stars:检测到的星点
+     * @param stats:分块的背景和噪声
+     * describe: Find local maxima above the threshold and measure them
+     * 描述：在分块中寻找高于阈值的局部最大值并测量，测量窗口可以超出分块
+     * note: Ties are broken in raster order so a flat top yields few candidates
+     */
+    template<typename T>
+    static void DetectTile(const cv::Mat &img,const cv::Rect &tile,const StarDetectSetting &setting,double saturation,std::vector<Star> &stars,TileStats &stats)
+    {
+        stats = EstimateBackground<T>(img,tile);
+        const double threshold = stats.Background + setting.Sigma * stats.Noise;
+        const int y0 = std::max(tile.y,1),y1 = std::min(tile.y + tile.height,img.rows - 1);
+        const int x0 = std::max(tile.x,1),x1 = std::min(tile.x + tile.width,img.cols - 1);
+        for(int y = y0;y < y1;y++)
+        {
+            const T *prev = img.ptr<T>(y - 1),*cur = img.ptr<T>(y),*next = img.ptr<T>(y + 1);
+            for(int x = x0;x < x1;x++)
+            {
+                const T v = cur[x];
+                if(v <= threshold)
+                    continue;
+                if(v <= prev[x - 1] || v <= prev[x] || v <= prev[x + 1] || v <= cur[x - 1] ||
+                   v < cur[x + 1] || v < next[x - 1] || v < next[x] || v < next[x + 1])
+                    continue;
+                Star star;
+                if(MeasureStar<T>(img,x,y,stats,setting,saturation,star))
+                    stars.push_back(star);
+            }
+        }
+    }
+
+    static double Median(std::vector<double> values)
+    {
+        if(values.empty())
+            return 0;
+        auto mid = values.begin() + values.size() / 2;
+        std::nth_element(values.begin(),mid,values.end());
+        return *mid;
+    }
+
+    /*
+     * name: DetectStars(const cv::Mat &img,const StarDetectSetting &setting)
+     * @param img:8位或16位图像，彩色图像先转为灰度
+     * @param setting:检测参数
+     * describe: Detect and measure stars over the whole frame
+     * 描述：分块并行检测整幅图像的星点，合并同一颗星的重复检测后统计HFD和FWHM的中位数
+     * calls: DetectTile()
+     */
+    StarResult DetectStars(const cv::Mat &img,const StarDetectSetting &setting)
+    {
+        StarResult result;
+        if(img.empty() || (img.depth() != CV_8U && img.depth() != CV_16U))
+            return result;
+        cv::Mat gray = img;
+        if(img.channels() == 3)
+            cv::cvtColor(img,gray,cv::COLOR_BGR2GRAY);
+        else if(img.channels() != 1)
+            return result;
+        const bool wide = gray.depth() == CV_16U;
+        const double saturation = (wide ? 65535 : 255) * SaturationLevel;
+        /*分块后每块独立处理，结果按分块保存，不需要加锁*/
+        const int size = std::max(setting.TileSize,32);
+        std::vector<cv::Rect> tiles;
+        for(int y = 0;y < gray.rows;y += size)
+            for(int x = 0;x < gray.cols;x += size)
+                tiles.emplace_back(x,y,std::min(size,gray.cols - x),std::min(size,gray.rows - y));
+        std::vector<std::vector<Star>> found(tiles.size());
+        std::vector<TileStats> stats(tiles.size());
+        cv::parallel_for_(cv::Range(0,(int)tiles.size()),[&](const cv::Range &range)
+        {
+            for(int i = range.start;i < range.end;i++)
+            {
+                if(wide)
+                    DetectTile<uint16_t>(gray,tiles[i],setting,saturation,found[i],stats[i]);
+                else
+                    DetectTile<uint8_t>(gray,tiles[i],setting,saturation,found[i],stats[i]);
+            }
+        });
+        std::vector<Star> stars;
+        for(auto &it : found)
+            stars.insert(stars.end(),it.begin(),it.end());
+        std::sort(stars.begin(),stars.end(),[](const Star &a,const Star &b){return a.Flux > b.Flux;});
+        /*
+            平顶和散焦星点会产生多个局部最大值，从最亮的星开始，去掉落在已有星点HFD以内的检测
+            网格边长为MaxRadius，HFD不会超过两倍的测量半径，只需检查周围两格
+        */
+        const int cell = std::max(setting.MaxRadius,3);
+        const int gw = gray.cols / cell + 1,gh = gray.rows / cell + 1;
+        std::vector<std::vector<int>> grid((size_t)gw * gh);
+        for(auto &star : stars)
+        {
+            const int gx = (int)star.X / cell,gy = (int)star.Y / cell;
+            bool duplicate = false;
+            for(int y = std::max(gy - 2,0);y <= std::min(gy + 2,gh - 1) && !duplicate;y++)
+            {
+                for(int x = std::max(gx - 2,0);x <= std::min(gx + 2,gw - 1) && !duplicate;x++)
+                {
+                    for(int index : grid[(size_t)y * gw + x])
+                    {
+                        const Star &kept = result.Stars[index];
+                        if(std::hypot(star.X - kept.X,star.Y - kept.Y) < std::max(kept.HFD,3.0))
+                        {
+                            duplicate = true;
+                            break;
+                        }
+                    }
+                }
+            }
+            if(duplicate)
+                continue;
+            grid[(size_t)gy * gw + gx].push_back((int)result.Stars.size());
+            result.Stars.push_back(star);
+        }
+        /*饱和星的轮廓被截平，只在没有其他星时才使用*/
+        std::vector<double> hfd,fwhm;
+        for(auto &it : result.Stars)
+        {
+            if(it.Saturated)
+                continue;
+            hfd.push_back(it.HFD);
+            fwhm.push_back(it.FWHM);
+        }
+        if(hfd.empty())
+        {
+            for(auto &it : result.Stars)
+            {
+                hfd.push_back(it.HFD);
+                fwhm.push_back(it.FWHM);
+            }
+        }
+        result.MedianHFD = Median(hfd);
+        result.MedianFWHM = Median(fwhm);
+        std::vector<double> background,noise;
+        for(auto &it : stats)
+        {
+            background.push_back(it.Background);
+            noise.push_back(it.Noise);
+        }
+        result.Background = Median(background);
+        result.Noise = Median(noise);
+        return result;
+    }
+}
@@ -0,0 +1,82 @@
+/*
+ * ImgStar.h
+ *
+ * Copyright (C) 2020-2021 Max Qian
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*************************************************
+
+Copyright: 2020-2021 Max Qian. All rights reserved
+
+Author:Max Qian
+
+E-mail:astro_air@126.com
+
+Date:2021-7-12
+
+Description:Star detection and measurement
+
+**************************************************/
+
+#ifndef _IMG_STAR_H_
+#define _IMG_STAR_H_
+
+#include <vector>
+
+namespace cv
+{
+    class Mat;
+}
+
+namespace AstroAir::ImageTools
+{
+    /*单颗星的测量结果，坐标和直径均以像素为单位*/
+    struct Star
+    {
+        double X = 0;
+        double Y = 0;
+        double Peak = 0;            //减去背景后的峰值
+        double Flux = 0;            //减去背景后的总亮度
+        double HFD = 0;             //半通量直径
+        double FWHM = 0;            //半高全宽
+        double SNR = 0;
+        bool Saturated = false;     //饱和的星不参与HFD统计
+    };
+
+    /*星点检测参数*/
+    struct StarDetectSetting
+    {
+        double Sigma = 5;           //检测阈值，背景噪声的倍数
+        int MinArea = 5;            //高于阈值的最少像素数，排除热噪点
+        int MaxRadius = 32;         //测量窗口的最大半径
+        int TileSize = 256;         //分块大小，每块单独估计背景并在一个线程中处理
+    };
+
+    /*整幅图像的统计结果*/
+    struct StarResult
+    {
+        std::vector<Star> Stars;    //按亮度从高到低排列
+        double MedianHFD = 0;
+        double MedianFWHM = 0;
+        double Background = 0;
+        double Noise = 0;
+    };
+
+    /*检测并测量8位或16位图像中的星点，彩色图像先转为灰度*/
+    StarResult DetectStars(const cv::Mat &img,const StarDetectSetting &setting = StarDetectSetting());
+}
+
+#endif
@@ -0,0 +1,180 @@
+/*
+ * ImgStats.cpp
+ *
+ * Copyright (C) 2020-2021 Max Qian
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*************************************************
+
+Copyright: 2020-2021 Max Qian. All rights reserved
+
+Author:Max Qian
+
+E-mail:astro_air@126.com
+
+Date:2021-7-12
+
+Description:Histogram and image statistics
+
+Using:OpenCV<https://github.com/opencv/opencv>
+
+**************************************************/
+
+#include "ImgStats.h"
+
+#include <mutex>
+#include <algorithm>
+
+#include <opencv2/core.hpp>
+
+namespace AstroAir::ImageTools
+{
+    /*
+     * name: Accumulate(const cv::Mat &img,int y0,int y1,std::vector<uint32_t> &local)
+     * @param img:8位或16位图像
+     * @param y0,y1:处理的行
+     * @param local:本线程的直方图
+     * describe: Count one stripe of rows into a private histogram
+     * 描述：统计一部分行的直方图
+     * note: 8-bit data is counted into 4 interleaved sub-histograms. Neighbouring pixels
+     *       often share a value, and separate counters keep the increments independent.
+     */
+    template<typename T,int Sub>
+    static void Accumulate(const cv::Mat &img,int y0,int y1,std::vector<uint32_t> &local)
+    {
+        const int cn = img.channels();
+        const size_t Levels = (size_t)1 << (sizeof(T) * 8);
+        const int n = img.cols * cn;
+        local.assign(Levels * cn * Sub,0);
+        uint32_t *h = local.data();
+        for(int y = y0;y < y1;y++)
+        {
+            const T *row = img.ptr<T>(y);
+            if(cn == 1)
+            {
+                int i = 0;
+                for(;i + Sub <= n;i += Sub)
+                    for(int k = 0;k < Sub;k++)
+                        h[k * Levels + row[i + k]]++;
+                for(;i < n;i++)
+                    h[row[i]]++;
+            }
+            else
+            {
+                for(int i = 0,p = 0;i < n;i += cn,p++)
+                    for(int c = 0;c < cn;c++)
+                        h[(p % Sub * cn + c) * Levels + row[i + c]]++;
+            }
+        }
+        /*合并子直方图*/
+        for(int k = 1;k < Sub;k++)
+            for(size_t i = 0;i < Levels * cn;i++)
+                h[i] += h[k * Levels * cn + i];
+        local.resize(Levels * cn);
+    }
+
+    /*
+     * name: Summarize(ChannelStats &stats,int Levels)
+     * @param stats:已统计直方图的通道
+     * @param Levels:像素值的数量
+     * describe: Min, max, mean, median, MAD and saturation from a histogram
+     * 描述：由直方图计算最小值、最大值、平均值、中位数、MAD和饱和像素数，不需要再次遍历图像
+     */
+    static void Summarize(ChannelStats &stats,int Levels)
+    {
+        const std::vector<uint32_t> &hist = stats.Histogram;
+        stats.Count = stats.Saturated = 0;
+        stats.Min = stats.Max = 0;
+        stats.Mean = stats.Median = stats.MAD = 0;
+        double sum = 0;
+        for(int i = 0;i < Levels;i++)
+        {
+            stats.Count += hist[i];
+            sum += (double)hist[i] * i;
+        }
+        if(!stats.Count)
+            return;
+        while(!hist[stats.Min])
+            stats.Min++;
+        stats.Max = Levels - 1;
+        while(!hist[stats.Max])
+            stats.Max--;
+        stats.Mean = sum / stats.Count;
+        int median = 0;
+        for(uint64_t acc = 0;median < Levels;median++)
+        {
+            acc += hist[median];
+            if(acc * 2 >= stats.Count)
+                break;
+        }
+        stats.Median = median;
+        /*与中位数之差的分布，从中位数向两侧展开*/
+        int mad = 0;
+        for(uint64_t acc = hist[median];acc * 2 < stats.Count;)
+        {
+            mad++;
+            if(median - mad >= 0)
+                acc += hist[median - mad];
+            if(median + mad < Levels)
+                acc += hist[median + mad];
+        }
+        stats.MAD = mad;
+        for(int i = (int)((Levels - 1) * SaturationLevel);i < Levels;i++)
+            stats.Saturated += hist[i];
+    }
+
+    /*
+     * name: ComputeStats(const cv::Mat &img,ImageStats &stats)
+     * @param img:8位或16位图像，1或3通道
+     * @param stats:统计结果
+     * describe: Per channel histograms and statistics in a single pass
+     * 描述：按行分块在多个线程中统计直方图，各线程使用独立的直方图，最后合并
+     * calls: Accumulate()
+     * calls: Summarize()
+     */
+    bool ComputeStats(const cv::Mat &img,ImageStats &stats)
+    {
+        if(img.empty() || (img.depth() != CV_8U && img.depth() != CV_16U) || (img.channels() != 1 && img.channels() != 3))
+            return false;
+        const bool wide = img.depth() == CV_16U;
+        const int Levels = wide ? 65536 : 256;
+        const int cn = img.channels();
+        stats.BitDepth = wide ? 16 : 8;
+        stats.Channels.resize(cn);
+        for(auto &it : stats.Channels)
+            it.Histogram.assign(Levels,0);
+        std::mutex mtx;
+        cv::parallel_for_(cv::Range(0,img.rows),[&](const cv::Range &rows)
+        {
+            std::vector<uint32_t> local;
+            if(wide)
+                Accumulate<uint16_t,1>(img,rows.start,rows.end,local);
+            else
+                Accumulate<uint8_t,4>(img,rows.start,rows.end,local);
+            std::lock_guard<std::mutex> guard(mtx);
+            for(int c = 0;c < cn;c++)
+            {
+                uint32_t *dst = stats.Channels[c].Histogram.data();
+                const uint32_t *src = local.data() + (size_t)c * Levels;
+                for(int i = 0;i < Levels;i++)
+                    dst[i] += src[i];
+            }
+        },std::max(cv::getNumThreads(),1));
+        for(auto &it : stats.Channels)
+            Summarize(it,Levels);
+        return true;
+    }
+}
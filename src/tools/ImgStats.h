@@ -0,0 +1,73 @@
+/*
+ * ImgStats.h
+ *
+ * Copyright (C) 2020-2021 Max Qian
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*************************************************
+
+Copyright: 2020-2021 Max Qian. All rights reserved
+
+Author:Max Qian
+
+E-mail:astro_air@126.com
+
+Date:2021-7-12
+
+Description:Histogram and image statistics
+
+**************************************************/
+
+#ifndef _IMG_STATS_H_
+#define _IMG_STATS_H_
+
+#include <vector>
+#include <stdint.h>
+
+namespace cv
+{
+    class Mat;
+}
+
+namespace AstroAir::ImageTools
+{
+    /*像素值达到最大值的98%即认为饱和*/
+    const double SaturationLevel = 0.98;
+
+    /*单个通道的统计信息，均由直方图得到*/
+    struct ChannelStats
+    {
+        std::vector<uint32_t> Histogram;        //每个像素值一个区间，8位为256个，16位为65536个
+        uint64_t Count = 0;
+        int Min = 0;
+        int Max = 0;
+        double Mean = 0;
+        double Median = 0;
+        double MAD = 0;
+        uint64_t Saturated = 0;                 //饱和的像素数
+    };
+
+    struct ImageStats
+    {
+        int BitDepth = 0;                       //8或16
+        std::vector<ChannelStats> Channels;     //黑白图像为1个，彩色图像按B、G、R排列
+    };
+
+    /*遍历一次图像计算各通道的直方图和统计信息，stats中已有的内存会被重复使用*/
+    bool ComputeStats(const cv::Mat &img,ImageStats &stats);
+}
+
+#endif
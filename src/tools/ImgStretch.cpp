@@ -0,0 +1,260 @@
+/*
+ * ImgStretch.cpp
+ *
+ * Copyright (C) 2020-2021 Max Qian
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*************************************************
+
+Copyright: 2020-2021 Max Qian. All rights reserved
+
+Author:Max Qian
+
+E-mail:astro_air@126.com
+
+Date:2021-7-12
+
+Description:Screen transfer function for previews
+
+Using:OpenCV<https://github.com/opencv/opencv>
+
+**************************************************/
+
+#include "ImgStretch.h"
+
+#include <vector>
+#include <algorithm>
+#include <math.h>
+
+#include <opencv2/imgproc.hpp>
+
+namespace AstroAir::ImageTools
+{
+    /*计算中位数和MAD最多使用的采样点数量*/
+    const size_t MaxSamples = 1 << 20;
+
+    /*
+     * name: MTF(double m,double x)
+     * @param m:中间调平衡
+     * @param x:归一化的像素值
+     * describe: Midtones transfer function, MTF(m,m) = 0.5
+     * 描述：中间调传递函数，m处的像素值变为0.5
+     */
+    double MTF(double m,double x)
+    {
+        if(x <= 0)
+            return 0;
+        if(x >= 1)
+            return 1;
+        if(x == m)
+            return 0.5;
+        return (m - 1) * x / ((2 * m - 1) * x - m);
+    }
+
+    /*
+     * name: StretchFromHistogram(const std::vector<uint32_t> &hist,size_t count,double target,double clipping)
+     * @param hist:直方图，每个像素值一个区间
+     * @param count:像素数
+     * @param target:拉伸后背景的亮度
+     * @param clipping:暗部截断位置，为中位数加上MAD的倍数
+     * describe: Stretch parameters from the median and MAD of a histogram
+     * 描述：由直方图得到中位数和MAD，计算拉伸参数
+     */
+    static StretchParams StretchFromHistogram(const std::vector<uint32_t> &hist,size_t count,double target,double clipping)
+    {
+        StretchParams params;
+        const int Levels = hist.size();
+        if(!count)
+            return params;
+        /*中位数*/
+        int median = 0;
+        for(size_t sum = 0;median < Levels;median++)
+        {
+            sum += hist[median];
+            if(sum * 2 >= count)
+                break;
+        }
+        /*由同一个直方图得到与中位数之差的分布*/
+        std::vector<uint32_t> dev(Levels,0);
+        for(int i = 0;i < Levels;i++)
+            dev[std::abs(i - median)] += hist[i];
+        int mad = 0;
+        for(size_t sum = 0;mad < Levels;mad++)
+        {
+            sum += dev[mad];
+            if(sum * 2 >= count)
+                break;
+        }
+        const double m = (double)median / (Levels - 1);
+        const double madn = 1.4826 * mad / (Levels - 1);
+        /*背景较暗的普通图像，截断暗部后将背景拉伸到target*/
+        if(m < 0.5)
+        {
+            params.Shadows = std::clamp(m + clipping * madn,0.0,1.0);
+            params.Highlights = 1;
+            double x = params.Shadows < 1 ? (m - params.Shadows) / (1 - params.Shadows) : 0;
+            params.Midtones = x > 0 ? MTF(target,x) : 0.5;
+        }
+        else
+        {
+            params.Shadows = 0;
+            params.Highlights = std::clamp(m - clipping * madn,0.0,1.0);
+            double x = params.Highlights > 0 ? m / params.Highlights : 1;
+            params.Midtones = x < 1 ? 1 - MTF(target,1 - x) : 0.5;
+        }
+        return params;
+    }
+
+    /*
+     * name: ComputeAutoStretch(const cv::Mat &img,double target,double clipping)
+     * @param img:8位或16位图像，彩色图像的各通道共用一组参数
+     * @param target:拉伸后背景的亮度
+     * @param clipping:暗部截断位置，为中位数加上MAD的倍数
+     * describe: Auto screen transfer function from a sampled median and MAD
+     * 描述：对图像采样，由直方图得到中位数和MAD，计算自动拉伸参数
+     * note: Both statistics come from histograms, no sorting is needed
+     */
+    StretchParams ComputeAutoStretch(const cv::Mat &img,double target,double clipping)
+    {
+        if(img.empty() || (img.depth() != CV_8U && img.depth() != CV_16U))
+            return StretchParams();
+        const int Levels = img.depth() == CV_16U ? 65536 : 256;
+        const size_t total = img.total() * img.channels();
+        const size_t step = std::max<size_t>(1,total / MaxSamples);
+        /*隔行隔列采样，统计直方图*/
+        std::vector<uint32_t> hist(Levels,0);
+        size_t count = 0;
+        for(int y = 0;y < img.rows;y++)
+        {
+            size_t n = (size_t)img.cols * img.channels();
+            size_t start = (y * n) % step;
+            if(img.depth() == CV_16U)
+            {
+                const uint16_t *row = img.ptr<uint16_t>(y);
+                for(size_t i = start;i < n;i += step)
+                    hist[row[i]]++;
+            }
+            else
+            {
+                const uint8_t *row = img.ptr<uint8_t>(y);
+                for(size_t i = start;i < n;i += step)
+                    hist[row[i]]++;
+            }
+            count += (n > start) ? (n - start + step - 1) / step : 0;
+        }
+        return StretchFromHistogram(hist,count,target,clipping);
+    }
+
+    /*
+     * name: ComputeAutoStretch(const ImageStats &stats,double target,double clipping)
+     * @param stats:已经计算的图像统计信息
+     * @param target:拉伸后背景的亮度
+     * @param clipping:暗部截断位置，为中位数加上MAD的倍数
+     * describe: Auto screen transfer function from the full frame histograms
+     * 描述：直接使用统计模块的直方图，各通道合并后计算，不需要再次采样
+     */
+    StretchParams ComputeAutoStretch(const ImageStats &stats,double target,double clipping)
+    {
+        if(stats.Channels.empty())
+            return StretchParams();
+        std::vector<uint32_t> hist = stats.Channels[0].Histogram;
+        size_t count = stats.Channels[0].Count;
+        for(size_t c = 1;c < stats.Channels.size();c++)
+        {
+            for(size_t i = 0;i < hist.size();i++)
+                hist[i] += stats.Channels[c].Histogram[i];
+            count += stats.Channels[c].Count;
+        }
+        return StretchFromHistogram(hist,count,target,clipping);
+    }
+
+    /*
+     * name: ApplyStretch(const cv::Mat &src,cv::Mat &dst,const StretchParams &params)
+     * @param src:8位或16位图像
+     * @param dst:输出的8位图像
+     * @param params:拉伸参数
+     * describe: Convert to 8 bits through a lookup table, split over worker threads
+     * 描述：生成查找表后按行分块在多个线程中转换为8位图像
+     * note: Every input level is computed once, the per pixel work is a single lookup
+     */
+    void ApplyStretch(const cv::Mat &src,cv::Mat &dst,const StretchParams &params)
+    {
+        if(src.depth() != CV_8U && src.depth() != CV_16U)
+        {
+            src.convertTo(dst,CV_8U);
+            return;
+        }
+        const int Levels = src.depth() == CV_16U ? 65536 : 256;
+        std::vector<uint8_t> lut(Levels);
+        const double range = params.Highlights - params.Shadows;
+        for(int i = 0;i < Levels;i++)
+        {
+            double x = (double)i / (Levels - 1);
+            x = range > 0 ? (x - params.Shadows) / range : (x > params.Shadows);
+            lut[i] = (uint8_t)lround(MTF(params.Midtones,std::clamp(x,0.0,1.0)) * 255);
+        }
+        cv::Mat out(src.rows,src.cols,CV_MAKETYPE(CV_8U,src.channels()));
+        const int n = src.cols * src.channels();
+        const uint8_t *table = lut.data();
+        cv::parallel_for_(cv::Range(0,src.rows),[&](const cv::Range &rows)
+        {
+            for(int y = rows.start;y < rows.end;y++)
+            {
+                uint8_t *d = out.ptr<uint8_t>(y);
+                if(src.depth() == CV_16U)
+                {
+                    const uint16_t *s = src.ptr<uint16_t>(y);
+                    for(int i = 0;i < n;i++)
+                        d[i] = table[s[i]];
+                }
+                else
+                {
+                    const uint8_t *s = src.ptr<uint8_t>(y);
+                    for(int i = 0;i < n;i++)
+                        d[i] = table[s[i]];
+                }
+            }
+        });
+        dst = out;
+    }
+
+    /*
+     * name: Debayer(const cv::Mat &src,cv::Mat &dst,const std::string &pattern)
+     * @param src:单通道原始图像
+     * @param dst:输出的BGR图像
+     * @param pattern:拜耳阵列
+     * describe: Demosaic a raw frame
+     * 描述：原始图像去马赛克，OpenCV以第二行的第二、三个像素命名拜耳阵列
+     */
+    bool Debayer(const cv::Mat &src,cv::Mat &dst,const std::string &pattern)
+    {
+        int code;
+        if(pattern == "RGGB")
+            code = cv::COLOR_BayerBG2BGR;
+        else if(pattern == "BGGR")
+            code = cv::COLOR_BayerRG2BGR;
+        else if(pattern == "GRBG")
+            code = cv::COLOR_BayerGB2BGR;
+        else if(pattern == "GBRG")
+            code = cv::COLOR_BayerGR2BGR;
+        else
+            return false;
+        if(src.channels() != 1)
+            return false;
+        cv::cvtColor(src,dst,code);
+        return true;
+    }
+}
@@ -0,0 +1,65 @@
+/*
+ * ImgStretch.h
+ *
+ * Copyright (C) 2020-2021 Max Qian
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*************************************************
+
+Copyright: 2020-2021 Max Qian. All rights reserved
+
+Author:Max Qian
+
+E-mail:astro_air@126.com
+
+Date:2021-7-12
+
+Description:Screen transfer function for previews
+
+**************************************************/
+
+#ifndef _IMG_STRETCH_H_
+#define _IMG_STRETCH_H_
+
+#include <string>
+
+#include <opencv2/core.hpp>
+
+#include "ImgStats.h"
+
+namespace AstroAir::ImageTools
+{
+    /*屏幕拉伸参数，数值均归一化到0~1*/
+    struct StretchParams
+    {
+        double Shadows = 0;         //暗部截断
+        double Highlights = 1;      //亮部截断
+        double Midtones = 0.5;      //中间调平衡，0.5为线性
+    };
+
+    /*中间调传递函数*/
+    double MTF(double m,double x);
+    /*根据采样的中位数和MAD计算自动拉伸参数，target为拉伸后背景的亮度，clipping为暗部截断的MAD倍数*/
+    StretchParams ComputeAutoStretch(const cv::Mat &img,double target = 0.25,double clipping = -2.8);
+    /*使用已经计算的全图直方图，不再对图像采样*/
+    StretchParams ComputeAutoStretch(const ImageStats &stats,double target = 0.25,double clipping = -2.8);
+    /*按照拉伸参数将8位或16位图像转为8位图像，默认参数为线性转换*/
+    void ApplyStretch(const cv::Mat &src,cv::Mat &dst,const StretchParams &params = StretchParams());
+    /*原始图像去马赛克，pattern为RGGB、BGGR、GRBG或GBRG*/
+    bool Debayer(const cv::Mat &src,cv::Mat &dst,const std::string &pattern);
+}
+
+#endif
@@ -35,26 +35,52 @@ Description:Image Progress Tools
 #define _IMG_TOOLS_H_
 
 #include <string>
+#include <vector>
+#include <stddef.h>
+
+#include "ImgStats.h"
+#include "ImgStar.h"
+
 namespace AstroAir
 {
+    /*一张图像的处理结果，由ProcessImage()填写，每个相机保存自己的最新结果*/
     struct ImageInfo
     {
-        std::string img_data;
-        double HFD;
-        int StarIndex;
-    };extern ImageInfo *IMGINFO;
+        unsigned int ImageID = 0;               //图像编号，用于对应JSON信息和二进制帧，JPG由PREVIEW按需生成
+        double HFD = 0;                         //所有未饱和星点HFD的中位数
+        double FWHM = 0;                        //所有未饱和星点FWHM的中位数
+        int StarIndex = 0;                      //星点数量
+        ImageTools::ImageStats Stats;           //各通道的直方图和统计信息
+        std::vector<ImageTools::Star> Stars;    //检测到的星点，坐标相对于图像左上角
+        int StartX = 0;                         //子画幅图像在传感器上的起点(合并后的像素)
+        int StartY = 0;
+        int Bin = 1;
+    };
+
+    /*预览图处理设置*/
+    struct ImageProcessSetting
+    {
+        bool AutoStretch = true;                //16位和线性图像自动拉伸后再生成预览
+        bool Debayer = true;                    //彩色相机的原始图像去马赛克，关闭时预览为黑白
+        int HistogramBins = 256;                //发送给客户端的直方图区间数
+        int VideoPreviewSize = 1280;            //视频预览图长边的最大像素数，0表示不缩小
+        int VideoPreviewFps = 5;                //视频预览图每秒最多发送的数量
+    };extern ImageProcessSetting *IMGSET;
 }
 
 namespace AstroAir::ImageTools
 {
     /*格式转化*/
-    std::string ConvertUCto64(unsigned char *imgBuf,bool isColor,int ImageHeight,int ImageWidth);       /*转为Base64格式*/
-    std::string base64Encode(const unsigned char* Data, int DataByte);      /*Base64编码*/
-    std::string base64Decode(const char* Data, int DataByte);               /*Base64解码*/
-    
-    /*图像信息处理*/
-    void clacHistogram(unsigned char *imgBuf,bool isColor,int ImageHeight,int ImageWidth);      /*计算直方图*/
-    
+    bool ConvertUCtoJPG(unsigned char *imgBuf,bool isColor,int ImageHeight,int ImageWidth,std::vector<unsigned char> &jpg);      /*转为JPG格式*/
+    bool ProcessImage(unsigned char *imgBuf,int ImageHeight,int ImageWidth,int BitDepth,int Channels,const std::string &Bayer,ImageInfo &Result);      /*拉伸、计算星点信息并保存预览*/
+    bool ProcessVideoFrame(unsigned char *imgBuf,int ImageHeight,int ImageWidth,int BitDepth,int Channels,const std::string &Bayer,unsigned int &ImageID);      /*缩小、拉伸视频图像并保存预览*/
+
+    /*Base64编解码，支持时使用SSSE3、AVX2或NEON指令，不需要OpenCV*/
+    size_t base64EncodedSize(size_t DataByte,bool LineBreak = false);      /*编码后的长度*/
+    size_t base64Encode(const unsigned char *Data,size_t DataByte,char *Out,bool LineBreak = false);      /*编码到预先分配的缓冲区*/
+    std::string base64Encode(const unsigned char *Data,size_t DataByte,bool LineBreak = false);      /*Base64编码*/
+    std::string base64Decode(const char *Data,size_t DataByte);               /*Base64解码*/
+
 }
 
 #endif
\ No newline at end of file
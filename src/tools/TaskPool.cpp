@@ -0,0 +1,295 @@
+/*
+ * TaskPool.cpp
+ *
+ * Copyright (C) 2020-2021 Max Qian
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*************************************************
+
+Copyright: 2020-2021 Max Qian. All rights reserved
+
+Author:Max Qian
+
+E-mail:astro_air@126.com
+
+Date:2021-7-12
+
+Description:Bounded work-stealing task pool
+
+**************************************************/
+
+#include "TaskPool.h"
+#include "../logger.h"
+
+#include <exception>
+
+namespace AstroAir
+{
+    TaskPool *POOL = nullptr;
+
+    /*
+     * name: TaskPool(int threads,int capacity)
+     * @param threads:工作线程数量
+     * @param capacity:最多可以排队的任务数量
+     * describe: Start worker threads
+     * 描述：构造函数，启动工作线程
+     */
+    TaskPool::TaskPool(int threads,int capacity)
+    {
+        if(threads <= 0)
+            threads = GetCPUCores() > 0 ? GetCPUCores() : 2;
+        MaxPending = capacity > 0 ? capacity : threads * 4;
+        queued = 0;
+        pending = 0;
+        active = 0;
+        next = 0;
+        running = true;
+        for(int i = 0;i < threads;i++)
+            workers.emplace_back(new Worker());
+        for(int i = 0;i < threads;i++)
+            this->threads.emplace_back(&TaskPool::WorkerThread,this,i);
+        IDLog(_("Start task pool with %d threads, at most %d pending tasks\n"),threads,MaxPending);
+    }
+
+    /*
+     * name: ~TaskPool()
+     * describe: Destructor
+     * 描述：析构函数
+     * calls: Stop()
+     */
+    TaskPool::~TaskPool()
+    {
+        Stop();
+    }
+
+    /*
+     * name: Submit(Task task)
+     * @param task:需要执行的任务
+     * describe: Submit a task to any worker
+     * 描述：提交任务，由任意空闲线程执行
+     * @return false:任务池已满或已经停止
+     */
+    bool TaskPool::Submit(Task task)
+    {
+        if(!running)
+            return false;
+        if(pending.fetch_add(1) >= MaxPending)
+        {
+            pending--;
+            return false;
+        }
+        Schedule([this,task]() mutable
+        {
+            pending--;
+            RunTask(task);
+        });
+        return true;
+    }
+
+    /*
+     * name: Submit(const std::string &queue,Task task)
+     * @param queue:串行队列名称，一般为设备类型
+     * @param task:需要执行的任务
+     * describe: Submit a task which runs after all earlier tasks of the same queue
+     * 描述：提交至串行队列，同一队列中的任务按顺序逐个执行
+     * @return false:任务池已满或已经停止
+     */
+    bool TaskPool::Submit(const std::string &queue,Task task)
+    {
+        if(queue.empty())
+            return Submit(task);
+        if(!running)
+            return false;
+        if(pending.fetch_add(1) >= MaxPending)
+        {
+            pending--;
+            return false;
+        }
+        std::lock_guard<std::mutex> guard(serial_mtx);
+        SerialQueue &serial = serials[queue];
+        serial.tasks.push_back(std::move(task));
+        if(!serial.running)
+        {
+            serial.running = true;
+            Schedule([this,queue]{RunSerial(queue);});
+        }
+        return true;
+    }
+
+    /*
+     * name: RunSerial(const std::string &queue)
+     * @param queue:串行队列名称
+     * describe: Run the next task of a serial queue
+     * 描述：执行串行队列中的下一个任务，完成后重新调度，使不同队列可以交替执行
+     */
+    void TaskPool::RunSerial(const std::string &queue)
+    {
+        Task task;
+        {
+            std::lock_guard<std::mutex> guard(serial_mtx);
+            SerialQueue &serial = serials[queue];
+            if(serial.tasks.empty())
+            {
+                serial.running = false;
+                return;
+            }
+            task = std::move(serial.tasks.front());
+            serial.tasks.pop_front();
+        }
+        pending--;
+        RunTask(task);
+        std::lock_guard<std::mutex> guard(serial_mtx);
+        SerialQueue &serial = serials[queue];
+        if(serial.tasks.empty())
+            serial.running = false;
+        else
+            Schedule([this,queue]{RunSerial(queue);});
+    }
+
+    /*
+     * name: RunTask(Task &task)
+     * describe: Run a task and count it as active
+     * 描述：执行任务，并统计正在执行的任务数量
+     * note: Exceptions must not kill the worker thread
+     */
+    void TaskPool::RunTask(Task &task)
+    {
+        active++;
+        try
+        {
+            task();
+        }
+        catch(std::exception const &e)
+        {
+            IDLog_Error(_("Task failed with exception: %s\n"),e.what());
+        }
+        catch(...)
+        {
+            IDLog_Error(_("Task failed with unknown exception\n"));
+        }
+        active--;
+    }
+
+    /*
+     * name: Schedule(Task task)
+     * describe: Push a task into the queue of a worker
+     * 描述：将任务轮流分配到工作线程的队列中
+     */
+    void TaskPool::Schedule(Task task)
+    {
+        Worker &worker = *workers[next++ % workers.size()];
+        {
+            std::lock_guard<std::mutex> guard(worker.mtx);
+            worker.tasks.push_back(std::move(task));
+        }
+        queued++;
+        std::lock_guard<std::mutex> guard(wait_mtx);
+        wait_cond.notify_one();
+    }
+
+    /*
+     * name: PopTask(int id,Task &task)
+     * @param id:工作线程编号
+     * describe: Take a task from own queue, or steal one from other workers
+     * 描述：优先从自己的队列头部取任务，否则从其他线程队列尾部窃取
+     */
+    bool TaskPool::PopTask(int id,Task &task)
+    {
+        {
+            Worker &own = *workers[id];
+            std::lock_guard<std::mutex> guard(own.mtx);
+            if(!own.tasks.empty())
+            {
+                task = std::move(own.tasks.front());
+                own.tasks.pop_front();
+                return true;
+            }
+        }
+        for(size_t i = 1;i < workers.size();i++)
+        {
+            Worker &other = *workers[(id + i) % workers.size()];
+            std::lock_guard<std::mutex> guard(other.mtx);
+            if(!other.tasks.empty())
+            {
+                task = std::move(other.tasks.back());
+                other.tasks.pop_back();
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /*
+     * name: WorkerThread(int id)
+     * @param id:工作线程编号
+     * describe: Main loop of worker thread
+     * 描述：工作线程主循环，没有任务时休眠
+     */
+    void TaskPool::WorkerThread(int id)
+    {
+        while(true)
+        {
+            Task task;
+            if(PopTask(id,task))
+            {
+                queued--;
+                task();
+                continue;
+            }
+            std::unique_lock<std::mutex> lock(wait_mtx);
+            wait_cond.wait(lock,[this]{return queued > 0 || !running;});
+            if(!running && queued == 0)
+                break;
+        }
+    }
+
+    /*
+     * name: Stop()
+     * describe: Stop the pool after all queued tasks have finished
+     * 描述：等待已排队的任务执行完成后停止任务池
+     */
+    void TaskPool::Stop()
+    {
+        {
+            std::lock_guard<std::mutex> guard(wait_mtx);
+            if(!running && threads.empty())
+                return;
+            running = false;
+            wait_cond.notify_all();
+        }
+        for(auto &t : threads)
+        {
+            if(t.joinable())
+                t.join();
+        }
+        threads.clear();
+    }
+
+    int TaskPool::Pending()
+    {
+        return pending;
+    }
+
+    int TaskPool::Active()
+    {
+        return active;
+    }
+
+    int TaskPool::Threads()
+    {
+        return workers.size();
+    }
+}
@@ -0,0 +1,110 @@
+/*
+ * TaskPool.h
+ *
+ * Copyright (C) 2020-2021 Max Qian
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*************************************************
+
+Copyright: 2020-2021 Max Qian. All rights reserved
+
+Author:Max Qian
+
+E-mail:astro_air@126.com
+
+Date:2021-7-12
+
+Description:Bounded work-stealing task pool
+
+**************************************************/
+
+#ifndef _TASK_POOL_H_
+#define _TASK_POOL_H_
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <map>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <atomic>
+
+namespace AstroAir
+{
+    /*
+        服务器任务池
+        工作线程数量固定，每个线程拥有自己的任务队列，空闲时从其他线程窃取任务
+        同一设备的任务进入串行队列，保证相机、赤道仪等命令不会同时执行
+        排队任务超过上限时拒绝新任务，由调用者返回错误信息
+    */
+    class TaskPool
+    {
+        public:
+            typedef std::function<void()> Task;
+
+            explicit TaskPool(int threads,int capacity);
+            ~TaskPool();
+            /*提交任务，任务池已满时返回false*/
+            bool Submit(Task task);
+            /*提交至指定设备的串行队列，队列名为空时等同于Submit(task)*/
+            bool Submit(const std::string &queue,Task task);
+            /*停止任务池并等待所有线程退出*/
+            void Stop();
+            /*已提交但尚未开始的任务数量*/
+            int Pending();
+            /*正在执行的任务数量*/
+            int Active();
+            /*工作线程数量*/
+            int Threads();
+        private:
+            struct Worker
+            {
+                std::deque<Task> tasks;
+                std::mutex mtx;
+            };
+            struct SerialQueue
+            {
+                std::deque<Task> tasks;
+                bool running = false;
+            };
+
+            void WorkerThread(int id);
+            bool PopTask(int id,Task &task);
+            void Schedule(Task task);
+            void RunSerial(const std::string &queue);
+            void RunTask(Task &task);
+
+            std::vector<std::unique_ptr<Worker>> workers;
+            std::vector<std::thread> threads;
+            std::map<std::string,SerialQueue> serials;
+            std::mutex serial_mtx;
+            std::mutex wait_mtx;
+            std::condition_variable wait_cond;
+
+            std::atomic_int queued;         //工作线程队列中的任务数量
+            std::atomic_int pending;        //尚未开始的用户任务数量
+            std::atomic_int active;         //正在执行的用户任务数量
+            std::atomic_uint next;          //轮询分配的下一个线程
+            std::atomic_bool running;
+            int MaxPending;
+    };
+    extern TaskPool *POOL;
+}
+
+#endif
@@ -47,6 +47,10 @@ Using:JsonCpp<https://github.com/open-source-parsers/jsoncpp>
 #include "air_filter.h"
 #include "air_guider.h"
 
+#include <string.h>
+#include <climits>
+#include <algorithm>
+
 #ifdef HAS_QHY
     #include "camera/air-qhy/qhy_ccd.h"
 #endif
@@ -58,6 +62,10 @@ Using:JsonCpp<https://github.com/open-source-parsers/jsoncpp>
     #include "camera/air-gphoto2/gphoto2_ccd.h"
 #endif
 
+#ifdef HAS_SIMULATOR
+    #include "camera/air-sim/sim_ccd.h"
+#endif
+
 #ifdef HAS_ASI
     #include "camera/air-asi/asi_ccd.h"
 #endif
@@ -78,15 +86,14 @@ Using:JsonCpp<https://github.com/open-source-parsers/jsoncpp>
 
 namespace AstroAir
 {
-    WSSERVER ws;
-    std::string SequenceTarget;
+    /*服务器设置在ws之前构造，ws的构造函数可以使用默认设置*/
     ServerSetting AA;
     ServerSetting *SS = &AA;
+    WSSERVER ws;
+    std::string SequenceTarget;
     
     std::string TargetRA,TargetDEC,MountAngle;
 
-	std::string Camera_name,Mount_name,Focus_name,Filter_name,Guide_name;
-
 //----------------------------------------服务器----------------------------------------
 
 #ifdef HAS_WEBSOCKET
@@ -97,7 +104,8 @@ namespace AstroAir
      */
     WSSERVER::WSSERVER()
     {
-        LoadConfigure();
+        flush_scheduled = false;
+        UpdateSubscribers();
         /*初始化WebSocket服务器*/
         /*加载设置*/
         m_server.clear_access_channels(websocketpp::log::alevel::all ^ websocketpp::log::alevel::frame_payload);
@@ -105,6 +113,9 @@ namespace AstroAir
         m_server.init_asio();
         /*设置重新使用端口*/
         m_server.set_reuse_addr(true);
+        /*设置握手检查事件，在接受连接之前限制客户端数量*/
+        m_server.set_validate_handler(bind(&WSSERVER::on_validate, this , ::_1));
+        m_server.set_fail_handler(bind(&WSSERVER::on_fail, this , ::_1));
         /*设置打开事件*/
         m_server.set_open_handler(bind(&WSSERVER::on_open, this , ::_1));
         /*设置关闭事件*/
@@ -124,24 +135,177 @@ namespace AstroAir
     }
     
     /*
-     * name: ~WSSERVER()
-     * describe: Destructor
-     * 描述：析构函数
+     * name: Init()
+     * describe: Load the configuration and set up the shared services
+     * 描述：加载配置文件，初始化任务池并注册驱动，由main()在运行服务器之前调用
+     * calls: LoadConfigure()
+     * calls: RegisterBuiltinDrivers()
+     * note: This must not run from the constructor. ws is a global, and the
+     *       frame pool, preview cache, operation table and device registry it
+     *       configures live in other translation units that may not be
+     *       constructed yet.
+     */
+    void WSSERVER::Init()
+    {
+        LoadConfigure();
+        /*初始化任务池，所有客户端命令均在任务池中执行*/
+        POOL = new TaskPool(SS->MaxThreadNumber,SS->MaxTaskNumber);
+        /*请求超过截止时间后通知客户端*/
+        OPS.SetTimeoutHandler([this](const OperationPtr &op)
+        {
+            Json::Value Root;
+            Root["Event"] = Json::Value("RequestTimeout");
+            Root["RequestID"] = op->RequestID;
+            Root["method"] = Json::Value(op->Method);
+            ReplyTo(op->Client,Root);
+        });
+        /*注册内置驱动，并加载插件提供的驱动*/
+        RegisterBuiltinDrivers();
+        DEVICES.LoadPlugins(SS->PluginDirectory);
+    }
+
+    /*
+     * name: Shutdown()
+     * describe: Stop the server and release the task pool and drivers
+     * 描述：停止服务器，等待任务池中的命令结束后释放驱动，由main()在退出前调用
      * calls: stop()
+     * note: The device registry is a global in another translation unit and may
+     *       already be destroyed when ~WSSERVER runs, so it is released here.
      */
-    WSSERVER::~WSSERVER()
+    void WSSERVER::Shutdown()
     {
-		/*如果服务器正在工作，则在停止程序之前停止服务器*/
+        /*如果服务器正在工作，则在停止程序之前停止服务器*/
         if(isConnected)
         {
             stop();
         }
-        delete [] CCD;
-        delete [] MOUNT;
-        delete [] FOCUS;
-        delete [] FILTER;
-        delete [] GUIDE;
         Running = false;
+        /*先等待任务池中的命令结束，再释放驱动*/
+        delete POOL;
+        POOL = nullptr;
+        DEVICES.Clear();
+    }
+
+    /*
+     * name: ~WSSERVER()
+     * describe: Destructor
+     * 描述：析构函数
+     * note: Shutdown() must already have released the drivers
+     */
+    WSSERVER::~WSSERVER()
+    {
+        Running = false;
+    }
+
+    /*将URL中的%XX和+还原*/
+    static std::string UrlDecode(const std::string &str)
+    {
+        std::string out;
+        out.reserve(str.size());
+        for(size_t i = 0;i < str.size();i++)
+        {
+            if(str[i] == '%' && i + 2 < str.size() && isxdigit((unsigned char)str[i + 1]) && isxdigit((unsigned char)str[i + 2]))
+            {
+                out += (char)strtol(str.substr(i + 1,2).c_str(),nullptr,16);
+                i += 2;
+            }
+            else
+                out += str[i] == '+' ? ' ' : str[i];
+        }
+        return out;
+    }
+
+    /*
+     * name: QueryParam(const std::string &query,const std::string &key,std::string &value)
+     * @param query:请求路径中?之后的部分
+     * @param key:参数名称
+     * @param value:解码后的参数值
+     * describe: Find a parameter of a query string
+     * 描述：按&分割查询字符串，参数名称必须完全相同，xtoken=不会被当作token=
+     */
+    static bool QueryParam(const std::string &query,const std::string &key,std::string &value)
+    {
+        size_t start = 0;
+        while(start <= query.size())
+        {
+            size_t end = query.find('&',start);
+            if(end == std::string::npos)
+                end = query.size();
+            std::string item = query.substr(start,end - start);
+            size_t eq = item.find('=');
+            if(UrlDecode(item.substr(0,eq)) == key)
+            {
+                value = eq == std::string::npos ? "" : UrlDecode(item.substr(eq + 1));
+                return true;
+            }
+            start = end + 1;
+        }
+        return false;
+    }
+
+    /*比较令牌，用时与第一个不同字符的位置无关*/
+    static bool SafeEqual(const std::string &a,const std::string &b)
+    {
+        const size_t n = std::max(a.size(),b.size());
+        unsigned char diff = a.size() != b.size();
+        for(size_t i = 0;i < n;i++)
+            diff |= (unsigned char)(i < a.size() ? a[i] : 0) ^ (unsigned char)(i < b.size() ? b[i] : 0);
+        return diff == 0;
+    }
+
+    /*
+     * name: on_validate(websocketpp::connection_hdl hdl)
+     * @param hdl:WebSocket句柄
+     * describe: Admit or refuse a client during the handshake
+     * 描述：握手时检查客户端数量和令牌，拒绝的连接直接返回HTTP错误
+     * @return false:客户端数量已满或令牌错误
+     * note: The slot is reserved here and released in on_fail or on_close
+     */
+    bool WSSERVER::on_validate(websocketpp::connection_hdl hdl)
+    {
+        airserver::connection_ptr con = m_server.get_con_from_hdl(hdl);
+        SessionPtr session = std::make_shared<ClientSession>();
+        session->Handle = hdl;
+        /*路径中只保存?之前的部分，令牌不会出现在日志和客户端列表中*/
+        const std::string resource = con->get_resource();
+        const size_t query = resource.find('?');
+        session->Path = resource.substr(0,query);
+        session->Address = con->get_remote_endpoint();
+        session->Opened = std::chrono::steady_clock::now();
+        /*检查令牌*/
+        if(!SS->AccessToken.empty())
+        {
+            std::string token;
+            bool found = query != std::string::npos && QueryParam(resource.substr(query + 1),"token",token);
+            if(!found || !SafeEqual(token,SS->AccessToken))
+            {
+                IDLog_Error(_("Refuse client %s with invalid token\n"),session->Address.c_str());
+                con->set_status(websocketpp::http::status_code::unauthorized);
+                return false;
+            }
+        }
+        session->Authenticated = true;
+        lock_guard<mutex> con_guard(con_mtx);
+        if(SS->MaxClientNumber > 0 && (int)(m_connections.size() + m_pending.size()) >= SS->MaxClientNumber)
+        {
+            IDLog_Error(_("There are too many clients connected with server, refuse %s\n"),session->Address.c_str());
+            con->set_status(websocketpp::http::status_code::service_unavailable);
+            return false;
+        }
+        m_pending[con.get()] = session;
+        return true;
+    }
+
+    /*
+     * name: on_fail(websocketpp::connection_hdl hdl)
+     * @param hdl:WebSocket句柄
+     * describe: Release the slot of a failed handshake
+     * 描述：握手失败时释放预留的客户端位置
+     */
+    void WSSERVER::on_fail(websocketpp::connection_hdl hdl)
+    {
+        lock_guard<mutex> con_guard(con_mtx);
+        m_pending.erase(hdl.lock().get());
     }
 
     /*
@@ -152,35 +316,42 @@ namespace AstroAir
      */
     void WSSERVER::on_open(websocketpp::connection_hdl hdl)
     {
-        lock_guard<mutex> guard(mtx);
-        airserver::connection_ptr con = m_server.get_con_from_hdl( hdl );      // 根据连接句柄获得连接对象
-        std::string path = con->get_resource();
-        IDLog(_("Successfully established connection with client path %s\n"),path.c_str());
-        m_connections.insert(hdl);
+        const void *key = hdl.lock().get();
+        SessionPtr session;
+        {
+            lock_guard<mutex> con_guard(con_mtx);
+            auto it = m_pending.find(key);
+            if(it == m_pending.end())
+                return;
+            session = it->second;
+            m_pending.erase(it);
+            /*握手回复中包含permessage-deflate时表示协商成功*/
+            websocketpp::lib::error_code ec;
+            airserver::connection_ptr con = m_server.get_con_from_hdl(hdl,ec);
+            if(!ec)
+                session->Deflate = con->get_response_header("Sec-WebSocket-Extensions").find("permessage-deflate") != std::string::npos;
+            m_connections[key] = session;
+            UpdateSessions();
+        }
         isConnected = true;
-        ClientNum++;
-        if(ClientNum > SS->MaxClientNumber)
-            ClientNumError();
-        m_server_cond.notify_one();
+        IDLog(_("Successfully established connection with client %s path %s%s\n"),session->Address.c_str(),session->Path.c_str(),session->Deflate ? " (permessage-deflate)" : "");
     }
     
     /*
      * name: on_close(websocketpp::connection_hdl hdl)
      * @param hdl:WebSocket句柄
      * describe: Clear data on server disconnection
-     * 描述：服务器断开连接时清空数据
+     * 描述：客户端断开连接时只清除该客户端的会话，已连接的设备不受影响
      */
     void WSSERVER::on_close(websocketpp::connection_hdl hdl)
     {
-        lock_guard<mutex> guard(mtx);
         IDLog(_("Disconnect from client,goodbye\n"));
-        m_connections.erase(hdl);
-        isConnected = false;
-        /*防止多次连接导致错误*/
-        memset(DeviceBuf,0,5);
-        DeviceNum = 0;
-        ClientNum--;
-        m_server_cond.notify_one();
+        {
+            lock_guard<mutex> con_guard(con_mtx);
+            m_connections.erase(hdl.lock().get());
+            UpdateSessions();
+            isConnected = !m_connections.empty();
+        }
     }
     
     /*
@@ -193,7 +364,15 @@ namespace AstroAir
      */
     void WSSERVER::on_message(websocketpp::connection_hdl hdl,message_ptr msg)
     {
-        readJson(msg->get_payload());
+        /*每条信息解析到独立的文档中，多个客户端同时发送命令时互不影响*/
+        MessagePtr message = messages.Parse(msg->get_payload());
+        if(!message)
+        {
+            UnknownMsg(hdl);
+            return;
+        }
+        message->client = hdl;
+        readJson(message);
     }
 
     /*以下三个函数均是用于switch支持string*/
@@ -218,183 +397,376 @@ namespace AstroAir
         return hash_compile_time(p);
     }
     
+//----------------------------------------命令表----------------------------------------
+
+    /*命令参数说明*/
+    constexpr ParamSpec SetProfileParams[] = {{"FileName",ParamType::String,true}};
+    constexpr ParamSpec ProtocolModeParams[] = {{"ImageMode",ParamType::String,false},{"JsonStyle",ParamType::String,false},{"Telemetry",ParamType::String,false},{"Compression",ParamType::String,false}};
+    constexpr ParamSpec SetupParams[] = {{"TimeoutConnect",ParamType::Int,false}};
+    constexpr ParamSpec DeviceParams[] = {{"Device",ParamType::String,false}};
+    constexpr ParamSpec CameraShotParams[] = {{"Device",ParamType::String,false},{"Expo",ParamType::Int,true},{"Bin",ParamType::Int,false},{"IsSaveFile",ParamType::Bool,false},{"FitFileName",ParamType::String,false},{"Gain",ParamType::Int,false},{"Offset",ParamType::Int,false},{"SubframeX",ParamType::Int,false},{"SubframeY",ParamType::Int,false},{"SubframeWidth",ParamType::Int,false},{"SubframeHeight",ParamType::Int,false},{"AutoCenter",ParamType::Bool,false},{"StarX",ParamType::Double,false},{"StarY",ParamType::Double,false}};
+    constexpr ParamSpec CameraVideoParams[] = {{"Device",ParamType::String,false},{"Expo",ParamType::Int,true},{"Bin",ParamType::Int,false},{"Gain",ParamType::Int,false},{"Offset",ParamType::Int,false}};
+    constexpr ParamSpec CoolingParams[] = {{"Device",ParamType::String,false},{"IsSetPoint",ParamType::Bool,false},{"IsCoolDown",ParamType::Bool,false},{"IsASync",ParamType::Bool,false},{"IsWarmup",ParamType::Bool,false},{"IsCoolerOFF",ParamType::Bool,false},{"Temperature",ParamType::Int,false}};
+    constexpr ParamSpec SearchTargetParams[] = {{"Name",ParamType::String,true}};
+    constexpr ParamSpec RoboClipListParams[] = {{"FilterGroup",ParamType::String,false},{"FilterName",ParamType::String,false},{"FilterNote",ParamType::String,false},{"Order",ParamType::Int,false}};
+    constexpr ParamSpec RoboClipAddParams[] = {{"DECJ2000",ParamType::String,true},{"RAJ2000",ParamType::String,true},{"FCOL",ParamType::Int,false},{"FROW",ParamType::Int,false},{"Group",ParamType::String,false},{"GuidTarget",ParamType::String,false},{"IsMosaic",ParamType::Bool,false},{"Note",ParamType::String,false},{"PA",ParamType::String,false},{"TILES",ParamType::String,false},{"TargetName",ParamType::String,true},{"angleAdj",ParamType::Bool,false},{"overlap",ParamType::Int,false}};
+    constexpr ParamSpec GotoParams[] = {{"RAText",ParamType::String,true},{"DECText",ParamType::String,true}};
+    constexpr ParamSpec SolveParams[] = {{"IsBlind",ParamType::Bool,false},{"IsSync",ParamType::Bool,false}};
+    constexpr ParamSpec SequenceParams[] = {{"SequenceFile",ParamType::String,true}};
+    constexpr ParamSpec DragScriptParams[] = {{"DragScriptFile",ParamType::String,true}};
+    constexpr ParamSpec CancelRequestParams[] = {{"RequestID",ParamType::String,true}};
+    constexpr ParamSpec SubscribeParams[] = {{"Images",ParamType::String,false},{"Logs",ParamType::String,false},{"TelemetryRate",ParamType::Int,false},{"Telemetry",ParamType::Bool,false},{"Progress",ParamType::Bool,false},{"GuideSteps",ParamType::Bool,false}};
+    constexpr ParamSpec UnsubscribeParams[] = {{"Topic",ParamType::String,true}};
+    constexpr ParamSpec GetImageParams[] = {{"Tier",ParamType::String,true},{"ImageID",ParamType::Int,false}};
+
+    /*
+        客户端命令表
+        增加命令只需要在这里增加一项，处理函数只能通过参数视图读取参数
+        Inline命令在网络线程中执行，必须很快完成
+    */
+    struct WSCommands
+    {
+        static constexpr auto Table()
+        {
+            return MakeCommandTable(std::array{
+                /*返回服务器版本号*/
+                CommandEntry{"RemoteSetDashboardMode",CommandExec::Inline,"",[](const Message &m){ws.SetDashBoardMode();}},
+                /*返回当前目录下的文件*/
+                CommandEntry{"RemoteGetAstroAirProfiles",CommandExec::Inline,"",[](const Message &m){ws.GetAstroAirProfiles();}},
+                /*设置通信协议，必须在该客户端后续信息之前生效*/
+                CommandEntry{"RemoteSetProtocolMode",CommandExec::Inline,"",[](const Message &m){ws.SetProtocolMode(m.client,m.Params());},ProtocolModeParams},
+                /*订阅主题，必须在该客户端后续信息之前生效*/
+                CommandEntry{"RemoteSubscribe",CommandExec::Inline,"",[](const Message &m){ws.Subscribe(m.client,m.Params());},SubscribeParams},
+                CommandEntry{"RemoteUnsubscribe",CommandExec::Inline,"",[](const Message &m){ws.Unsubscribe(m.client,m.Params());},UnsubscribeParams},
+                /*获取命令统计信息*/
+                CommandEntry{"RemoteGetMethodMetrics",CommandExec::Inline,"",[](const Message &m){ws.GetMethodMetrics(m.client);}},
+                /*取消请求*/
+                CommandEntry{"RemoteCancelRequest",CommandExec::Inline,"",[](const Message &m){ws.CancelRequest(m.client,m.Params());},CancelRequestParams},
+                /*获取正在进行的请求*/
+                CommandEntry{"RemoteGetOperations",CommandExec::Inline,"",[](const Message &m){ws.GetOperations(m.client);}},
+                /*设置新的配置文件*/
+                CommandEntry{"RemoteSetProfile",CommandExec::Queue,"setup",[](const Message &m){ws.SetProfile(m.Params().String("FileName"));},SetProfileParams},
+                /*连接设备*/
+                CommandEntry{"RemoteSetupConnect",CommandExec::Queue,"setup",[](const Message &m){ws.SetupConnect(m.Params().Int("TimeoutConnect"));},SetupParams},
+                /*断开连接*/
+                CommandEntry{"RemoteSetupDisconnect",CommandExec::Queue,"setup",[](const Message &m){ws.SetupDisconnect(m.Params().Int("TimeoutConnect"));},SetupParams},
+                /*相机开始拍摄，可以指定子画幅(传感器像素)或以星点为中心自动设置子画幅，不指定时拍摄全画幅*/
+                CommandEntry{"RemoteCameraShot",CommandExec::Queue,"camera",[](const Message &m)
+                {
+                    CommandParams p = m.Params();
+                    AIRCAMERA *camera = DEVICES.Camera(p.String("Device"));
+                    if(!camera)
+                        return ws.DeviceNotFoundError(m.client,m.method,p.String("Device","camera"));
+                    if(p.Bool("AutoCenter"))
+                    {
+                        if(!camera->CenterSubframe(p.Int("SubframeWidth",256),p.Int("SubframeHeight",256),p.Double("StarX",-1),p.Double("StarY",-1)))
+                            camera->SetSubframe(0,0,0,0);
+                    }
+                    else
+                        camera->SetSubframe(p.Int("SubframeX"),p.Int("SubframeY"),p.Int("SubframeWidth"),p.Int("SubframeHeight"));
+                    camera->StartExposureServer(p.Int("Expo"),p.Int("Bin"),p.Bool("IsSaveFile"),p.String("FitFileName"),p.Int("Gain"),p.Int("Offset"));
+                },CameraShotParams}.WithCancel([](const Json::Value &params)
+                {
+                    /*取消命令指定的相机，而不是主相机*/
+                    if(AIRCAMERA *camera = DEVICES.Camera(CommandParams(params).String("Device")))
+                        camera->AbortExposure();
+                }),
+                /*相机停止拍摄，不能在相机队列中等待正在进行的曝光*/
+                CommandEntry{"RemoteActionAbort",CommandExec::Inline,"",[](const Message &m)
+                {
+                    AIRCAMERA *camera = DEVICES.Camera(m.Params().String("Device"));
+                    if(!camera)
+                        return ws.DeviceNotFoundError(m.client,m.method,m.Params().String("Device","camera"));
+                    camera->StopSequence();
+                    camera->AbortExposure();
+                },DeviceParams},
+                /*相机开始视频预览，Expo为单帧曝光时间(毫秒)*/
+                CommandEntry{"RemoteCameraStartVideo",CommandExec::Queue,"camera",[](const Message &m)
+                {
+                    CommandParams p = m.Params();
+                    AIRCAMERA *camera = DEVICES.Camera(p.String("Device"));
+                    if(!camera)
+                        return ws.DeviceNotFoundError(m.client,m.method,p.String("Device","camera"));
+                    camera->StartVideoServer(p.Int("Expo"),p.Int("Bin",1),p.Int("Gain"),p.Int("Offset"));
+                },CameraVideoParams},
+                /*相机停止视频预览，与开始视频在同一队列中执行，保证先开始后停止*/
+                CommandEntry{"RemoteCameraStopVideo",CommandExec::Queue,"camera",[](const Message &m)
+                {
+                    AIRCAMERA *camera = DEVICES.Camera(m.Params().String("Device"));
+                    if(!camera)
+                        return ws.DeviceNotFoundError(m.client,m.method,m.Params().String("Device","camera"));
+                    camera->StopVideoServer();
+                },DeviceParams},
+                /*相机制冷*/
+                CommandEntry{"RemoteCooling",CommandExec::Queue,"camera",[](const Message &m)
+                {
+                    CommandParams p = m.Params();
+                    AIRCAMERA *camera = DEVICES.Camera(p.String("Device"));
+                    if(!camera)
+                        return ws.DeviceNotFoundError(m.client,m.method,p.String("Device","camera"));
+                    camera->CoolingServer(p.Bool("IsSetPoint"),p.Bool("IsCoolDown"),p.Bool("IsASync"),p.Bool("IsWarmup"),p.Bool("IsCoolerOFF"),p.Int("Temperature"));
+                },CoolingParams},
+                /*搜索天体*/
+                CommandEntry{"RemoteSearchTarget",CommandExec::Pooled,"",[](const Message &m){Search a;a.SearchTarget(m.Params().String("Name"));},SearchTargetParams},
+                /*自定义目标管理*/
+                CommandEntry{"RemoteRoboClipGetTargetList",CommandExec::Queue,"roboclip",[](const Message &m)
+                {
+                    CommandParams p = m.Params();
+                    SEARCH.RoboClipGetTargetList(p.String("FilterGroup"),p.String("FilterName"),p.String("FilterNote"),p.Int("Order"));
+                },RoboClipListParams},
+                /*自定义目标管理-添加目标*/
+                CommandEntry{"RemoteRoboClipAddTarget",CommandExec::Queue,"roboclip",[](const Message &m)
+                {
+                    CommandParams p = m.Params();
+                    SEARCH.RemoteRoboClipAddTarget(p.String("DECJ2000"),p.String("RAJ2000"),p.Int("FCOL"),p.Int("FROW"),p.String("Group"),p.String("GuidTarget"),p.Bool("IsMosaic"),p.String("Note"),p.String("PA"),p.String("TILES"),p.String("TargetName"),p.Bool("angleAdj"),p.Int("overlap"));
+                },RoboClipAddParams},
+                /*获取滤镜轮设置*/
+                CommandEntry{"RemoteGetFilterConfiguration",CommandExec::Inline,"",[](const Message &m){ws.GetFilterConfiguration();}},
+                /*获取最近图像的其他预览等级，编码原图可能需要几秒*/
+                CommandEntry{"RemoteGetImage",CommandExec::Pooled,"",[](const Message &m){ws.GetImage(m.client,m.Params());},GetImageParams},
+                /*获取已连接客户端信息*/
+                CommandEntry{"RemoteGetClients",CommandExec::Inline,"",[](const Message &m){ws.GetClients(m.client);}},
+                /*获取已连接设备信息*/
+                CommandEntry{"RemoteGetEnvironmentData",CommandExec::Inline,"",[](const Message &m){ws.EnvironmentDataSend();}},
+                /*获取所有设备实例和可用驱动*/
+                CommandEntry{"RemoteGetDevices",CommandExec::Inline,"",[](const Message &m){ws.GetDevices(m.client);}},
+                /*赤道仪Goto*/
+                CommandEntry{"RemotePrecisePointTarget",CommandExec::Queue,"mount",[](const Message &m){MOUNT->GotoServer(m.Params().String("RAText"),m.Params().String("DECText"));},GotoParams}.WithCancel([](const Json::Value &params)
+                {
+                    /*超时时赤道仪可能已经断开*/
+                    if(AIRMOUNT *mount = DEVICES.Mount(""))
+                        mount->AbortServer(2);
+                }),
+                /*解析*/
+                CommandEntry{"RemoteSolveActualPosition",CommandExec::Queue,"solver",[](const Message &m)
+                {
+                    CommandParams p = m.Params();
+                    if(p.Bool("IsBlind"))
+                        SOLVER->SolveActualPosition(true,p.Bool("IsSync"),2);
+                    else
+                        SOLVER->SolveActualPositionOnline(false,p.Bool("IsSync"));
+                },SolveParams},
+                /*搜索所有可以执行的序列*/
+                CommandEntry{"RemoteGetListAvalaibleSequence",CommandExec::Pooled,"",[](const Message &m){SCRIPT->GetListAvalaibleSequence();}},
+                /*运行拍摄序列，在相机队列中执行，拍摄完成后请求才结束*/
+                CommandEntry{"RemoteSequence",CommandExec::Queue,"camera",[](const Message &m){SCRIPT->RunSequence(m.Params().String("SequenceFile"));},SequenceParams}.WithCancel([](const Json::Value &params){SCRIPT->AbortSequence();}),
+                /*搜索所有可以执行的脚本*/
+                CommandEntry{"RemoteGetListAvalaibleDragScript",CommandExec::Pooled,"",[](const Message &m){SCRIPT->GetListAvalaibleDragScript();}},
+                /*运行脚本，在相机队列中执行*/
+                CommandEntry{"RemoteDragScript",CommandExec::Queue,"camera",[](const Message &m){SCRIPT->RemoteDragScript(m.Params().String("DragScriptFile"));},DragScriptParams}.WithCancel([](const Json::Value &params){SCRIPT->AbortSequence();}),
+                /*导星*/
+                CommandEntry{"RemoteConnectToGuider",CommandExec::Queue,"guide",[](const Message &m){GUIDE->Connect("PHD2");}},
+                CommandEntry{"RemoteStartGuiding",CommandExec::Queue,"guide",[](const Message &m){GUIDE->StartGuidingServer();}}.WithCancel([](const Json::Value &params)
+                {
+                    if(AIRGUIDER *guider = DEVICES.Guider(""))
+                        guider->AbortGuidingServer();
+                }),
+                CommandEntry{"RemoteDither",CommandExec::Queue,"guide",[](const Message &m){GUIDE->DitherServer();}},
+                CommandEntry{"RemoteAbortGuiding",CommandExec::Queue,"guide",[](const Message &m){GUIDE->AbortGuidingServer();}},
+                /*轮询，保持连接*/
+                CommandEntry{"Polling",CommandExec::Inline,"",[](const Message &m){ws.Polling();}},
+            });
+        }
+    };
+
+    constexpr auto Commands = WSCommands::Table();
+    static_assert(Commands.Valid(),"No perfect hash for the command table, add more slots");
+    static_assert(Commands.Unique(),"Duplicate command in the command table");
+    CommandMetrics CommandStat[Commands.Size()];
+
     /*
-     * name: readJson(std::string message)
+     * name: RunCommand(const CommandEntry &cmd,const MessagePtr &message,const OperationPtr &op)
+     * @param cmd:命令
      * @param message:客户端信息
+     * @param op:客户端提供RequestID时对应的操作，否则为空
+     * describe: Run the handler and record the time used
+     * 描述：执行命令并记录执行时间，执行期间发送的信息都会带上RequestID
+     * note: Handlers use CCD, MOUNT and the other raw driver pointers, so the
+     *       instances are pinned for the whole call.
+     */
+    void WSSERVER::RunCommand(const CommandEntry &cmd,const MessagePtr &message,const OperationPtr &op)
+    {
+        OperationScope scope(op);
+        /*命令执行期间持有所有设备实例，断开连接时被移除的驱动在最后一个使用它的命令结束后才释放*/
+        std::vector<DevicePtr> devices = DEVICES.List();
+        if(op)
+        {
+            /*排队时已经被取消，状态只能由这里或OPS.Cancel中的一方改变*/
+            int queued = Operation::Queued;
+            if(!op->State.compare_exchange_strong(queued,Operation::Running))
+            {
+                RequestComplete(op,false);
+                return;
+            }
+        }
+        auto start = std::chrono::steady_clock::now();
+        cmd.handler(*message);
+        CommandStat[Commands.Index(&cmd)].Record(std::chrono::steady_clock::now() - start);
+        if(op)
+            RequestComplete(op,true);
+    }
+
+    /*
+     * name: readJson(MessagePtr message)
+     * @param message:已解析的客户端信息
      * describe: Process information and complete
      * 描述：处理信息并完成对应任务
      * note: This is the heart of the whole process!!!
      */
-    void WSSERVER::readJson(std::string message)
+    void WSSERVER::readJson(MessagePtr message)
     {
-        /*运用JsonCpp拆分JSON数组*/
-        std::unique_ptr<Json::CharReader>const json_read(reader.newCharReader());
-        json_read->parse(message.c_str(), message.c_str() + message.length(), &root,&errs);
         /*将接收到的信息写入文件*/
         #ifdef DEBUG_MODE
-        if(root["method"].asString() != "Polling")
-            IDLog_CMDL(message.c_str());
+        if(message->method != "Polling")
+            IDLog_CMDL(message->payload.c_str());
         #endif
         /*判断客户端需要执行的命令*/
-        switch(hash_(root["method"].asString().c_str()))
+        const CommandEntry *cmd = Commands.Find(message->method);
+        if(!cmd)
         {
-            /*返回服务器版本号*/
-            case "RemoteSetDashboardMode"_hash:
-                SetDashBoardMode();
-                break;
-            /*返回当前目录下的文件*/
-            case "RemoteGetAstroAirProfiles"_hash:
-                GetAstroAirProfiles();
-                break;
-            /*设置新的配置文件*/
-            case "RemoteSetProfile"_hash:{
-                std::thread ProfileThread(&WSSERVER::SetProfile,this,root["params"]["FileName"].asString());
-                ProfileThread.detach();
-                SS->thread_num++;
-                break;
-            }
-            /*连接设备*/
-            case "RemoteSetupConnect"_hash:{
-                std::thread ConnectThread(&WSSERVER::SetupConnect,this,root["params"]["TimeoutConnect"].asInt());
-                ConnectThread.detach();
-                SS->thread_num++;
-                break;
-            }
-            /*断开连接*/
-            case "RemoteSetupDisconnect"_hash:{
-                std::thread DisconnectThread(&WSSERVER::SetupDisconnect,this,root["params"]["TimeoutConnect"].asInt());
-                DisconnectThread.detach();
-                SS->thread_num++;
-                break;
-            }
-            /*相机开始拍摄*/
-            case "RemoteCameraShot"_hash:{
-                std::thread CamThread(&AIRCAMERA::StartExposureServer,CCD,root["params"]["Expo"].asInt(),root["params"]["Bin"].asInt(),root["params"]["IsSaveFile"].asBool(),root["params"]["FitFileName"].asString(),root["params"]["Gain"].asInt(),root["params"]["Offset"].asInt());
-                CamThread.detach();
-                SS->thread_num++;
-                break;
-            }
-            /*相机停止拍摄*/
-            case "RemoteActionAbort"_hash:
-				CCD->AbortExposure();
-				break;
-            /*相机制冷*/
-            case "RemoteCooling"_hash:{
-                std::thread CoolingThread(&AIRCAMERA::CoolingServer,CCD,root["params"]["IsSetPoint"].asBool(),root["params"]["IsCoolDown"].asBool(),root["params"]["IsASync"].asBool(),root["params"]["IsWarmup"].asBool(),root["params"]["IsCoolerOFF"].asBool(),root["params"]["Temperature"].asInt());
-                CoolingThread.detach();
-                SS->thread_num++;
-                break;
-            }
-            /*搜索天体*/
-            case "RemoteSearchTarget"_hash:{
-                Search a;
-                std::thread SearchThread(&Search::SearchTarget,a,root["params"]["Name"].asString());
-                SearchThread.detach();
-                SS->thread_num++;
-                break;
-            }
-            /*自定义目标管理*/
-            case "RemoteRoboClipGetTargetList"_hash:{
-                std::thread RoboClipThread(&Search::RoboClipGetTargetList,SEARCH,root["params"]["FilterGroup"].asString(),root["params"]["FilterName"].asString(),root["params"]["FilterNote"].asString(),root["params"]["Order"].asInt());
-                RoboClipThread.detach();
-                SS->thread_num++;
-                break;
-            }
-            /*自定义目标管理-添加目标*/
-            case "RemoteRoboClipAddTarget"_hash:{
-                std::thread RoboClipThread(&Search::RemoteRoboClipAddTarget,SEARCH,root["params"]["DECJ2000"].asString(),root["params"]["RAJ2000"].asString(),root["params"]["FCOL"].asInt(),root["params"]["FROW"].asInt(),root["params"]["Group"].asString(),root["params"]["GuidTarget"].asString(),root["params"]["IsMosaic"].asBool(),root["params"]["Note"].asString(),root["params"]["PA"].asString(),root["params"]["TILES"].asString(),root["params"]["TargetName"].asString(),root["params"]["angleAdj"].asBool(),root["params"]["overlap"].asInt());
-                RoboClipThread.detach();
-                SS->thread_num++;
-                break;
-            }
-            /*获取滤镜轮设置*/
-            case "RemoteGetFilterConfiguration"_hash:{
-                GetFilterConfiguration();
-                break;
-            }
-            /*获取已连接设备信息*/
-            case "RemoteGetEnvironmentData"_hash:{
-                EnvironmentDataSend();
-                break;
-            }
-            /*赤道仪Goto*/
-            case "RemotePrecisePointTarget"_hash:{
-                std::thread GotoThread(&AIRMOUNT::GotoServer,MOUNT,root["params"]["RAText"].asString(),root["params"]["DECText"].asString());
-                GotoThread.detach();
-                SS->thread_num++;
-                break;
-            }
-            /*解析*/
-            case "RemoteSolveActualPosition"_hash:{
-                if(root["params"]["IsBlind"].asBool())
-                {
-                    std::thread SolveThread(&AIRSOLVER::SolveActualPosition,SOLVER,root["params"]["IsBlind"].asBool(),root["params"]["IsSync"].asBool(),2);
-                    SolveThread.detach();
-                }  
-                else
-                {
-                    std::thread SolveThread(&AIRSOLVER::SolveActualPositionOnline,SOLVER,root["params"]["IsBlind"].asBool(),root["params"]["IsSync"].asBool());
-                    SolveThread.detach();
-                }
-                SS->thread_num++;
-                break;
-            }
-            /*搜索所有可以执行的序列*/
-            case "RemoteGetListAvalaibleSequence"_hash:{
-                std::thread SequenceThread(&AIRSCRIPT::GetListAvalaibleSequence,SCRIPT);
-                SequenceThread.detach();
-                SS->thread_num++;
-                break;
-            }
-            /*运行拍摄序列*/
-            case "RemoteSequence"_hash:{
-                std::thread SequenceThreadRun(&AIRSCRIPT::RunSequence,SCRIPT,root["params"]["SequenceFile"].asString());
-                SequenceThreadRun.detach();
-                SS->thread_num++;
-                break;
-            }
-            /*搜索所有可以执行的脚本*/
-            case "RemoteGetListAvalaibleDragScript"_hash:{
-                std::thread DragScriptThread(&AIRSCRIPT::GetListAvalaibleDragScript,SCRIPT);
-                DragScriptThread.detach();
-                SS->thread_num++;
-                break;
-            }
-            /*运行脚本*/
-            case "RemoteDragScript"_hash:{
-                std::thread DragScriptThreadRun(&AIRSCRIPT::RemoteDragScript,SCRIPT,root["params"]["DragScriptFile"].asString());
-                DragScriptThreadRun.detach();
-                SS->thread_num++;
-                break;
-            }
-            /*连接导星软件*/
-            case "RemoteConnectToGuider"_hash:{
-                GUIDE->Connect("PHD2");
-                break;
-            }
-            case "RemoteStartGuiding"_hash:{
-                GUIDE->StartGuidingServer();
-                break;
-            }
-            case "RemoteDither"_hash:{
-                GUIDE->DitherServer();
-                break;
-            }
-            case "RemoteAbortGuiding"_hash:{
-                GUIDE->AbortGuidingServer();
-                break;
+            UnknownMsg(message->client);
+            return;
+        }
+        std::string bad;
+        if(!CheckParams(*cmd,message->Params(),bad))
+        {
+            CommandStat[Commands.Index(cmd)].Rejected++;
+            InvalidParamError(message->client,message->method,bad);
+            return;
+        }
+        /*客户端提供了RequestID，记录为正在进行的操作*/
+        OperationPtr op;
+        if(!message->RequestID.isNull())
+        {
+            op = OPS.Begin(message->client,message->RequestID,message->method,message->Params().Raw(),cmd->cancel,message->Deadline);
+            if(!op)
+            {
+                CommandStat[Commands.Index(cmd)].Rejected++;
+                DuplicateRequestError(message->client,message->method,message->RequestID);
+                return;
             }
-            /*轮询，保持连接*/
-            case "Polling"_hash:
-                Polling();
-                break;
-            /*默认返回未知信息*/
-            default:
-                UnknownMsg();
-                break;
         }
+        if(cmd->exec == CommandExec::Inline)
+            RunCommand(*cmd,message,op);
+        else if(!Dispatch(message,*cmd,op))
+            CommandStat[Commands.Index(cmd)].Rejected++;
     }
-    
+
+    /*
+     * name: Dispatch(const MessagePtr &message,const CommandEntry &cmd,const OperationPtr &op)
+     * @param message:客户端信息，在任务执行完成前一直有效
+     * @param cmd:命令，Queue命令进入设备串行队列，Pooled命令可以与其他任务并行执行
+     * note: The queue of a device instance is named after the instance
+     * @param op:对应的操作，可以为空
+     * describe: Run the command on the task pool instead of a detached thread
+     * 描述：将命令交给任务池执行，任务池已满时向客户端返回错误
+     * calls: ServerBusyError()
+     */
+    bool WSSERVER::Dispatch(const MessagePtr &message,const CommandEntry &cmd,const OperationPtr &op)
+    {
+        std::string queue;
+        if(cmd.exec == CommandExec::Queue)
+        {
+            /*指定了设备实例的命令进入该实例自己的队列，主相机与导星相机可以同时工作*/
+            queue = cmd.queue;
+            std::string device = message->Params().String("Device");
+            if(!device.empty() && DEVICES.Find(device))
+                queue = device;
+        }
+        if(!POOL->Submit(queue,[this,message,&cmd,op]{RunCommand(cmd,message,op);}))
+        {
+            if(op)
+                OPS.End(op);
+            OperationScope scope(op);
+            ServerBusyError(message->client,message->method);
+            return false;
+        }
+        return true;
+    }
+
+    /*
+     * name: RequestComplete(const OperationPtr &op,bool executed)
+     * @param op:操作
+     * @param executed:命令是否已经执行
+     * describe: Tell the client that the request has finished
+     * 描述：请求结束，只通知发出请求的客户端，客户端可以据此发送下一条命令
+     */
+    void WSSERVER::RequestComplete(const OperationPtr &op,bool executed)
+    {
+        OPS.End(op);
+        Json::Value Root;
+        Root["Event"] = Json::Value("RequestComplete");
+        Root["RequestID"] = op->RequestID;
+        Root["method"] = Json::Value(op->Method);
+        Root["Executed"] = Json::Value(executed);
+        Root["Cancelled"] = Json::Value((bool)op->Cancelled);
+        Root["TimedOut"] = Json::Value((bool)op->TimedOut);
+        Root["UsedTime"] = Json::Value((Json::Int64)std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - op->Start).count());
+        ReplyTo(op->Client,Root);
+    }
+
+    /*
+     * name: CancelRequest(websocketpp::connection_hdl hdl,const CommandParams &params)
+     * @param hdl:客户端句柄
+     * @param params:需要取消的RequestID
+     * describe: Cancel an in-flight request
+     * 描述：取消该客户端正在进行或正在排队的请求，其他客户端的请求不会被找到
+     */
+    void WSSERVER::CancelRequest(websocketpp::connection_hdl hdl,const CommandParams &params)
+    {
+        bool found = OPS.Cancel(hdl,params.Raw()["RequestID"]);
+        Json::Value Root;
+        Root["Event"] = Json::Value("RemoteActionResult");
+        Root["UID"] = Json::Value("RemoteCancelRequest");
+        Root["ActionResultInt"] = Json::Value(found ? 4 : 5);
+        Root["ParamRet"]["RequestID"] = params.Raw()["RequestID"];
+        if(!found)
+            Root["Motivo"] = Json::Value(_("No such request"));
+        sendTo(hdl,WriteJson(Root,false));
+    }
+
+    /*
+     * name: GetOperations(websocketpp::connection_hdl hdl)
+     * @param hdl:客户端句柄
+     * describe: List in-flight requests
+     * 描述：列出该客户端正在进行和正在排队的请求
+     */
+    void WSSERVER::GetOperations(websocketpp::connection_hdl hdl)
+    {
+        Json::Value Root;
+        Root["Event"] = Json::Value("RemoteActionResult");
+        Root["UID"] = Json::Value("RemoteGetOperations");
+        Root["ActionResultInt"] = Json::Value(4);
+        Root["ParamRet"] = Json::Value(Json::arrayValue);
+        for(auto &op : OPS.List(hdl))
+            Root["ParamRet"].append(op->ToJson());
+        sendTo(hdl,WriteJson(Root,false));
+    }
+
+    /*
+     * name: GetMethodMetrics(websocketpp::connection_hdl hdl)
+     * @param hdl:客户端句柄
+     * describe: Send call counts and latency histograms of all commands
+     * 描述：发送所有命令的调用次数和执行时间分布
+     * note: Histogram[i] counts calls which took less than 2^i microseconds
+     */
+    void WSSERVER::GetMethodMetrics(websocketpp::connection_hdl hdl)
+    {
+        Json::Value Root;
+        Root["Event"] = Json::Value("RemoteActionResult");
+        Root["UID"] = Json::Value("RemoteGetMethodMetrics");
+        Root["ActionResultInt"] = Json::Value(4);
+        for(size_t i = 0;i < Commands.Size();i++)
+        {
+            Json::Value metrics = CommandStat[i].ToJson();
+            metrics["Exec"] = Json::Value(Commands[i].exec == CommandExec::Inline ? "Inline" : (Commands[i].exec == CommandExec::Pooled ? "Pooled" : "Queue"));
+            if(Commands[i].exec == CommandExec::Queue)
+                metrics["Queue"] = Json::Value(Commands[i].queue);
+            Root["ParamRet"][Commands[i].method] = metrics;
+        }
+        sendTo(hdl,WriteJson(Root,false));
+    }
+
     /*
      * name: send(std::string payload)
      * @param message:需要发送的信息
@@ -406,25 +778,384 @@ namespace AstroAir
     {
         if(isConnected)
         {
-            /*向WS客户端发送信息*/
-            for (auto it : m_connections)
+            /*加入每个客户端的发送队列，发送操作由各连接的网络线程异步完成*/
+            OutboundQueue::Payload payload = std::make_shared<const std::string>(std::move(message));
+            for (auto &it : *Sessions())
+                Post(it,OutboundQueue::Result,payload);
+        }
+    }
+    
+    /*
+     * name: send(const Json::Value &Root,OutboundQueue::Class type)
+     * @param Root:需要发送的信息
+     * @param type:信息类型，决定客户端发送缓慢时是否可以丢弃
+     * describe: Serialize once per style and send to all clients
+     * 描述：每种格式只序列化一次，再发送给所有客户端
+     * note: Compact JSON by default, styled JSON for clients which ask for it
+     */
+    void WSSERVER::send(const Json::Value &Root,OutboundQueue::Class type)
+    {
+        Broadcast(Root,type,Topic::Results,0);
+    }
+
+    /*
+     * name: Publish(Topic topic,const Json::Value &Root,int level)
+     * @param topic:信息主题
+     * @param Root:需要发送的信息
+     * @param level:日志类型或图像订阅
+     * describe: Send a message only to the clients subscribed to the topic
+     * 描述：只向订阅了该主题的客户端发送信息，没有客户端订阅时不序列化
+     */
+    void WSSERVER::Publish(Topic topic,const Json::Value &Root,int level)
+    {
+        static const OutboundQueue::Class TopicClass[(int)Topic::TopicNum] = {OutboundQueue::Result,OutboundQueue::Log,OutboundQueue::Progress,OutboundQueue::Image,OutboundQueue::Telemetry,OutboundQueue::Log};
+        if(!Subscribed(topic,level))
+            return;
+        Broadcast(Root,TopicClass[(int)topic],topic,level);
+    }
+
+    /*
+     * name: Subscribed(Topic topic,int level)
+     * @param topic:信息主题
+     * @param level:日志类型或图像订阅，图像为0时表示任意图像订阅
+     * describe: Check if any client wants the topic
+     * 描述：检查是否有客户端订阅了该主题，只读取统计结果，不遍历客户端
+     */
+    bool WSSERVER::Subscribed(Topic topic,int level)
+    {
+        if(!isConnected)
+            return false;
+        switch(topic)
+        {
+            case Topic::Results:
+                return true;
+            case Topic::Logs:
+                return subscribers[(int)topic] > 0 && level >= min_log_level;
+            case Topic::Images:
+                if(level > 0 && level <= ImageFull)
+                    return image_subscribers[level] > 0;
+                return subscribers[(int)topic] > 0;
+            default:
+                return subscribers[(int)topic] > 0;
+        }
+    }
+
+    /*
+     * name: Broadcast(const Json::Value &Root,OutboundQueue::Class type,Topic topic,int level)
+     * @param Root:需要发送的信息
+     * @param type:信息类型
+     * @param topic:信息主题
+     * @param level:日志类型或图像订阅
+     * describe: Serialize once per style and send to the subscribed clients
+     * 描述：每种格式只序列化一次，再发送给订阅了该主题的客户端
+     */
+    void WSSERVER::Broadcast(const Json::Value &Root,OutboundQueue::Class type,Topic topic,int level)
+    {
+        if(!isConnected)
+            return;
+        /*在请求中发送的信息带上RequestID*/
+        const Json::Value *Out = &Root;
+        Json::Value Tagged;
+        OperationPtr op = CurrentOperation();
+        if(op && Root.isObject() && !Root.isMember("RequestID"))
+        {
+            Tagged = Root;
+            Tagged["RequestID"] = op->RequestID;
+            Out = &Tagged;
+        }
+        OutboundQueue::Payload payload[2];
+        for (auto &it : *Sessions())
+        {
+            if(!it->Wants(topic,level))
+                continue;
+            int style = it->StyledJson;
+            if(!payload[style])
+                payload[style] = std::make_shared<const std::string>(WriteJson(*Out,style));
+            Post(it,type,payload[style]);
+        }
+    }
+
+    /*
+     * name: sendTo(websocketpp::connection_hdl hdl,const std::string &payload)
+     * @param hdl:客户端句柄
+     * @param payload:需要发送的信息
+     * describe: Send a result to one client
+     * 描述：向指定客户端发送命令结果
+     */
+    void WSSERVER::sendTo(websocketpp::connection_hdl hdl,const std::string &payload)
+    {
+        if(SessionPtr client = Session(hdl))
+            Post(client,OutboundQueue::Result,std::make_shared<const std::string>(payload));
+    }
+
+    /*
+     * name: ReplyTo(websocketpp::connection_hdl hdl,Json::Value Root)
+     * @param hdl:发出命令的客户端
+     * @param Root:需要发送的信息
+     * describe: Reply to the client which sent the command
+     * 描述：只回复发出命令的客户端，例如参数错误，其他客户端不需要知道，请求中的回复带上RequestID
+     */
+    void WSSERVER::ReplyTo(websocketpp::connection_hdl hdl,Json::Value Root)
+    {
+        SessionPtr client = Session(hdl);
+        if(!client)
+            return;
+        OperationPtr op = CurrentOperation();
+        if(op && !Root.isMember("RequestID"))
+            Root["RequestID"] = op->RequestID;
+        Post(client,OutboundQueue::Result,std::make_shared<const std::string>(WriteJson(Root,client->StyledJson)));
+    }
+
+    void WSSERVER::Post(const SessionPtr &client,OutboundQueue::Class type,const OutboundQueue::Payload &payload)
+    {
+        std::vector<OutboundQueue::Frame> frames(1);
+        frames[0].payload = payload;
+        Post(client,type,std::move(frames));
+    }
+
+    /*
+     * name: Post(const SessionPtr &client,OutboundQueue::Class type,std::vector<OutboundQueue::Frame> frames)
+     * @param client:客户端
+     * @param type:信息类型
+     * @param frames:需要发送的帧
+     * describe: Queue the message and try to flush the queue at once
+     * 描述：加入客户端发送队列，并尝试立即发送
+     */
+    void WSSERVER::Post(const SessionPtr &client,OutboundQueue::Class type,std::vector<OutboundQueue::Frame> frames)
+    {
+        /*图像已经是JPG，再压缩只会浪费CPU*/
+        if(type == OutboundQueue::Image)
+        {
+            for(auto &frame : frames)
+                frame.compress = false;
+        }
+        client->Out.Push(type,std::move(frames));
+        Flush(client);
+    }
+
+    /*
+     * name: Flush(const SessionPtr &client)
+     * @param client:客户端
+     * describe: Hand queued messages to websocketpp while the client keeps up
+     * 描述：客户端网络缓存未满时将队列中的信息交给网络线程
+     * note: When the client is slow the rest stays in the queue, where superseded
+     *       progress, telemetry and images can still be dropped.
+     *       Text frames are compressed only if the client negotiated permessage-deflate,
+     *       binary frames and images never are.
+     */
+    void WSSERVER::Flush(const SessionPtr &client)
+    {
+        OutboundQueue *out = &client->Out;
+        lock_guard<mutex> guard(out->send_mtx);
+        websocketpp::lib::error_code ec;
+        airserver::connection_ptr con = m_server.get_con_from_hdl(client->Handle,ec);
+        if(ec)
+            return;
+        const size_t MaxBuffered = (SS->MaxSendBuffer > 0 ? SS->MaxSendBuffer : 2048) * 1024;
+        const bool Deflate = client->Deflate && client->Compress && SS->Compression;
+        std::vector<OutboundQueue::Frame> frames;
+        while(con->get_buffered_amount() < MaxBuffered && out->Pop(frames))
+        {
+            for(auto &frame : frames)
             {
-                try
-                {
-                    m_server.send(it, message, websocketpp::frame::opcode::text);
-                }
-                catch (websocketpp::exception const &e)
-                {
-                    std::cerr << e.what() << std::endl;
-                }
-                catch (...)
+                message_ptr msg = con->get_message(frame.binary ? websocketpp::frame::opcode::binary : websocketpp::frame::opcode::text,frame.payload->size());
+                msg->append_payload(frame.payload->data(),frame.payload->size());
+                msg->set_compressed(Deflate && frame.compress && !frame.binary && (int)frame.payload->size() >= SS->CompressMinSize);
+                ec = con->send(msg);
+                if(ec)
                 {
-                    std::cerr << _("other exception") << std::endl;
+                    std::cerr << ec.message() << std::endl;
+                    return;
                 }
             }
         }
+        /*还有信息没有发送，稍后重试*/
+        if(out->Size() > 0)
+            ScheduleFlush();
     }
-    
+
+    /*
+     * name: ScheduleFlush()
+     * describe: Retry all queues later on a network thread
+     * 描述：在网络线程中稍后重新发送所有客户端的队列
+     */
+    void WSSERVER::ScheduleFlush()
+    {
+        if(flush_scheduled.exchange(true))
+            return;
+        try
+        {
+            m_server.set_timer(20,[this](websocketpp::lib::error_code const &ec)
+            {
+                flush_scheduled = false;
+                if(!ec)
+                    FlushAll();
+            });
+        }
+        catch (websocketpp::exception const &e)
+        {
+            flush_scheduled = false;
+            std::cerr << e.what() << std::endl;
+        }
+    }
+
+    void WSSERVER::FlushAll()
+    {
+        for (auto &it : *Sessions())
+            Flush(it);
+    }
+
+    /*
+     * name: sendImage(Json::Value &Root,unsigned int ImageID)
+     * @param Root:图像信息
+     * @param ImageID:图像编号
+     * describe: Send image to clients according to their protocol mode and subscription
+     * 描述：按照客户端的协议和订阅的预览等级发送图像，不需要图像的客户端只收到图像信息
+     * note: Each tier is encoded only if some client subscribed to it,
+     *       and only once for all of them
+     */
+    void WSSERVER::sendImage(Json::Value &Root,unsigned int ImageID)
+    {
+        if(!isConnected)
+            return;
+        Root["ImageID"] = Json::Value(ImageID);
+        if(OperationPtr op = CurrentOperation())
+            Root["RequestID"] = op->RequestID;
+        ImagePayload tiers[TierNum];
+        OutboundQueue::Payload meta[2];
+        for (auto &it : *Sessions())
+        {
+            int sub = it->Images;
+            if(sub > ImageNone && sub <= ImageFull && PostImage(it,Root,ImageID,sub - ImageThumbnail,tiers[sub - ImageThumbnail]))
+                continue;
+            /*不需要图像的客户端只收到图像信息*/
+            int style = it->StyledJson;
+            if(!meta[style])
+            {
+                Json::Value Meta = Root;
+                Meta["ImageTier"] = Json::Value("None");
+                meta[style] = std::make_shared<const std::string>(WriteJson(Meta,style));
+            }
+            Post(it,OutboundQueue::Image,meta[style]);
+        }
+    }
+
+    /*
+     * name: PostImage(const SessionPtr &client,const Json::Value &Root,unsigned int ImageID,int tier,ImagePayload &cache,OutboundQueue::Class type)
+     * @param client:客户端
+     * @param Root:图像信息
+     * @param ImageID:图像编号
+     * @param tier:预览等级
+     * @param cache:同一等级共用的编码结果
+     * @param type:推送的图像只保留最新的一张，客户端请求的图像作为命令结果发送，不会被替换
+     * describe: Queue one tier of an image for a client
+     * 描述：按照客户端的协议发送一级预览图，JPG、Base64和二进制帧只在第一次需要时生成
+     * note: Binary frame is ImageID (4 bytes, big-endian) followed by the JPG data.
+     */
+    bool WSSERVER::PostImage(const SessionPtr &client,const Json::Value &Root,unsigned int ImageID,int tier,ImagePayload &cache,OutboundQueue::Class type)
+    {
+        if(!cache.loaded)
+        {
+            cache.loaded = true;
+            #ifdef HAS_OPENCV
+                cache.preview = PREVIEW->Get(ImageID,tier);
+            #endif
+        }
+        if(!cache.preview.jpg)
+            return false;
+        const std::vector<unsigned char> &jpg = *cache.preview.jpg;
+        int style = client->StyledJson;
+        auto Info = [&]
+        {
+            Json::Value Info = Root;
+            Info["ImageTier"] = Json::Value(PreviewTierName(tier));
+            Info["ImageWidth"] = Json::Value(cache.preview.width);
+            Info["ImageHeight"] = Json::Value(cache.preview.height);
+            return Info;
+        };
+        if(client->BinaryImage)
+        {
+            if(!cache.meta[style])
+            {
+                Json::Value Meta = Info();
+                Meta["ImageFormat"] = Json::Value("jpg");
+                Meta["ImageSize"] = Json::Value((Json::UInt64)jpg.size());
+                cache.meta[style] = std::make_shared<const std::string>(WriteJson(Meta,style));
+            }
+            if(!cache.frame)
+            {
+                /*图像编号+JPG图像*/
+                std::string data(4 + jpg.size(),0);
+                data[0] = (char)(ImageID >> 24);
+                data[1] = (char)(ImageID >> 16);
+                data[2] = (char)(ImageID >> 8);
+                data[3] = (char)ImageID;
+                if(!jpg.empty())
+                    memcpy(&data[4],jpg.data(),jpg.size());
+                cache.frame = std::make_shared<const std::string>(std::move(data));
+            }
+            /*图像信息和二进制帧作为一条信息，不会被分开丢弃*/
+            std::vector<OutboundQueue::Frame> frames(2);
+            frames[0].payload = cache.meta[style];
+            frames[1].payload = cache.frame;
+            frames[1].binary = true;
+            Post(client,type,std::move(frames));
+        }
+        else
+        {
+            if(!cache.text[style])
+            {
+                Json::Value Text = Info();
+                /*直接编码到data URI的前缀之后，不生成中间字符串*/
+                static const std::string Prefix = "data:image/jpg;base64,";
+                std::string uri(Prefix.size() + ImageTools::base64EncodedSize(jpg.size()),0);
+                memcpy(&uri[0],Prefix.data(),Prefix.size());
+                uri.resize(Prefix.size() + ImageTools::base64Encode(jpg.data(),jpg.size(),&uri[Prefix.size()]));
+                Text["Base64Data"] = Json::Value(uri);
+                cache.text[style] = std::make_shared<const std::string>(WriteJson(Text,style));
+            }
+            Post(client,type,cache.text[style]);
+        }
+        return true;
+    }
+
+    /*
+     * name: GetImage(websocketpp::connection_hdl hdl,const CommandParams &params)
+     * @param hdl:客户端句柄
+     * @param params:Tier为Thumbnail、Screen或Full，ImageID默认为最新的图像
+     * describe: Send another tier of a recent image to one client
+     * 描述：客户端请求最近图像的其他等级，例如在缩略图上点击后查看原图
+     */
+    void WSSERVER::GetImage(websocketpp::connection_hdl hdl,const CommandParams &params)
+    {
+        SessionPtr session = Session(hdl);
+        if(!session)
+            return;
+        int tier = TierNum;
+        for(int i = 0;i < TierNum;i++)
+        {
+            if(params.String("Tier") == PreviewTierName(i))
+                tier = i;
+        }
+        if(tier == TierNum)
+            return InvalidParamError(hdl,"RemoteGetImage","Tier");
+        unsigned int ImageID = params.Int("ImageID",PREVIEW->LastID());
+        Json::Value Root;
+        Root["Event"] = Json::Value("RemoteActionResult");
+        Root["UID"] = Json::Value("RemoteGetImage");
+        Root["ImageID"] = Json::Value(ImageID);
+        if(OperationPtr op = CurrentOperation())
+            Root["RequestID"] = op->RequestID;
+        ImagePayload cache;
+        Root["ActionResultInt"] = Json::Value(4);
+        if(PostImage(session,Root,ImageID,tier,cache,OutboundQueue::Result))
+            return;
+        /*图像已经不在缓存中*/
+        Root["ActionResultInt"] = Json::Value(5);
+        Root["Motivo"] = Json::Value(_("Image is no longer available"));
+        sendTo(hdl,WriteJson(Root,session->StyledJson));
+    }
+
     /*
      * name: stop()
      * describe: Stop the websocket server
@@ -433,17 +1164,161 @@ namespace AstroAir
      */
     void WSSERVER::stop()
     {
-        for (auto it : m_connections)
+        for (auto &it : *Sessions())
         {
-            m_server.close(it, websocketpp::close::status::normal, _("Switched off by user."));
+            try
+            {
+                m_server.close(it->Handle, websocketpp::close::status::normal, _("Switched off by user."));
+            }
+            catch (websocketpp::exception const &e)
+            {
+                std::cerr << e.what() << std::endl;
+            }
         }
         IDLog(_("Stop the server..\n"));
         /*清除服务器句柄*/
-        m_connections.clear();
+        {
+            lock_guard<mutex> con_guard(con_mtx);
+            m_connections.clear();
+            m_pending.clear();
+            m_sessions = std::make_shared<const SessionList>();
+        }
         /*停止服务器*/
         m_server.stop();
     }
 
+    /*
+     * name: Sessions()
+     * describe: Get the current clients
+     * 描述：获取当前所有客户端，发送信息时不需要复制客户端列表，也不需要一直持有锁
+     * note: The list is rebuilt only when a client connects or disconnects
+     */
+    std::shared_ptr<const SessionList> WSSERVER::Sessions()
+    {
+        lock_guard<mutex> con_guard(con_mtx);
+        return m_sessions;
+    }
+
+    /*
+     * name: UpdateSessions()
+     * describe: Rebuild the list shared by senders
+     * 描述：客户端连接或断开后重新生成客户端列表
+     * note: The caller must hold con_mtx
+     */
+    void WSSERVER::UpdateSessions()
+    {
+        auto list = std::make_shared<SessionList>();
+        list->reserve(m_connections.size());
+        for (auto &it : m_connections)
+            list->push_back(it.second);
+        m_sessions = list;
+        UpdateSubscribers();
+    }
+
+    /*
+     * name: UpdateSubscribers()
+     * describe: Count the subscribers of every topic
+     * 描述：统计各主题的订阅数量，发送信息时只需要读取统计结果
+     * note: The caller must hold con_mtx
+     */
+    void WSSERVER::UpdateSubscribers()
+    {
+        int count[(int)Topic::TopicNum] = {0},images[ImageFull + 1] = {0},level = INT_MAX;
+        for (auto &it : m_connections)
+        {
+            const SessionPtr &client = it.second;
+            count[(int)Topic::Results]++;
+            if(client->Logs)
+            {
+                count[(int)Topic::Logs]++;
+                level = std::min(level,client->LogLevel.load());
+            }
+            if(client->Progress)
+                count[(int)Topic::Progress]++;
+            if(client->Images != ImageNone)
+                count[(int)Topic::Images]++;
+            if(client->Images >= ImageNone && client->Images <= ImageFull)
+                images[client->Images]++;
+            if(client->Telemetry)
+                count[(int)Topic::Telemetry]++;
+            if(client->GuideSteps)
+                count[(int)Topic::GuideSteps]++;
+        }
+        for(int i = 0;i < (int)Topic::TopicNum;i++)
+            subscribers[i] = count[i];
+        for(int i = 0;i <= ImageFull;i++)
+            image_subscribers[i] = images[i];
+        min_log_level = level;
+    }
+
+    /*
+     * name: Session(websocketpp::connection_hdl hdl)
+     * @param hdl:客户端句柄
+     * describe: Find the session of a client
+     * 描述：查找客户端会话，客户端已断开时返回nullptr
+     */
+    SessionPtr WSSERVER::Session(websocketpp::connection_hdl hdl)
+    {
+        const void *key = hdl.lock().get();
+        if(!key)
+            return nullptr;
+        lock_guard<mutex> con_guard(con_mtx);
+        auto it = m_connections.find(key);
+        return it == m_connections.end() ? nullptr : it->second;
+    }
+
+    /*
+     * name: SubscriptionJson(const ClientSession &client)
+     * @param client:客户端
+     * describe: Describe the topics a client subscribed to
+     * 描述：客户端订阅的主题
+     */
+    static Json::Value SubscriptionJson(const ClientSession &client)
+    {
+        static const char *ImageNames[] = {"None","Thumbnail","Screen","Full"};
+        Json::Value Root;
+        Root["Images"] = Json::Value(ImageNames[client.Images]);
+        Root["Logs"] = client.Logs ? Json::Value(client.LogLevel.load()) : Json::Value("None");
+        Root["Progress"] = Json::Value(client.Progress.load());
+        Root["Telemetry"] = Json::Value(client.Telemetry.load());
+        Root["TelemetryRate"] = Json::Value(client.TelemetryInterval.load());
+        Root["GuideSteps"] = Json::Value(client.GuideSteps.load());
+        return Root;
+    }
+
+    /*
+     * name: GetClients(websocketpp::connection_hdl hdl)
+     * @param hdl:客户端句柄
+     * describe: List connected clients
+     * 描述：返回所有已连接客户端的信息
+     */
+    void WSSERVER::GetClients(websocketpp::connection_hdl hdl)
+    {
+        Json::Value Root;
+        Root["Event"] = Json::Value("RemoteActionResult");
+        Root["UID"] = Json::Value("RemoteGetClients");
+        Root["ActionResultInt"] = Json::Value(4);
+        Root["ParamRet"] = Json::Value(Json::arrayValue);
+        const void *self = hdl.lock().get();
+        auto now = std::chrono::steady_clock::now();
+        for (auto &it : *Sessions())
+        {
+            Json::Value client;
+            client["Address"] = Json::Value(it->Address);
+            client["Path"] = Json::Value(it->Path);
+            client["ConnectedTime"] = Json::Value((Json::Int64)std::chrono::duration_cast<std::chrono::seconds>(now - it->Opened).count());
+            client["Authenticated"] = Json::Value(it->Authenticated);
+            client["ImageMode"] = Json::Value(it->BinaryImage ? "Binary" : "Text");
+            client["Telemetry"] = Json::Value(it->DeltaTelemetry ? "Delta" : "Full");
+            client["Compression"] = Json::Value(it->Deflate && it->Compress ? "Deflate" : "None");
+            client["Subscriptions"] = SubscriptionJson(*it);
+            client["Queued"] = Json::Value((Json::UInt64)it->Out.Size());
+            client["Self"] = Json::Value(it->Handle.lock().get() == self);
+            Root["ParamRet"].append(client);
+        }
+        sendTo(hdl,WriteJson(Root,false));
+    }
+
     /*
      * name: is_running()
      * @return Boolean function:服务器运行状态
@@ -471,6 +1346,36 @@ namespace AstroAir
             /*设置端口为IPv4模式并指定端口*/
             m_server.listen(websocketpp::lib::asio::ip::tcp::v4(),port);
             m_server.start_accept();
+        }
+        catch (websocketpp::exception const & e)
+        {   
+			std::cerr << e.what() << std::endl;
+            return;
+        }
+        /*启动网络线程，当前线程也作为其中之一*/
+        int threads = SS->IOThreadNumber > 0 ? SS->IOThreadNumber : (GetCPUCores() > 0 ? GetCPUCores() : 2);
+        IDLog(_("Start %d network threads\n"),threads);
+        std::vector<std::thread> io_threads;
+        for(int i = 1;i < threads;i++)
+            io_threads.emplace_back(&WSSERVER::RunIOThread,this);
+        RunIOThread();
+        for(auto &t : io_threads)
+        {
+            if(t.joinable())
+                t.join();
+        }
+    }
+
+    /*
+     * name: RunIOThread()
+     * describe: Run the io_context until the server stops
+     * 描述：网络线程主体，服务器停止后退出
+     * note: Handlers of one connection are serialized by its strand
+     */
+    void WSSERVER::RunIOThread()
+    {
+        try
+        {
             m_server.run();
         }
         catch (websocketpp::exception const & e)
@@ -501,12 +1406,48 @@ namespace AstroAir
         while (getline(in, line))
             jsonStr.append(line);
         in.close();
+        Json::Value root;
+        Json::String errs;
+        Json::CharReaderBuilder reader;
         std::unique_ptr<Json::CharReader>const json_read(reader.newCharReader());
         json_read->parse(jsonStr.c_str(), jsonStr.c_str() + jsonStr.length(), &root,&errs);
         /*获取基础配置信息*/
         SS->MaxUsedTime = root["ServerConfig"]["Timeout"].asInt();
         SS->MaxClientNumber = root["ServerConfig"]["MaxClientNum"].asInt();
         SS->MaxThreadNumber = root["ServerConfig"]["MaxThreadNum"].asInt();
+        SS->MaxTaskNumber = root["ServerConfig"]["MaxTaskNum"].asInt();
+        SS->IOThreadNumber = root["ServerConfig"]["IOThreadNum"].asInt();
+        SS->TelemetryKeyframe = root["ServerConfig"]["TelemetryKeyframe"].asInt();
+        SS->MaxSendBuffer = root["ServerConfig"]["MaxSendBuffer"].asInt();
+        /*预览等级，例如"ImageTiers":{"Screen":{"Size":1280,"Quality":80}}，没有设置的使用默认值*/
+        #ifdef HAS_OPENCV
+            const Json::Value &tiers = root["ServerConfig"]["ImageTiers"];
+            for(int i = 0;i < TierNum;i++)
+            {
+                const Json::Value &tier = tiers[PreviewTierName(i)];
+                if(tier.isObject())
+                    PREVIEW->SetTier(i,tier.get("Size",-1).asInt(),tier.get("Quality",0).asInt());
+            }
+            if(root["ServerConfig"]["ImageCache"].isIntegral())
+                PREVIEW->SetMaxImages(root["ServerConfig"]["ImageCache"].asInt());
+            /*预览图是否自动拉伸和去马赛克*/
+            IMGSET->AutoStretch = root["ServerConfig"].get("AutoStretch",true).asBool();
+            IMGSET->Debayer = root["ServerConfig"].get("Debayer",true).asBool();
+            /*随图像发送的直方图区间数，0表示不发送*/
+            IMGSET->HistogramBins = root["ServerConfig"].get("HistogramBins",256).asInt();
+            /*视频预览图的尺寸和帧率*/
+            IMGSET->VideoPreviewSize = std::max(root["ServerConfig"].get("VideoPreviewSize",1280).asInt(),0);
+            IMGSET->VideoPreviewFps = std::max(root["ServerConfig"].get("VideoPreviewFps",5).asInt(),1);
+        #endif
+        /*图像缓冲池，空闲缓冲区数量和是否使用大页*/
+        FRAMES->SetMaxIdle(std::max(root["ServerConfig"].get("FramePoolSize",2).asInt(),0));
+        FRAMES->SetHugePages(root["ServerConfig"].get("HugePages",false).asBool());
+        SS->Compression = root["ServerConfig"].get("Compression",true).asBool();
+        SS->CompressMinSize = root["ServerConfig"].get("CompressMinSize",128).asInt();
+        SS->PluginDirectory = root["ServerConfig"]["PluginDirectory"].asString();
+        if(SS->PluginDirectory.empty())
+            SS->PluginDirectory = "plugins";
+        SS->AccessToken = root["ServerConfig"]["AccessToken"].asString();
         return true;
     }
 
@@ -514,7 +1455,7 @@ namespace AstroAir
      * name: SetDashBoardMode()
      * describe: This is used to initialize the connection and send the version number.
      * 描述：初始化连接，并发送版本号
-     * calls: send(std::string message)
+     * calls: send(const Json::Value &Root)
      */
     void WSSERVER::SetDashBoardMode()
 	{
@@ -523,7 +1464,7 @@ namespace AstroAir
 		Root["code"] = Json::Value();
 		Root["Event"] = Json::Value("Version");
 		Root["AIRVersion"] = Json::Value("2.0.0");
-		send(Root.toStyledString());
+		send(Root);
 	}
 
     /*
@@ -581,7 +1522,170 @@ namespace AstroAir
             }
         }
         /*整合信息并发送至客户端*/
-        send(Root.toStyledString());
+        send(Root);
+    }
+
+    /*
+     * name: SetProtocolMode(websocketpp::connection_hdl hdl,const CommandParams &params)
+     * @param hdl:客户端句柄
+     * @param params:ImageMode为Binary或Text，JsonStyle为Compact或Styled，Telemetry为Full或Delta，
+     *               Compression为Deflate或None
+     * describe: Set how images and messages are delivered to this client
+     * 描述：设置该客户端接收图像的方式和JSON格式，旧客户端默认使用文本模式和紧凑格式
+     * note: Compression only works if the client offered permessage-deflate in the handshake
+     */
+    void WSSERVER::SetProtocolMode(websocketpp::connection_hdl hdl,const CommandParams &params)
+    {
+        std::string mode = params.String("ImageMode","Text"),style = params.String("JsonStyle","Compact");
+        std::string telemetry_mode = params.String("Telemetry","Full"),compression = params.String("Compression","Deflate");
+        if((mode != "Binary" && mode != "Text") || (style != "Styled" && style != "Compact") || (telemetry_mode != "Delta" && telemetry_mode != "Full") || (compression != "Deflate" && compression != "None"))
+        {
+            UnknownMsg(hdl);
+            return;
+        }
+        SessionPtr session = Session(hdl);
+        if(!session)
+            return;
+        session->BinaryImage = (mode == "Binary");
+        session->StyledJson = (style == "Styled");
+        session->DeltaTelemetry = (telemetry_mode == "Delta");
+        session->Compress = (compression == "Deflate");
+        Json::Value Root;
+        Root["result"] = Json::Value(1);
+		Root["code"] = Json::Value();
+		Root["Event"] = Json::Value("ProtocolMode");
+		Root["ImageMode"] = Json::Value(mode);
+		Root["JsonStyle"] = Json::Value(style);
+		Root["Telemetry"] = Json::Value(telemetry_mode);
+		/*返回实际使用的压缩方式*/
+		Root["Compression"] = Json::Value(session->Deflate && session->Compress && SS->Compression ? "Deflate" : "None");
+        sendTo(hdl,WriteJson(Root,style == "Styled"));
+        /*增量模式的客户端需要尽快收到第一帧完整信息*/
+        NotifyTelemetry();
+    }
+
+    /*
+     * name: Subscribe(websocketpp::connection_hdl hdl,const CommandParams &params)
+     * @param hdl:客户端句柄
+     * @param params:Images为Full、Screen、Thumbnail或None，Logs为All、Info、Error、None或日志类型，
+     *               TelemetryRate为遥测信息的最小间隔(毫秒)，Telemetry、Progress和GuideSteps为是否接收
+     * describe: Choose the streams this client receives
+     * 描述：设置该客户端接收的信息，没有提供的参数保持不变
+     */
+    void WSSERVER::Subscribe(websocketpp::connection_hdl hdl,const CommandParams &params)
+    {
+        int images = -1,level = -1;
+        if(params.Has("Images"))
+        {
+            std::string mode = params.String("Images");
+            if(mode == "Full")
+                images = ImageFull;
+            else if(mode == "Screen" || mode == "Preview")
+                images = ImageScreen;
+            else if(mode == "Thumbnail")
+                images = ImageThumbnail;
+            else if(mode == "None")
+                images = ImageNone;
+            else
+                return InvalidParamError(hdl,"RemoteSubscribe","Images");
+        }
+        bool logs = true;
+        if(params.Has("Logs"))
+        {
+            std::string mode = params.String("Logs");
+            if(mode == "All")
+                level = 0;
+            else if(mode == "Info")
+                level = 2;
+            else if(mode == "Error")
+                level = 3;
+            else if(mode == "None")
+                logs = false;
+            else if(params.Raw()["Logs"].isIntegral())
+                level = params.Int("Logs");
+            else
+                return InvalidParamError(hdl,"RemoteSubscribe","Logs");
+        }
+        if(params.Int("TelemetryRate",-1) < -1)
+            return InvalidParamError(hdl,"RemoteSubscribe","TelemetryRate");
+        SessionPtr session = Session(hdl);
+        if(!session)
+            return;
+        if(images >= 0)
+            session->Images = images;
+        if(params.Has("Logs"))
+        {
+            session->Logs = logs;
+            if(level >= 0)
+                session->LogLevel = level;
+        }
+        if(params.Has("TelemetryRate"))
+            session->TelemetryInterval = params.Int("TelemetryRate");
+        session->Telemetry = params.Bool("Telemetry",session->Telemetry);
+        session->Progress = params.Bool("Progress",session->Progress);
+        session->GuideSteps = params.Bool("GuideSteps",session->GuideSteps);
+        {
+            lock_guard<mutex> con_guard(con_mtx);
+            UpdateSubscribers();
+        }
+        SubscriptionSend(hdl,session);
+        NotifyTelemetry();
+    }
+
+    /*
+     * name: Unsubscribe(websocketpp::connection_hdl hdl,const CommandParams &params)
+     * @param hdl:客户端句柄
+     * @param params:Topic为Images、Logs、Telemetry、Progress或GuideSteps
+     * describe: Stop a stream for this client
+     * 描述：该客户端不再接收某一主题的信息
+     */
+    void WSSERVER::Unsubscribe(websocketpp::connection_hdl hdl,const CommandParams &params)
+    {
+        SessionPtr session = Session(hdl);
+        if(!session)
+            return;
+        switch(hash_(params.String("Topic").c_str()))
+        {
+            case "Images"_hash:
+                session->Images = ImageNone;
+                break;
+            case "Logs"_hash:
+                session->Logs = false;
+                break;
+            case "Telemetry"_hash:
+                session->Telemetry = false;
+                break;
+            case "Progress"_hash:
+                session->Progress = false;
+                break;
+            case "GuideSteps"_hash:
+                session->GuideSteps = false;
+                break;
+            default:
+                return InvalidParamError(hdl,"RemoteUnsubscribe","Topic");
+        }
+        {
+            lock_guard<mutex> con_guard(con_mtx);
+            UpdateSubscribers();
+        }
+        SubscriptionSend(hdl,session);
+    }
+
+    /*
+     * name: SubscriptionSend(websocketpp::connection_hdl hdl,const SessionPtr &session)
+     * @param hdl:客户端句柄
+     * @param session:客户端会话
+     * describe: Tell the client what it is subscribed to
+     * 描述：返回该客户端当前订阅的主题
+     */
+    void WSSERVER::SubscriptionSend(websocketpp::connection_hdl hdl,const SessionPtr &session)
+    {
+        Json::Value Root;
+        Root["result"] = Json::Value(1);
+        Root["code"] = Json::Value();
+        Root["Event"] = Json::Value("Subscriptions");
+        Root["Subscriptions"] = SubscriptionJson(*session);
+        sendTo(hdl,WriteJson(Root,session->StyledJson));
     }
 
     /*
@@ -610,21 +1714,20 @@ namespace AstroAir
             profile["name"] = Json::Value(FileBuf[i]);
             Root["ParamRet"]["list"].append(profile);
         }
-        send(Root.toStyledString());
-        SS->thread_num--;
+        send(Root);
     }
 
     /*
      * name: SetupConnect(int timeout)
-     * @param timeout:连接相机最长时间
+     * @param timeout:每个设备重试连接的最长时间(秒)，只在两次尝试之间检查
      * describe: All connection profiles in the device
-     * 描述：连接配置文件中的所有设备
-     * calls: Connect(std::string Device_name)
+     * 描述：连接配置文件中的所有设备，各设备同时连接
+     * calls: ConnectDevice()
      * calls: IDLog(const char *fmt, ...)
-     * calls: IDLog_DEBUG(const char *fmt, ...)
-     * calls: UnknownCamera()
-     * calls: UnknownMount()
-     * note: If it times out, an error message is returned
+     * calls: UnknownDevice()
+     * note: Each device reports its own DeviceConnect event, the whole call
+     *       takes about as long as the slowest device. Success is only reported
+     *       when every device connected, otherwise the result lists the failed ones.
      */
     void WSSERVER::SetupConnect(int timeout)
     {
@@ -643,6 +1746,7 @@ namespace AstroAir
         if (!in.is_open())
         {
             IDLog_Error(_("Unable to open configuration file\n"));
+            SetupConnectError(8);
             return;
         }
         /*将文件转化为string格式*/
@@ -650,412 +1754,261 @@ namespace AstroAir
             jsonStr.append(line);
         /*关闭文件*/
         in.close();
-        /*将读取出的json数组转化为string*/
+        /*将读取出的json数组转化为string，配置文件使用独立的文档，不与客户端命令共享*/
+        Json::Value root;
+        Json::String errs;
+        Json::CharReaderBuilder reader;
         std::unique_ptr<Json::CharReader>const json_read(reader.newCharReader());
         json_read->parse(jsonStr.c_str(), jsonStr.c_str() + jsonStr.length(), &root,&errs);
-        bool connect_ok = false;
-        auto start = std::chrono::high_resolution_clock::now();     //开始计时
-        /*连接指定品牌的指定型号相机*/
-        if(!AIRCAMINFO->isCameraConnected)
+        if(timeout <= 0)
+            timeout = 15;
+        /*需要连接的设备，原有格式中的设备为主设备，"devices"中可以添加更多设备实例*/
+        struct PlannedDevice
         {
-            Camera_name = root["camera"]["name"].asString();
-            if(!root["camera"]["brand"].asString().empty() && !Camera_name.empty())
-            {
-                switch(hash_(root["camera"]["brand"].asString().c_str()))
-                {
-                    #ifdef HAS_ASI
-                    {
-                        case "ZWOASI"_hash:
-                        {
-                            /*初始化ASI相机，并赋值CCD*/
-                            ASICCD *ASICamera = new ASICCD(AIRCAMINFO);
-                            CCD = ASICamera;
-                            ASICamera = nullptr;
-                            break;
-                        }
-                        break;
-                    }
-                    #endif
-                    #ifdef HAS_QHY
-                    {
-                        case "QHYCCD"_hash:
-                        {
-                            /*初始化QHY相机，并赋值CCD*/
-                            QHYCCD *QHYCamera = new QHYCCD(AIRCAMINFO);
-                            CCD = QHYCamera;
-                            QHYCamera = nullptr;
-                            break;
-                        }
-                    }
-                    #endif
-                    #ifdef HAS_INDI
-                    {
-                        case "INDI"_hash:
-                        {
-                            /*初始化INDI相机，并赋值CCD*/
-                            INDICCD *INDIDevice = new INDICCD();
-                            CCD = INDIDevice;
-                            INDIDevice = nullptr;
-                            break;
-                        }
-                    }
-                    #endif
-                    #ifdef HAS_GPhoto2
-                    {
-                        case "GPhoto2"_hash:
-                        {
-                            /*初始化GPhoto2相机，并赋值CCD*/
-                            GPhotoCCD *GPhotoCamera = new GPhotoCCD(AIRCAMINFO);
-                            CCD = GPhotoCamera;
-                            GPhotoCamera = nullptr;
-                            break;
-                        }
-                    }
-                    #endif
-                    default:
-                    {
-                        UnknownDevice(301, _("Unknown camera")); //未知相机返回错误信息
-                        goto error_c;
-                        break;
-                    }
-                }
-                for(int i=1;i<=3;i++)
-                {
-                    if(i == 3)
-                    {
-                        /*相机未连接成功，返回错误信息*/
-                        SetupConnectError(5);
-                        WebLog(_("Could not connect to ") + Camera_name,3);
-                        connect_ok = false;
-                        break;
-                    }
-                    else
-                    {
-                        if(CCD->Connect(Camera_name))
-                        {
-                            AIRCAMINFO->isCameraConnected = true;
-                            if(IsGUI)
-                                CCD->CameraGUI((bool *)&IsGUI);
-                            DeviceBuf[DeviceNum] = CCD->ReturnDeviceName();
-                            WebLog(_("Connect to ")+DeviceBuf[DeviceNum]+_(" successfully"),2);
-                            DeviceNum++;
-                            connect_ok = true;
-                            break;
-                        }
-                    }
-                    sleep(4);
-                }
-            }
-        }
-        else
+            std::string id;
+            DeviceType type;
+            std::string brand;
+            std::string name;
+        };
+        std::vector<PlannedDevice> planned;
+        const char *Keys[] = {"camera","mount","focus","filter","Guide"};
+        for(int i = 0;i < (int)DeviceType::TypeNum;i++)
         {
-            WebLog(Camera_name + _(" had already connected"),3);
+            const Json::Value &dev = root[Keys[i]];
+            if(!dev["brand"].asString().empty() && !dev["name"].asString().empty())
+                planned.push_back({DeviceTypeName((DeviceType)i),(DeviceType)i,dev["brand"].asString(),dev["name"].asString()});
         }
-        error_c:{}
-        /*连接指定品牌的指定型号赤道仪*/
-        if(!isMountConnected)
+        for(auto &dev : root["devices"])
         {
-            Mount_name = root["mount"]["name"].asString();
-            if(!root["mount"]["brand"].asString().empty() && !Mount_name.empty())
+            DeviceType type;
+            if(!ParseDeviceType(dev["type"].asString(),type) || dev["id"].asString().empty())
             {
-                switch(hash_(root["mount"]["brand"].asString().c_str()))
-				{
-					/*初始化iOptron赤道仪，并赋值MOUNT*/
-					#ifdef HAS_IOPTRON
-					case "iOptron"_hash:{
-						IEQPRO *iOptronMount = new IEQPRO();
-						MOUNT = iOptronMount;
-						iOptronMount = nullptr;
-						break;
-					}
-					#endif
-					#ifdef HAS_SKYWATCHER
-					case "SkyWatcher"_hash:{
-						/*初始化SkyWatcher赤道仪，并赋值MOUNT*/
-						SkyWatcher *SkyWatcherMount = new SkyWatcher();
-						MOUNT = SkyWatcherMount;
-                        SkyWatcherMount = nullptr;
-						break;
-					}
-					#endif
-					#ifdef HAS_INDI
-					case "INDIMount"_hash:{
-						/*初始化INDI赤道仪，并赋值MOUNT*/
-						INDICCD *INDIDevice = new INDICCD();
-						MOUNT = INDIDevice;
-						break;
-					}
-					#endif
-					default:
-                    {
-                        UnknownDevice(302,_("Unknown mount"));		//未知赤道仪返回错误信息
-                        goto error_m;
-						break;
-                    }
-				}
-                for(int i=1;i<=3;i++)
-                {
-                    if(i == 3)
-                    {
-                        /*赤道仪未连接成功，返回错误信息*/
-                        SetupConnectError(5);
-                        WebLog(_("Could not connect to ") + Mount_name,3);
-                        connect_ok = false;
-                        break;
-                    }
-                    else
-                    {
-                        if(MOUNT->Connect(Mount_name))
-                        {
-                            isMountConnected = true;
-                            DeviceBuf[DeviceNum] = MOUNT->ReturnDeviceName();
-                            WebLog("Connect to "+DeviceBuf[DeviceNum]+" successfully",2);
-                            DeviceNum++;
-                            connect_ok = true;
-                            break;
-                        }
-                    }
-                    sleep(4);
-                }
+                WebLog(_("Invalid device in configuration file"),3);
+                continue;
             }
+            planned.push_back({dev["id"].asString(),type,dev["brand"].asString(),dev["name"].asString()});
         }
-        else
-        {
-            WebLog(Mount_name+" had already connected",3);
-        }
-        error_m:{}
-        /*连接指定品牌的指定型号电动调焦座*/
-        if(!isFocusConnected)
+        std::atomic_bool connect_ok(false);
+        bool connected_before = false;
+        /*连接失败或无法创建驱动的设备*/
+        Json::Value failed(Json::arrayValue);
+        std::mutex failed_mtx;
+        std::vector<std::thread> threads;
+        OperationPtr op = CurrentOperation();
+        auto start = std::chrono::high_resolution_clock::now();     //开始计时
+        for(auto &item : planned)
         {
-            Focus_name = root["focus"]["name"].asString();
-            if(!root["focus"]["brand"].asString().empty() && !Focus_name.empty())
+            DevicePtr old = DEVICES.Find(item.id);
+            if(old && old->Connected)
             {
-                switch(hash_(root["focus"]["brand"].asString().c_str()))
-				{
-					#ifdef HAS_ASIEAF
-					case "ASIEAF"_hash:{
-						/*初始化EAF电动调焦座，并赋FOCUS*/
-						EAF *EAFFOCUS = new EAF();
-						FOCUS = EAFFOCUS;
-                        EAFFOCUS = nullptr;
-						break;
-					}
-					#endif
-					#ifdef HAS_GRUS
-					case "Grus"_hash:{
-						/*初始化Grus电动调焦座，并赋FOCUS*/
-                        GRUS *GRUSFOCUS = new GRUS();
-						FOCUS = GRUSFOCUS;
-						GURSFOCUS = nullptr;
-						break;
-					}
-					#endif
-					#ifdef HAS_INDI
-					case "INDIFocus"_hash:{
-						/*初始化INDI电动调焦座，并赋FOCUS*/
-						INDICCD *INDIDevice = new INDICCD();
-						FOCUS = INDIDevice;
-						break;
-					}
-					#endif
-					default:
-                    {
-                        UnknownDevice(303,_("Unknown focus"));		//未知电动调焦座返回错误信息
-                        goto error_ff;
-						break;
-                    }	
-				}
-                for(int i = 0;i<=3;i++)
-                {
-                    if(i == 3)
-                    {
-                        /*电动调焦座未连接成功，返回错误信息*/
-                        SetupConnectError(5);
-                        WebLog("Could not connect to "+Focus_name,3);
-                        connect_ok = false;
-                        break;
-                    }
-                    else
-                    {
-                        if(FOCUS->Connect(Focus_name))
-                        {
-                            isFocusConnected = true;
-                            DeviceBuf[DeviceNum] = FOCUS->ReturnDeviceName();
-                            WebLog("Connect to "+DeviceBuf[DeviceNum]+" successfully",2);
-                            DeviceNum++;
-                            connect_ok = true;
-                            break;
-                        }
-                    }
-                    sleep(4);
-                }
+                WebLog(item.name + _(" had already connected"),3);
+                connected_before = true;
+                continue;
             }
-        }
-        else
-        {
-            WebLog(Focus_name+" had already connected",3);
-        }
-        error_ff:{}
-        /*连接指定品牌的指定型号滤镜轮*/
-        if(!isFilterConnected)
-        {
-            Filter_name = root["filter"]["name"].asString();
-            if(!root["filter"]["brand"].asString().empty() && !Filter_name.empty())
+            /*初始化指定品牌的驱动*/
+            DevicePtr dev = DEVICES.Create(item.id,item.type,item.brand,item.name);
+            if(!dev)
             {
-                switch(hash_(root["filter"]["brand"].asString().c_str()))
-				{
-					#ifdef HAS_ASIEFW
-					case "ASIEFW"_hash:{
-						/*初始化EFW滤镜轮，并赋FILTER*/
-						EFW *EFWFILTER = new EFW();
-						FILTER = EFWFILTER;
-                        EFWFILTER = nullptr;
-						break;
-					}
-					#endif
-					#ifdef HAS_QHYCFW
-					case "QHYCFW"_hash:{
-						/*初始化QHY滤镜轮，并赋FILTER*/
-						CFW *CFWFILTER = new CFW();
-						FILTER = CFWFILTER;
-                        CFWFILTER = nullptr;
-						break;
-					}
-					#endif
-					#ifdef HAS_INDI
-					case "INDIFilter"_hash:{
-						/*初始化INDI滤镜轮，并赋FILTER*/
-						INDICCD *INDIDevice = new INDICCD();
-						FILTER = INDIDevice;
-						break; 
-					}
-					#endif
-					default:
-                    {
-                        UnknownDevice(304,_("Unknown filter"));		//未知滤镜轮返回错误信息
-                        goto error_f;
-						break;
-                    }
-				}
-                for(int i = 1;i<=3;i++)
-                {
-                    if(i == 3)
-                    {
-                        /*滤镜轮未连接成功，返回错误信息*/
-                        SetupConnectError(5);
-                        WebLog("Could not connect to "+Filter_name,3);
-                        connect_ok = false;
-                        break;
-                    }
-                    else
-                    {
-                        if(FILTER->Connect(Filter_name))
-                        {
-                            isFilterConnected = true;
-                            DeviceBuf[DeviceNum] = FILTER->ReturnDeviceName();
-                            WebLog("Connect to "+DeviceBuf[DeviceNum]+" successfully",2);
-                            DeviceNum++;
-                            connect_ok = true;
-                            break;
-                        }
-                    }
-                    sleep(4);
-                }
+                UnknownDevice(301 + (int)item.type,_("Unknown ") + std::string(DeviceTypeName(item.type)) + ": " + item.brand);
+                failed.append(item.id);
+                continue;
             }
-        }
-        else
-        {
-            WebLog(Filter_name+_(" had already connected"),3);
-        }
-        error_f:{}
-        /*连接指定品牌的指定型号导星软件*/
-        if(!isGuideConnected)
-        {
-            Guide_name = root["Guide"]["name"].asString();
-            if(!root["Guide"]["brand"].asString().empty() && !Guide_name.empty())
+            /*所有设备的连接线程属于同一个请求*/
+            threads.emplace_back([this,op,dev,timeout,&connect_ok,&failed,&failed_mtx]
             {
-                switch(hash_(root["Guide"]["brand"].asString().c_str()))
+                OperationScope scope(op);
+                if(ConnectDevice(dev,timeout))
                 {
-                    /*Max：事实上我们一般只会使用PHD2，所以LinGuider可以等其他做好以后再做*/
-                    case "PHD2"_hash:
-                    {
-                        PHD2 *PHD2Guider = new PHD2();
-                        GUIDE = PHD2Guider;
-                        PHD2Guider = nullptr;
-                        break;
-                    }
-                    default:
-                    {
-                        UnknownDevice(305, _("Unknown guide server")); //未知导星软件返回错误信息
-                        goto error_g;
-                        break;
-                    }
-                        
+                    if(dev->Type == DeviceType::Camera && dev->IsPrimary() && IsGUI)
+                        dev->Camera->CameraGUI((bool *)&IsGUI);
+                    connect_ok = true;
                 }
-                for(int i = 1;i<=3;i++)
+                else
                 {
-                    if(i == 3)
-                    {
-                        /*导星软件未连接成功，返回错误信息*/
-                        SetupConnectError(5);
-                        WebLog(_("Could not connect to ")+root["Guide"]["brand"].asString(),3);
-                        connect_ok = false;
-                        break;
-                    }
-                    else
-                    {
-                        if(GUIDE->Connect(Guide_name))
-                        {
-                            isGuideConnected = true;
-                            DeviceBuf[DeviceNum] = GUIDE->ReturnDeviceName();
-                            WebLog(_("Connect to ")+DeviceBuf[DeviceNum]+_(" successfully"),2);
-                            DeviceNum++;
-                            connect_ok = true;
-                            break;
-                        }
-                    }
-                    sleep(4);
+                    std::lock_guard<std::mutex> guard(failed_mtx);
+                    failed.append(dev->ID);
                 }
-            }
+            });
         }
-        else
+        /*等待所有设备连接完成*/
+        for(auto &t : threads)
         {
-            WebLog(root["Guide"]["brand"].asString()+_(" had already connected"),3);
+            if(t.joinable())
+                t.join();
         }
-        error_g:{}
         auto end = std::chrono::high_resolution_clock::now();       //停止计时
         std::chrono::duration<double> diff = end - start;
         IDLog(_("Connecting to device took %g seconds\n"), diff.count());
-        if(diff.count() >= 50)
+        TelemetryChanged();
+        /*有设备在线时开始发送环境和遥测信息*/
+        if(connect_ok || connected_before)
         {
-            SetupConnectError(8);
-            SS->thread_num--;
-            return;
+            EnvironmentDataSend();
+            /*遥测线程只需要启动一次*/
+            if(!Running.exchange(true))
+            {
+                std::thread ControlDataThread(&WSSERVER::ControlDataSend,this);
+                ControlDataThread.detach();
+            }
         }
-        /*判断设备是否完全连接成功*/
-        if(connect_ok)
+        /*无论是否启动了连接线程，客户端都会收到一个最终结果，只有所有设备都连接成功时才视为成功*/
+        if(failed.empty() && (connect_ok || connected_before))
         {
-            SetupConnectSuccess();		//将连接上的设备列表发送给客户端
-            EnvironmentDataSend();
-            Running = true;
+            SetupConnectSuccess();
             WebLog(_("All devices connected successfully"),2);
-            std::thread ControlDataThread(&WSSERVER::ControlDataSend,this);
-            ControlDataThread.detach();
         }
         else
         {
-            SetupConnectError(5);
-            WebLog(_("There were some errors in connecting the device"),3);
+            /*每个设备的结果已经通过DeviceConnect发送，这里再列出失败的设备*/
+            std::string names;
+            for(auto &it : failed)
+                names += (names.empty() ? "" : ", ") + it.asString();
+            WebLog(_("Some devices could not be connected: ") + names,3);
+            SetupConnectError(5,failed);
         }
-        SS->thread_num--;
         return;
     }
+
+    /*
+     * name: ConnectDevice(const DevicePtr &dev,int timeout)
+     * @param dev:设备实例
+     * @param timeout:最长重试时间(秒)
+     * describe: Connect one device, retry with exponential backoff until timeout
+     * 描述：连接单个设备，失败后等待时间逐次加倍，超过最长时间后放弃
+     * calls: DeviceConnectSend()
+     * note: The timeout is only checked between attempts. A single blocking
+     *       driver Connect() call is not interrupted and can run past it.
+     */
+    bool WSSERVER::ConnectDevice(const DevicePtr &dev,int timeout)
+    {
+        auto start = std::chrono::steady_clock::now();
+        auto deadline = start + std::chrono::seconds(timeout);
+        auto delay = std::chrono::milliseconds(250);
+        int attempts = 0;
+        bool ok = false;
+        while(true)
+        {
+            attempts++;
+            if((ok = dev->Connect()))
+                break;
+            OperationPtr op = CurrentOperation();
+            if(op && op->Cancelled)
+                break;
+            auto now = std::chrono::steady_clock::now();
+            if(now + delay >= deadline)
+                break;
+            IDLog(_("Could not connect to %s, retry in %d ms\n"),dev->Name.c_str(),(int)delay.count());
+            std::this_thread::sleep_for(delay);
+            delay = std::min(delay * 2,std::chrono::milliseconds(8000));
+        }
+        double used = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        if(ok)
+            WebLog(_("Connect to ")+dev->Name+_(" successfully"),2);
+        else
+            WebLog(_("Could not connect to ") + dev->Name,3);
+        DeviceConnectSend(dev,ok,attempts,used);
+        return ok;
+    }
+
+    /*
+     * name: DeviceConnectSend(const DevicePtr &dev,bool ok,int attempts,double used)
+     * describe: Report the result of one device
+     * 描述：单个设备连接完成后立即通知客户端
+     */
+    void WSSERVER::DeviceConnectSend(const DevicePtr &dev,bool ok,int attempts,double used)
+    {
+        Json::Value Root;
+        Root["Event"] = Json::Value("DeviceConnect");
+        Root["UID"] = Json::Value("RemoteSetupConnect");
+        Root["Device"] = Json::Value(dev->ID);
+        Root["Type"] = Json::Value(DeviceTypeName(dev->Type));
+        Root["Name"] = Json::Value(dev->Name);
+        Root["Result"] = Json::Value(ok ? 1 : 0);
+        Root["Attempts"] = Json::Value(attempts);
+        Root["UsedTime"] = Json::Value(used);
+        send(Root);
+    }
+
+    /*
+     * name: RegisterBuiltinDrivers()
+     * describe: Register the drivers built into the server
+     * 描述：注册编译时启用的驱动，品牌名称与配置文件中的brand一致
+     * note: Other drivers can be provided by plugins
+     */
+    void WSSERVER::RegisterBuiltinDrivers()
+    {
+        /*相机*/
+        #ifdef HAS_ASI
+        DEVICES.RegisterDriver(DeviceType::Camera,"ZWOASI",[](DeviceInstance &dev){return (dev.Camera = new ASICCD(dev.Info)) != nullptr;});
+        #endif
+        #ifdef HAS_QHY
+        DEVICES.RegisterDriver(DeviceType::Camera,"QHYCCD",[](DeviceInstance &dev){return (dev.Camera = new QHYCCD(dev.Info)) != nullptr;});
+        #endif
+        #ifdef HAS_INDI
+        DEVICES.RegisterDriver(DeviceType::Camera,"INDI",[](DeviceInstance &dev){return (dev.Camera = new INDICCD()) != nullptr;});
+        #endif
+        #ifdef HAS_GPhoto2
+        DEVICES.RegisterDriver(DeviceType::Camera,"GPhoto2",[](DeviceInstance &dev){return (dev.Camera = new GPhotoCCD(dev.Info)) != nullptr;});
+        #endif
+        #ifdef HAS_SIMULATOR
+        DEVICES.RegisterDriver(DeviceType::Camera,"Simulator",[](DeviceInstance &dev){return (dev.Camera = new SIMCCD(dev.Info)) != nullptr;});
+        #endif
+        /*赤道仪*/
+        #ifdef HAS_IOPTRON
+        DEVICES.RegisterDriver(DeviceType::Mount,"iOptron",[](DeviceInstance &dev){return (dev.Mount = new IEQPRO()) != nullptr;});
+        #endif
+        #ifdef HAS_SKYWATCHER
+        DEVICES.RegisterDriver(DeviceType::Mount,"SkyWatcher",[](DeviceInstance &dev){return (dev.Mount = new SkyWatcher()) != nullptr;});
+        #endif
+        #ifdef HAS_INDI
+        DEVICES.RegisterDriver(DeviceType::Mount,"INDIMount",[](DeviceInstance &dev){return (dev.Mount = new INDICCD()) != nullptr;});
+        #endif
+        /*电动调焦座*/
+        #ifdef HAS_ASIEAF
+        DEVICES.RegisterDriver(DeviceType::Focus,"ASIEAF",[](DeviceInstance &dev){return (dev.Focus = new EAF()) != nullptr;});
+        #endif
+        #ifdef HAS_GRUS
+        DEVICES.RegisterDriver(DeviceType::Focus,"Grus",[](DeviceInstance &dev){return (dev.Focus = new GRUS()) != nullptr;});
+        #endif
+        #ifdef HAS_INDI
+        DEVICES.RegisterDriver(DeviceType::Focus,"INDIFocus",[](DeviceInstance &dev){return (dev.Focus = new INDICCD()) != nullptr;});
+        #endif
+        /*滤镜轮*/
+        #ifdef HAS_ASIEFW
+        DEVICES.RegisterDriver(DeviceType::Filter,"ASIEFW",[](DeviceInstance &dev){return (dev.Filter = new EFW()) != nullptr;});
+        #endif
+        #ifdef HAS_QHYCFW
+        DEVICES.RegisterDriver(DeviceType::Filter,"QHYCFW",[](DeviceInstance &dev){return (dev.Filter = new CFW()) != nullptr;});
+        #endif
+        #ifdef HAS_INDI
+        DEVICES.RegisterDriver(DeviceType::Filter,"INDIFilter",[](DeviceInstance &dev){return (dev.Filter = new INDICCD()) != nullptr;});
+        #endif
+        /*导星软件，Max：事实上我们一般只会使用PHD2，所以LinGuider可以等其他做好以后再做*/
+        DEVICES.RegisterDriver(DeviceType::Guider,"PHD2",[](DeviceInstance &dev){return (dev.Guider = new PHD2()) != nullptr;});
+    }
+
+    /*
+     * name: GetDevices(websocketpp::connection_hdl hdl)
+     * @param hdl:客户端句柄
+     * describe: List device instances and available drivers
+     * 描述：返回所有设备实例及可用的驱动
+     */
+    void WSSERVER::GetDevices(websocketpp::connection_hdl hdl)
+    {
+        Json::Value Root = DEVICES.ToJson();
+        Root["Event"] = Json::Value("RemoteActionResult");
+        Root["UID"] = Json::Value("RemoteGetDevices");
+        Root["ActionResultInt"] = Json::Value(4);
+        sendTo(hdl,WriteJson(Root,false));
+    }
     
     /*
      * name: SetupDisconnect(int timeout)
      * describe: Disconnect from devices
      * @param tiemout:Max time
-     * 描述： 与设备断开连接
+     * 描述： 与设备断开连接，并移除所有设备实例
+     * note: Removed drivers stay allocated until shutdown, threads started by
+     *       earlier commands may still be using them
      * calls: Disconnect()
      * calls: WebLog()
      * calls: SetupDisconnectSuccess()
@@ -1063,57 +2016,29 @@ namespace AstroAir
     void WSSERVER::SetupDisconnect(int timeout)
     {
         bool disconnect_ok = false;
-        if(AIRCAMINFO->isCameraConnected)
-        {
-            if((disconnect_ok = CCD->Disconnect()))
-                WebLog(_("Disconnect from ")+Camera_name,2);
-            else
-                WebLog(_("Could not Disconnect from ")+Camera_name,3);
-            AIRCAMINFO->isCameraConnected = false;
-            CCD = nullptr;
-        }
-        if(isMountConnected)
-        {
-            if((disconnect_ok = MOUNT->Disconnect()))
-                WebLog(_("Disconnect from ")+Mount_name,2);
-            else
-                WebLog(_("Could not Disconnect from ")+Mount_name,3);
-            isMountConnected = false;
-            MOUNT = nullptr;
-        }
-        if(isFocusConnected)
-        {
-            if((disconnect_ok = FOCUS->Disconnect()))
-                WebLog(_("Disconnect from ")+Focus_name,2);
-            else
-                WebLog(_("Could not Disconnect from ")+Focus_name,3);
-            isFocusConnected = false;
-            FOCUS = nullptr;
-        }
-        if(isFilterConnected)
+        for(auto &dev : DEVICES.List())
         {
-            if((disconnect_ok = FILTER->Disconnect()))
-                WebLog(_("Disconnect from ")+Filter_name,2);
-            else
-                WebLog(_("Could not Disconnect from ")+Filter_name,3);
-            isFilterConnected = false;
-            FILTER = nullptr;
-        }
-        if(isGuideConnected)
-        {
-            if((disconnect_ok = GUIDE->Disconnect()))
-                WebLog(_("Disconnect from ")+Guide_name,2);
-            else
-                WebLog(_("Could not Disconnect from ")+Guide_name,3);
-            isGuideConnected = false;
-            GUIDE = nullptr;
+            if(dev->Connected)
+            {
+                /*相机队列中的序列拍摄不再开始新的曝光*/
+                if(dev->Camera)
+                    dev->Camera->StopSequence();
+                if(dev->Disconnect())
+                {
+                    disconnect_ok = true;
+                    WebLog(_("Disconnect from ")+dev->Name,2);
+                }
+                else
+                    WebLog(_("Could not Disconnect from ")+dev->Name,3);
+            }
+            DEVICES.Remove(dev->ID);
         }
+        TelemetryChanged();
         if(disconnect_ok)
         {
             WebLog(_("Successfully disconnected from all devices"),2);
             SetupDisconnectSuccess();
         }
-        SS->thread_num--;
     }
 
     /*
@@ -1129,7 +2054,7 @@ namespace AstroAir
         Root["Event"] = Json::Value("RemoteActionResult");
         Root["UID"] = Json::Value("RemoteGetFilterConfiguration");
         Root["ActionResultInt"] = Json::Value(4);
-        send(Root.toStyledString());
+        send(Root);
     }
 
     /*
@@ -1145,73 +2070,192 @@ namespace AstroAir
         Root["Event"] = Json::Value("RemoteActionResult");
         Root["UID"] = Json::Value("RemoteGetEnvironmentData");
         Root["ActionResultInt"] = Json::Value(4);
-        for(int i = 0;i<DeviceNum;i++)
-            Root["ParamRet"].append(DeviceBuf[i]);
-        send(Root.toStyledString());
+        for(auto &dev : DEVICES.List())
+        {
+            if(dev->Connected)
+                Root["ParamRet"].append(dev->DeviceName());
+        }
+        send(Root);
     }
 
+    /*
+     * name: ControlDataSend()
+     * describe: Telemetry publisher
+     * 描述：遥测信息发布线程
+     * note: Old clients still get the full ControlData every second.
+     *       Delta clients get changed fields as soon as they are noticed,
+     *       and a full keyframe every TelemetryKeyframe seconds.
+     *       A client may ask for a slower rate, or no telemetry at all.
+     */
     void WSSERVER::ControlDataSend()
     {
+        const auto FullInterval = std::chrono::seconds(1);
+        const auto SampleInterval = std::chrono::milliseconds(100);
+        const auto KeyframeInterval = std::chrono::seconds(SS->TelemetryKeyframe > 0 ? SS->TelemetryKeyframe : 10);
         while(Running)
         {
-            Json::Value Root;
-            Root["Event"] = Json::Value("ControlData");
-            if(AIRCAMINFO->isCameraConnected)
-                Root["CCDCONN"] = Json::Value(1);
-            else
-                Root["CCDCONN"] = Json::Value(0);
-            Root["PLACONN"] = Json::Value(1);
-            if(AIRCAMINFO->isCameraCoolingOn)
-                Root["CCDCOOL"] = Json::Value(1);
-            else
-                Root["CCDCOOL"] = Json::Value(0);
-            if(isGuideConnected)
-                Root["GUIDECONN"] = Json::Value(1);
-            else
-                Root["GUIDECONN"] = Json::Value(0);
-            if(IsGuiding)
+            /*没有客户端订阅遥测信息时不采集设备状态*/
+            if(Subscribed(Topic::Telemetry))
             {
-                Root["GUIDEX"] = Json::Value(Guide_RA);
-                Root["GUIDEY"] = Json::Value(Guide_DEC);
+                Json::Value Root = ControlDataSnapshot();
+                auto now = std::chrono::steady_clock::now();
+                OutboundQueue::Payload full[2];
+                for (auto &it : *Sessions())
+                {
+                    if(!it->Telemetry)
+                        continue;
+                    int style = it->StyledJson,interval = it->TelemetryInterval;
+                    auto MinInterval = interval >= 0 ? std::chrono::milliseconds(interval) : (it->DeltaTelemetry ? std::chrono::milliseconds(0) : std::chrono::milliseconds(FullInterval));
+                    if(now - it->TelemetrySent < MinInterval)
+                        continue;
+                    if(!it->DeltaTelemetry)
+                    {
+                        /*切换到增量模式时重新从完整信息开始*/
+                        it->LastTelemetry = Json::Value();
+                        if(!full[style])
+                            full[style] = std::make_shared<const std::string>(WriteJson(Root,style));
+                        Post(it,OutboundQueue::Telemetry,full[style]);
+                        it->TelemetrySent = now;
+                        continue;
+                    }
+                    /*发送队列丢弃过增量信息，下一次必须发送完整信息*/
+                    if(it->Out.TakeDropped(OutboundQueue::Telemetry))
+                        it->LastTelemetry = Json::Value();
+                    if(it->LastTelemetry.isNull() || now - it->Keyframe >= KeyframeInterval)
+                    {
+                        Json::Value Keyframe = Root;
+                        Keyframe["Keyframe"] = Json::Value(1);
+                        Post(it,OutboundQueue::Telemetry,std::make_shared<const std::string>(WriteJson(Keyframe,style)));
+                        it->LastTelemetry = Root;
+                        it->Keyframe = it->TelemetrySent = now;
+                        continue;
+                    }
+                    Json::Value Delta = ControlDataDelta(it->LastTelemetry,Root);
+                    if(!Delta.isNull())
+                    {
+                        Post(it,OutboundQueue::Telemetry,std::make_shared<const std::string>(WriteJson(Delta,style)));
+                        it->LastTelemetry = Root;
+                        it->TelemetrySent = now;
+                    }
+                }
+            }
+            /*等待下一次采样，设备状态变化时提前唤醒*/
+            std::unique_lock<mutex> lock(telemetry_mtx);
+            telemetry_cond.wait_for(lock,SampleInterval,[this]{return telemetry_changed || !Running;});
+            telemetry_changed = false;
+        }
+    }
+
+    /*
+     * name: ControlDataSnapshot()
+     * describe: Collect the current device status
+     * 描述：采集当前设备状态
+     */
+    Json::Value WSSERVER::ControlDataSnapshot()
+    {
+        Json::Value Root;
+        Root["Event"] = Json::Value("ControlData");
+        if(AIRCAMINFO->isCameraConnected)
+            Root["CCDCONN"] = Json::Value(1);
+        else
+            Root["CCDCONN"] = Json::Value(0);
+        Root["PLACONN"] = Json::Value(1);
+        if(AIRCAMINFO->isCameraCoolingOn)
+            Root["CCDCOOL"] = Json::Value(1);
+        else
+            Root["CCDCOOL"] = Json::Value(0);
+        if(isGuideConnected)
+            Root["GUIDECONN"] = Json::Value(1);
+        else
+            Root["GUIDECONN"] = Json::Value(0);
+        if(IsGuiding)
+        {
+            Root["GUIDEX"] = Json::Value(Guide_RA);
+            Root["GUIDEY"] = Json::Value(Guide_DEC);
+        }
+        if(isFocusConnected)
+            Root["AFCONN"] = Json::Value(1);
+        else
+            Root["AFCONN"] = Json::Value(0);
+        Root["SETUPCONN"] = Json::Value(1);
+        if(isSolverConnected)
+            Root["PSCONN"] = Json::Value(1);
+        else
+            Root["PSCONN"] = Json::Value(0);
+        if(isMountTracking)
+            Root["MNTTRACK"] = Json::Value(1);
+        else
+            Root["MNTTRACK"] = Json::Value(0);
+        if(isMountParked)
+            Root["MNTPARK"] = Json::Value(1);
+        else
+            Root["MNTPARK"] = Json::Value(0);
+        Root["MNTTFLIP"] = Json::Value(1);
+        if(isMountSlewing)
+            Root["MNTSLEW"] = Json::Value(1);
+        else
+            Root["MNTSLEW"] = Json::Value(0);
+        Root["AFTEMP"] = Json::Value(FocusTemp);
+        Root["AFPOS"] = Json::Value(FocusPosition);
+        Root["CCDSTAT"] = Json::Value(1);
+        if(POOL->Active() + POOL->Pending() == 0)
+            Root["AIRSTAT"] = Json::Value(1);
+        else
+            Root["AIRSTAT"] = Json::Value(0);
+        Root["RUNSEQ"] = Json::Value("");
+        Root["RUNDS"] = Json::Value("");
+        if(isMountConnected)
+            Root["MNTCONN"] = Json::Value(1);
+        else
+            Root["MNTCONN"] = Json::Value(0);
+        return Root;
+    }
+
+    /*
+     * name: ControlDataDelta(const Json::Value &last,const Json::Value &now)
+     * @param last:客户端最后收到的信息
+     * @param now:当前设备状态
+     * describe: Build a message with only the changed fields
+     * 描述：生成只包含变化字段的信息，没有变化时返回null
+     * note: Fields which disappeared are listed in "Removed"
+     */
+    Json::Value WSSERVER::ControlDataDelta(const Json::Value &last,const Json::Value &now)
+    {
+        Json::Value Delta;
+        bool changed = false;
+        for (auto &name : now.getMemberNames())
+        {
+            if(!last.isMember(name) || last[name] != now[name])
+            {
+                Delta[name] = now[name];
+                changed = true;
             }
-            if(isFocusConnected)
-                Root["AFCONN"] = Json::Value(1);
-            else
-                Root["AFCONN"] = Json::Value(0);
-            Root["SETUPCONN"] = Json::Value(1);
-            if(isSolverConnected)
-                Root["PSCONN"] = Json::Value(1);
-            else
-                Root["PSCONN"] = Json::Value(0);
-            if(isMountTracking)
-                Root["MNTTRACK"] = Json::Value(1);
-            else
-                Root["MNTTRACK"] = Json::Value(0);
-            if(isMountParked)
-                Root["MNTPARK"] = Json::Value(1);
-            else
-                Root["MNTPARK"] = Json::Value(0);
-            Root["MNTTFLIP"] = Json::Value(1);
-            if(isMountSlewing)
-                Root["MNTSLEW"] = Json::Value(1);
-            else
-                Root["MNTSLEW"] = Json::Value(0);
-            Root["AFTEMP"] = Json::Value(FocusTemp);
-            Root["AFPOS"] = Json::Value(FocusPosition);
-            Root["CCDSTAT"] = Json::Value(1);
-            if(SS->thread_num == 0)
-                Root["AIRSTAT"] = Json::Value(1);
-            else
-                Root["AIRSTAT"] = Json::Value(0);
-            Root["RUNSEQ"] = Json::Value("");
-            Root["RUNDS"] = Json::Value("");
-            if(isMountConnected)
-                Root["MNTCONN"] = Json::Value(1);
-            else
-                Root["MNTCONN"] = Json::Value(0);
-            send(Root.toStyledString());
-            sleep(1);
         }
+        for (auto &name : last.getMemberNames())
+        {
+            if(!now.isMember(name))
+            {
+                Delta["Removed"].append(name);
+                changed = true;
+            }
+        }
+        if(!changed)
+            return Json::Value();
+        Delta["Event"] = Json::Value("ControlData");
+        Delta["Delta"] = Json::Value(1);
+        return Delta;
+    }
+
+    /*
+     * name: NotifyTelemetry()
+     * describe: Wake up the telemetry publisher
+     * 描述：唤醒遥测线程，立即推送变化
+     */
+    void WSSERVER::NotifyTelemetry()
+    {
+        lock_guard<mutex> guard(telemetry_mtx);
+        telemetry_changed = true;
+        telemetry_cond.notify_one();
     }
 
     /*
@@ -1229,19 +2273,20 @@ namespace AstroAir
         Root["Event"] = Json::Value("RemoteActionResult");
         Root["UID"] = Json::Value("RemoteSetupConnect");
         Root["ActionResultInt"] = Json::Value(4);
-        send(Root.toStyledString());
-        isConnected = true;
+        send(Root);
     }
     
     /*
-     * name: SetupConnectError(int id)
+     * name: SetupConnectError(int id,const Json::Value &failed)
+     * @param id:错误代码
+     * @param failed:连接失败的设备实例名称，可以为空
      * describe: Error handling connection to device
      * 描述：处理连接设备时的错误
      * calls: IDLog(const char *fmt, ...)
      * calls: IDLog_DEBUG(const char *fmt, ...)
      * calls: send()
      */
-    void WSSERVER::SetupConnectError(int id)
+    void WSSERVER::SetupConnectError(int id,const Json::Value &failed)
     {
         IDLog_Error(_("Unable to connect device\n"));
         /*整合信息并发送至客户端*/
@@ -1249,7 +2294,9 @@ namespace AstroAir
         Root["Event"] = Json::Value("RemoteActionResult");
         Root["UID"] = Json::Value("RemoteSetupConnect");
         Root["ActionResultInt"] = Json::Value(id);
-        send(Root.toStyledString());
+        if(!failed.empty())
+            Root["ParamRet"]["Failed"] = failed;
+        send(Root);
     }
 
     /*
@@ -1261,17 +2308,13 @@ namespace AstroAir
      */
     void WSSERVER::SetupDisconnectSuccess()
     {
-        /*防止多次连接导致错误*/
-        memset(DeviceBuf,0,5);
-        DeviceNum = 0;
         IDLog(_("Successfully disconnect from devices\n"));
         /*整合信息并发送至客户端*/
         Json::Value Root;
         Root["Event"] = Json::Value("RemoteActionResult");
         Root["UID"] = Json::Value("RemoteSetupDisconnect");
         Root["ActionResultInt"] = Json::Value(4);
-        send(Root.toStyledString());
-        isConnected = false;
+        send(Root);
     }
 
 //----------------------------------------日志----------------------------------------
@@ -1286,26 +2329,41 @@ namespace AstroAir
 	 */
     void WebLog(std::string message,int type)
     {
+        /*没有客户端需要该类型的日志*/
+        if(!ws.Subscribed(Topic::Logs,type))
+            return;
         Json::Value Root;
         Root["Event"] = Json::Value("LogEvent");
         Root["Type"] = Json::Value(type);
         Root["Text"] = Json::Value(message);
         Root["TimeInfo"] = Json::Value(timestamp());
-        ws.send(Root.toStyledString());
+        ws.Publish(Topic::Logs,Root,type);
+    }
+
+    /*
+     * name: TelemetryChanged()
+     * describe: Tell the telemetry thread that device state has changed
+     * 描述：设备状态发生变化，通知遥测线程立即推送，不必等到下一个周期
+     * calls: NotifyTelemetry()
+     */
+    void TelemetryChanged()
+    {
+        ws.NotifyTelemetry();
     }
 
 //----------------------------------------错误代码----------------------------------------
 
     /*
-     * name: UnknownMsg()
+     * name: UnknownMsg(websocketpp::connection_hdl hdl)
+     * @param hdl:发出信息的客户端
      * describe: Processing unknown information from clients
-     * 描述：处理来自客户端的未知信息
+     * 描述：处理来自客户端的未知信息，只回复给发送者
      * calls: IDLog(const char *fmt, ...)
      * calls: IDLog_DEBUG(const char *fmt, ...)
-     * calls: send()
+     * calls: ReplyTo()
 	 * note:If this function is executed, an error will appear on the web page
      */
-    void WSSERVER::UnknownMsg()
+    void WSSERVER::UnknownMsg(websocketpp::connection_hdl hdl)
     {
         IDLog_Error(_("An unknown message was received from the client\n"));
         /*整合信息并发送至客户端*/
@@ -1315,7 +2373,7 @@ namespace AstroAir
         Root["id"] = Json::Value(403);
         error["message"] = Json::Value(_("Unknown information"));
         Root["error"] = error;
-        send(Root.toStyledString());
+        ReplyTo(hdl,Root);
     }
     
     /*
@@ -1336,21 +2394,94 @@ namespace AstroAir
         Root["id"] = Json::Value(id);
         error["message"] = Json::Value(message);
         Root["error"] = error;
-        send(Root.toStyledString());
+        send(Root);
     }
 
-    void WSSERVER::ClientNumError()
+    /*
+     * name: ServerBusyError(websocketpp::connection_hdl hdl,std::string method)
+     * @param hdl:发出命令的客户端
+     * @param method:被拒绝的命令
+     * describe: Tell the client that the task pool is full
+     * 描述：任务池已满，拒绝执行命令
+     * calls: ReplyTo()
+     */
+    void WSSERVER::ServerBusyError(websocketpp::connection_hdl hdl,std::string method)
     {
-        IDLog_Error(_("There are too many clients connected with server\n"));
+        IDLog_Error(_("Task pool is full, reject command %s\n"),method.c_str());
         /*整合信息并发送至客户端*/
         Json::Value Root;
         Root["result"] = Json::Value(1);
 		Root["code"] = Json::Value();
-        Root["id"] = Json::Value(601);
-        Root["error"]["message"] = Json::Value(_("Too many client!"));
-        send(Root.toStyledString());
+        Root["id"] = Json::Value(602);
+        Root["method"] = Json::Value(method);
+        Root["error"]["message"] = Json::Value(_("Server is busy,please try again later!"));
+        ReplyTo(hdl,Root);
     }
-    
+
+    /*
+     * name: InvalidParamError(websocketpp::connection_hdl hdl,std::string method,std::string param)
+     * @param hdl:发出命令的客户端
+     * @param method:命令名称
+     * @param param:缺少或类型错误的参数
+     * describe: Reject a command with wrong parameters
+     * 描述：命令参数缺失或类型错误，不执行命令并返回错误
+     */
+    void WSSERVER::InvalidParamError(websocketpp::connection_hdl hdl,std::string method,std::string param)
+    {
+        IDLog_Error(_("Invalid parameter %s of command %s\n"),param.c_str(),method.c_str());
+        /*整合信息并发送至客户端*/
+        Json::Value Root;
+        Root["result"] = Json::Value(1);
+		Root["code"] = Json::Value();
+        Root["id"] = Json::Value(405);
+        Root["method"] = Json::Value(method);
+        Root["error"]["message"] = Json::Value(_("Missing or invalid parameter: ") + param);
+        ReplyTo(hdl,Root);
+    }
+
+    /*
+     * name: DeviceNotFoundError(websocketpp::connection_hdl hdl,std::string method,std::string device)
+     * @param hdl:发出命令的客户端
+     * @param method:命令名称
+     * @param device:设备实例名称
+     * describe: The command refers to a device which is not created
+     * 描述：命令指定的设备实例不存在
+     */
+    void WSSERVER::DeviceNotFoundError(websocketpp::connection_hdl hdl,std::string method,std::string device)
+    {
+        IDLog_Error(_("Device %s of command %s not found\n"),device.c_str(),method.c_str());
+        /*整合信息并发送至客户端*/
+        Json::Value Root;
+        Root["result"] = Json::Value(1);
+		Root["code"] = Json::Value();
+        Root["id"] = Json::Value(407);
+        Root["method"] = Json::Value(method);
+        Root["error"]["message"] = Json::Value(_("Device not found: ") + device);
+        ReplyTo(hdl,Root);
+    }
+
+    /*
+     * name: DuplicateRequestError(websocketpp::connection_hdl hdl,std::string method,const Json::Value &id)
+     * @param hdl:发出命令的客户端
+     * @param method:命令名称
+     * @param id:重复的RequestID
+     * describe: Reject a request whose ID is still in use
+     * 描述：RequestID对应的请求尚未完成，拒绝新的请求
+     */
+    void WSSERVER::DuplicateRequestError(websocketpp::connection_hdl hdl,std::string method,const Json::Value &id)
+    {
+        IDLog_Error(_("Request %s is still in progress, reject command %s\n"),OperationTable::IDKey(id).c_str(),method.c_str());
+        /*整合信息并发送至客户端*/
+        Json::Value Root;
+        Root["result"] = Json::Value(1);
+		Root["code"] = Json::Value();
+        Root["id"] = Json::Value(406);
+        Root["method"] = Json::Value(method);
+        Root["RequestID"] = id;
+        Root["error"]["message"] = Json::Value(_("RequestID is still in progress"));
+        ReplyTo(hdl,Root);
+    }
+
     void WSSERVER::ErrorCode()
     {
 		
@@ -1369,6 +2500,6 @@ namespace AstroAir
         Root["result"] = Json::Value(1);
 		Root["code"] = Json::Value();
         Root["Event"] = Json::Value("Polling");
-        send(Root.toStyledString());
+        send(Root);
     }
 }
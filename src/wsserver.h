@@ -41,6 +41,9 @@ Description:Main framework of astroair server
 #ifdef HAS_WEBSOCKET
 	#include <websocketpp/config/asio_no_tls.hpp>
 	#include <websocketpp/server.hpp>
+	#ifdef HAS_DEFLATE
+		#include <websocketpp/extensions/permessage_deflate/enabled.hpp>
+	#endif
 #endif
 
 #ifdef HAS_JSONCPP
@@ -51,19 +54,98 @@ Description:Main framework of astroair server
 	#include "libastro.h"
 #endif
 
+#include "tools/TaskPool.h"
+#include "air_message.h"
+#include "air_outbound.h"
+#include "air_command.h"
+#include "air_device.h"
+#include "tools/ImgPreview.h"
+
 #include <string>
 #include <set>
+#include <map>
+#include <unordered_map>
 #include <dirent.h>
 #include <vector>
 #include <chrono>
 #include <atomic>
 #include <fstream>
-
-#define MAXDEVICE 5
+#include <functional>
+#include <thread>
 
 #ifdef HAS_WEBSOCKET
+	/*
+		服务器配置
+		websocketpp::config::asio默认为每个连接创建strand，多个网络线程可以同时运行io_context
+	*/
+	#ifdef HAS_DEFLATE
+	/*客户端提出permessage-deflate时协商压缩，每条信息是否压缩由服务器决定*/
+	struct air_asio_config : public websocketpp::config::asio
+	{
+		typedef air_asio_config type;
+		struct permessage_deflate_config
+		{
+			typedef websocketpp::config::asio::request_type request_type;
+		};
+		typedef websocketpp::extensions::permessage_deflate::enabled<permessage_deflate_config> permessage_deflate_type;
+	};
+	typedef websocketpp::server<air_asio_config> airserver;
+	#else
 	typedef websocketpp::server<websocketpp::config::asio> airserver;
-	typedef std::set<websocketpp::connection_hdl, std::owner_less<websocketpp::connection_hdl>> con_list;
+	#endif
+	/*
+		客户端会话
+		在握手通过时创建，连接关闭时销毁，只保存与该客户端有关的状态，设备状态与客户端无关
+	*/
+	struct ClientSession
+	{
+		websocketpp::connection_hdl Handle;
+		std::string Address;			//客户端地址
+		std::string Path;				//连接路径
+		std::chrono::steady_clock::time_point Opened;
+		bool Authenticated = false;		//握手时提供了正确的令牌，服务器没有设置令牌时总是为true
+		std::atomic_bool BinaryImage{false};		//图像以二进制帧发送，JSON中只包含图像信息
+		std::atomic_bool StyledJson{false};		//输出带缩进的JSON，便于调试
+		std::atomic_bool DeltaTelemetry{false};	//ControlData只发送变化的字段
+		bool Deflate = false;					//握手时协商了permessage-deflate
+		std::atomic_bool Compress{true};			//客户端可以关闭压缩，节省双方的CPU
+		AstroAir::OutboundQueue Out;	//发送队列
+		/*订阅的主题，默认与旧客户端相同，接收所有信息*/
+		std::atomic_int Images{AstroAir::ImageFull};	//ImageFull、ImageScreen、ImageThumbnail或ImageNone
+		std::atomic_bool Logs{true};
+		std::atomic_int LogLevel{0};				//只接收Type不小于该值的日志
+		std::atomic_bool Progress{true};
+		std::atomic_bool Telemetry{true};
+		std::atomic_int TelemetryInterval{-1};	//遥测信息的最小间隔(毫秒)，-1表示完整模式每秒一次，增量模式立即发送
+		std::atomic_bool GuideSteps{false};		//每一步导星数据，数据量较大，默认不发送
+		/*增量遥测状态，只在遥测线程中使用*/
+		Json::Value LastTelemetry;
+		std::chrono::steady_clock::time_point Keyframe;
+		std::chrono::steady_clock::time_point TelemetrySent;
+		/*是否需要该主题的信息，level为日志类型或图像订阅*/
+		bool Wants(AstroAir::Topic topic,int level = 0) const
+		{
+			switch(topic)
+			{
+				case AstroAir::Topic::Logs:
+					return Logs && level >= LogLevel;
+				case AstroAir::Topic::Progress:
+					return Progress;
+				case AstroAir::Topic::Images:
+					return level ? Images == level : Images != AstroAir::ImageNone;
+				case AstroAir::Topic::Telemetry:
+					return Telemetry;
+				case AstroAir::Topic::GuideSteps:
+					return GuideSteps;
+				default:
+					return true;
+			}
+		}
+	};
+	typedef std::shared_ptr<ClientSession> SessionPtr;
+	typedef std::vector<SessionPtr> SessionList;
+	/*以连接对象的地址为键，查找不需要比较weak_ptr*/
+	typedef std::unordered_map<const void *,SessionPtr> con_list;
 	using websocketpp::lib::placeholders::_1;
 	using websocketpp::lib::placeholders::_2;
 	using websocketpp::lib::bind;
@@ -81,24 +163,100 @@ namespace AstroAir
 			/*WebSocket服务器主体函数*/
 			explicit WSSERVER();
 			~WSSERVER();
+			/*加载配置并初始化，必须在main()中运行服务器之前调用*/
+			void Init();
+			/*停止服务器并释放驱动，必须在main()返回之前调用*/
+			void Shutdown();
+			/*握手时检查客户端数量和令牌，超过上限的连接不会被接受*/
+			virtual bool on_validate(websocketpp::connection_hdl hdl);
+			virtual void on_fail(websocketpp::connection_hdl hdl);
 			virtual void on_open(websocketpp::connection_hdl hdl);
 			virtual void on_close(websocketpp::connection_hdl hdl);
 			virtual void on_message(websocketpp::connection_hdl hdl,message_ptr msg);
 			virtual void send(std::string payload);
+			/*按照客户端的设置序列化并发送信息*/
+			virtual void send(const Json::Value &Root,OutboundQueue::Class type = OutboundQueue::Result);
+			/*发送图像，二进制模式的客户端先收到图像信息，再收到二进制图像帧*/
+			virtual void sendImage(Json::Value &Root,unsigned int ImageID);
+			/*只发送给订阅了该主题的客户端*/
+			void Publish(Topic topic,const Json::Value &Root,int level = 0);
+			/*是否有客户端订阅了该主题，没有时调用者可以不生成信息*/
+			bool Subscribed(Topic topic,int level = 0);
 			virtual void stop();
 			virtual bool is_running();
 			/*运行服务器*/
 			virtual void run(int port);
+			/*设备状态发生变化，立即推送遥测信息*/
+			void NotifyTelemetry();
 		protected:
+			/*网络线程*/
+			void RunIOThread();
+			/*获取当前所有客户端，返回的列表在客户端连接或断开前保持不变*/
+			std::shared_ptr<const SessionList> Sessions();
+			SessionPtr Session(websocketpp::connection_hdl hdl);
+			void UpdateSessions();
+			/*获取客户端信息*/
+			void GetClients(websocketpp::connection_hdl hdl);
+			/*向指定客户端发送命令结果*/
+			void sendTo(websocketpp::connection_hdl hdl,const std::string &payload);
+			/*只回复发出命令的客户端，按照该客户端的格式序列化*/
+			void ReplyTo(websocketpp::connection_hdl hdl,Json::Value Root);
+			/*同一预览等级的图像发送给多个客户端时共用编码结果*/
+			struct ImagePayload
+			{
+				bool loaded = false;
+				PreviewCache::Preview preview;
+				OutboundQueue::Payload text[2],meta[2],frame;
+			};
+			/*按照客户端的协议发送一级预览图，图像已不在缓存中时返回false*/
+			bool PostImage(const SessionPtr &client,const Json::Value &Root,unsigned int ImageID,int tier,ImagePayload &cache,OutboundQueue::Class type = OutboundQueue::Image);
+			/*客户端请求其他等级的图像*/
+			void GetImage(websocketpp::connection_hdl hdl,const CommandParams &params);
+			/*按主题过滤后发送给客户端*/
+			void Broadcast(const Json::Value &Root,OutboundQueue::Class type,Topic topic,int level);
+			/*加入客户端发送队列*/
+			void Post(const SessionPtr &client,OutboundQueue::Class type,std::vector<OutboundQueue::Frame> frames);
+			void Post(const SessionPtr &client,OutboundQueue::Class type,const OutboundQueue::Payload &payload);
+			/*将发送队列中的信息交给网络线程*/
+			void Flush(const SessionPtr &client);
+			void FlushAll();
+			void ScheduleFlush();
+			/*命令表中的处理函数需要访问以下函数*/
+			friend struct WSCommands;
 			/*转化Json信息*/
-			void readJson(std::string message);
+			void readJson(MessagePtr message);
+			/*将任务提交至任务池*/
+			bool Dispatch(const MessagePtr &message,const CommandEntry &cmd,const OperationPtr &op);
+			void RunCommand(const CommandEntry &cmd,const MessagePtr &message,const OperationPtr &op);
+			/*请求结束*/
+			void RequestComplete(const OperationPtr &op,bool executed);
+			/*取消请求*/
+			void CancelRequest(websocketpp::connection_hdl hdl,const CommandParams &params);
+			/*获取正在进行的请求*/
+			void GetOperations(websocketpp::connection_hdl hdl);
+			/*获取命令统计信息*/
+			void GetMethodMetrics(websocketpp::connection_hdl hdl);
 			/*WebSocket服务器功能性函数*/
 			void SetDashBoardMode();
 			/*获取配置文件*/
 			void GetAstroAirProfiles();
 			/*设置配置文件*/
 			void SetProfile(std::string File_Name);
+			/*设置客户端通信协议*/
+			void SetProtocolMode(websocketpp::connection_hdl hdl,const CommandParams &params);
+			/*订阅和取消订阅主题*/
+			void Subscribe(websocketpp::connection_hdl hdl,const CommandParams &params);
+			void Unsubscribe(websocketpp::connection_hdl hdl,const CommandParams &params);
+			void SubscriptionSend(websocketpp::connection_hdl hdl,const SessionPtr &session);
+			/*重新统计各主题的订阅数量，调用者必须持有con_mtx*/
+			void UpdateSubscribers();
 			void SetupConnect(int timeout);
+			/*连接单个设备*/
+			bool ConnectDevice(const DevicePtr &dev,int timeout);
+			void DeviceConnectSend(const DevicePtr &dev,bool ok,int attempts,double used);
+			/*注册内置驱动*/
+			void RegisterBuiltinDrivers();
+			void GetDevices(websocketpp::connection_hdl hdl);
 			void SetupDisconnect(int timeout);
 			void GetFilterConfiguration();
 			/*处理正确返回信息*/
@@ -106,29 +264,41 @@ namespace AstroAir
 			void SetupDisconnectSuccess();
 			void EnvironmentDataSend();
 			void ControlDataSend();
+			Json::Value ControlDataSnapshot();
+			Json::Value ControlDataDelta(const Json::Value &last,const Json::Value &now);
 			/*处理错误信息函数*/
-			void SetupConnectError(int id);
-			void UnknownMsg();
+			void SetupConnectError(int id,const Json::Value &failed = Json::Value());
+			void UnknownMsg(websocketpp::connection_hdl hdl);
 			void UnknownDevice(int id,std::string message);
-			void ClientNumError();
+			void ServerBusyError(websocketpp::connection_hdl hdl,std::string method);
+			void InvalidParamError(websocketpp::connection_hdl hdl,std::string method,std::string param);
+			void DuplicateRequestError(websocketpp::connection_hdl hdl,std::string method,const Json::Value &id);
+			void DeviceNotFoundError(websocketpp::connection_hdl hdl,std::string method,std::string device);
 			void ErrorCode();
 			void Polling();
 		private:
 			airserver m_server;
 			con_list m_connections;
+			con_list m_pending;				//握手已通过但还没有打开的连接，同样计入客户端数量
+			std::shared_ptr<const SessionList> m_sessions = std::make_shared<const SessionList>();
+			/*只保护m_connections、m_pending和m_sessions，send()可以在持有mtx时调用*/
+			mutex con_mtx;
+			/*各主题的订阅数量，客户端连接、断开或修改订阅时重新统计*/
+			std::atomic_int subscribers[(int)Topic::TopicNum];
+			std::atomic_int image_subscribers[ImageFull + 1];
+			std::atomic_int min_log_level;
+			std::atomic_bool flush_scheduled;
+			mutex telemetry_mtx;
+			condition_variable telemetry_cond;
+			bool telemetry_changed = false;
 			virtual bool LoadConfigure();
-			Json::Value root;
-			Json::String errs;
-			Json::CharReaderBuilder reader;
+			MessagePool messages;
 
 			mutex mtx,mtx_action;
 			condition_variable m_server_cond,m_server_action;
 			/*定义服务器设备参数*/
 			std::string FileName;
 			std::string FileBuf[10];
-			int DeviceNum = 0;
-			int ClientNum = 0;
-			std::string DeviceBuf[5];
 			/*服务器设备连接状态参数*/
 			std::atomic_bool isConnected;
 			std::atomic_bool Running;
@@ -136,13 +306,21 @@ namespace AstroAir
 	extern WSSERVER ws;
 	extern std::string SequenceTarget;
 	void WebLog(std::string message,int type);
+	void TelemetryChanged();
 	/*服务器配置参数*/
 	struct ServerSetting
 	{
 		int MaxUsedTime;		//解析最长时间
 		int MaxThreadNumber;	//最多能同时处理的事件数量
 		int MaxClientNumber;	//最大客户端数量
-		int thread_num; 		//线程数量	
+		int MaxTaskNumber;		//最多能排队等待的事件数量
+		int IOThreadNumber;		//网络线程数量
+		int TelemetryKeyframe;	//增量遥测发送完整信息的间隔(秒)
+		int MaxSendBuffer;		//每个客户端网络层最多缓存的数据(KB)，超过后信息留在发送队列中
+		bool Compression;		//协商了permessage-deflate的客户端是否压缩文本信息
+		int CompressMinSize;	//小于该长度(字节)的信息不压缩
+		std::string PluginDirectory;	//驱动插件目录
+		std::string AccessToken;		//客户端连接时需要提供的令牌(ws://host:port/?token=...)，为空时不检查
 	};extern ServerSetting *SS;
 	extern std::string TargetRA,TargetDEC,MountAngle;
 }
@@ -0,0 +1,7 @@
+#include <memory>
+#include <mutex>
+#include <cstdio>
+struct S; struct Pool{ std::shared_ptr<S> s; Pool(); void Set(int n); };
+extern Pool *FR;
+struct W{ W(){ std::printf("ws ctor, pool shared=%p\n",(void*)FR->s.get()); } };
+W ws;